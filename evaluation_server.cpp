@@ -0,0 +1,981 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "evaluation_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const uint64_t EvaluationServer::LISTEN_ID;
+const uint64_t EvaluationServer::WAKE_ID;
+const uint64_t EvaluationServer::TIMER_ID;
+const uint64_t EvaluationServer::FIRST_CONNECTION_ID;
+
+EvaluationServer::EvaluationServer(const Config& config): m_config(config) {
+
+/*
+	Listens on the socket, replacing a socket left at the path by a previous
+	server, and starts the workers. Throws SERVER_ERROR on failure.
+*/
+
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if(m_config.socketPath.empty() ||
+		m_config.socketPath.size() >= sizeof(address.sun_path)) {
+		throw SERVER_ERROR("Bad socket path: " + m_config.socketPath);
+	}
+
+	std::memcpy(address.sun_path, m_config.socketPath.c_str(),
+		m_config.socketPath.size());
+
+	struct stat pathStat;
+
+	if(lstat(m_config.socketPath.c_str(), &pathStat) == 0 &&
+		S_ISSOCK(pathStat.st_mode)) {
+		unlink(m_config.socketPath.c_str());
+	}
+
+	auto fail = [this](const std::string& what) {
+		std::string error = what + ": " + std::strerror(errno);
+		m_close();
+		throw SERVER_ERROR(error);
+	};
+
+	m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(m_listenFd < 0) fail("socket()");
+
+	if(bind(m_listenFd, (const sockaddr*)&address, sizeof(address)) != 0) {
+		fail("Cannot bind " + m_config.socketPath);
+	}
+
+	if(listen(m_listenFd, SOMAXCONN) != 0) fail("listen()");
+
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(m_epollFd < 0) fail("epoll_create1()");
+
+	m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_wakeFd < 0) fail("eventfd()");
+
+	m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(m_timerFd < 0) fail("timerfd_create()");
+
+	const std::pair<int, uint64_t> fds[] = {{m_listenFd, LISTEN_ID},
+		{m_wakeFd, WAKE_ID}, {m_timerFd, TIMER_ID}};
+
+	for(const auto& fd: fds) {
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = fd.second;
+
+		if(epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd.first, &event) != 0) {
+			fail("epoll_ctl()");
+		}
+	}
+
+	size_t numWorkers = m_config.numWorkers ? m_config.numWorkers :
+		std::max(1u, std::thread::hardware_concurrency());
+
+	for(size_t i = 0; i < numWorkers; i++) {
+		m_workers.emplace_back(&EvaluationServer::m_work, this);
+	}
+
+}
+
+EvaluationServer::~EvaluationServer() {
+
+	{
+		std::lock_guard<std::mutex> lock(m_taskMutex);
+		m_isStopping = true;
+	}
+
+	m_taskCondition.notify_all();
+
+	for(auto& worker: m_workers) worker.join();
+
+	while(!m_connections.empty()) {
+		m_close_connection(m_connections.begin()->first);
+	}
+
+	if(m_listenFd >= 0) unlink(m_config.socketPath.c_str());
+
+	m_close();
+
+}
+
+void EvaluationServer::run() {
+
+/*
+	Runs the event loop in the calling thread, until stop() is called. The
+	connections are closed when it returns, and the requests in progress
+	are dropped.
+*/
+
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+
+	while(!m_isStopping) {
+		int numEvents = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+
+		if(numEvents < 0) {
+			if(errno == EINTR) continue;
+
+			throw SERVER_ERROR(std::string("epoll_wait(): ") +
+				std::strerror(errno));
+		}
+
+		for(int i = 0; i < numEvents; i++) {
+			uint64_t id = events[i].data.u64;
+			uint64_t count;
+
+			switch(id) {
+				case LISTEN_ID:
+					m_accept();
+					break;
+				case WAKE_ID:
+					while(read(m_wakeFd, &count, sizeof(count)) > 0) {}
+					m_drain_completions();
+					break;
+				case TIMER_ID:
+					while(read(m_timerFd, &count, sizeof(count)) > 0) {}
+					m_flush_batches(false);
+					break;
+				default:
+					if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+						m_read(id);
+					}
+
+					if(events[i].events & EPOLLOUT) m_write(id);
+			}
+		}
+	}
+
+	m_batches.clear();
+
+	while(!m_connections.empty()) {
+		m_close_connection(m_connections.begin()->first);
+	}
+
+}
+
+void EvaluationServer::stop() noexcept {
+
+	m_isStopping = true;
+
+	uint64_t one = 1;
+	ssize_t written = write(m_wakeFd, &one, sizeof(one));
+	(void)written;
+
+}
+
+EvaluationServer::Stats EvaluationServer::stats() const {
+
+	return Stats {m_numConnections, m_numCompiles, m_numEvaluations,
+		m_numBatches, m_numRows, m_numErrors, m_numChannels};
+
+}
+
+void EvaluationServer::m_accept() {
+
+	while(true) {
+		int fd = accept4(m_listenFd, nullptr, nullptr,
+			SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if(fd < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+
+			// EAGAIN, or out of descriptors: the rest wait in the backlog
+			return;
+		}
+
+		uint64_t id = m_nextConnectionId++;
+
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = id;
+
+		if(epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			continue;
+		}
+
+		m_connections[id] = Connection {fd, std::string(), std::string(),
+			false, 0, {}, {}};
+		m_numConnections++;
+	}
+
+}
+
+void EvaluationServer::m_read(uint64_t connectionId) {
+
+/*
+	Reads what the connection sent, and handles the complete frames. Closes
+	the connection at the end of the stream, on errors, and on malformed
+	frames.
+*/
+
+	auto found = m_connections.find(connectionId);
+	if(found == m_connections.end()) return;
+
+	char buffer[65536];
+	bool isClosed = false;
+
+	while(true) {
+		ssize_t length = read(found->second.fd, buffer, sizeof(buffer));
+
+		if(length > 0) {
+			found->second.in.append(buffer, length);
+			continue;
+		}
+
+		if(length < 0 && errno == EINTR) continue;
+		if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+		isClosed = true;
+		break;
+	}
+
+	size_t offset = 0;
+
+	while(true) {
+		// handling a request may close the connection
+		found = m_connections.find(connectionId);
+		if(found == m_connections.end()) return;
+
+		std::string& in = found->second.in;
+		if(in.size() - offset < sizeof(uint32_t)) break;
+
+		uint32_t length = m_read_u32(in.data() + offset);
+
+		if(length > m_config.maxFrameSize) {
+			m_close_connection(connectionId);
+			return;
+		}
+
+		if(in.size() - offset - sizeof(uint32_t) < length) break;
+
+		std::string payload = in.substr(offset + sizeof(uint32_t), length);
+		offset += sizeof(uint32_t) + length;
+
+		if(!m_handle_request(connectionId, payload)) {
+			m_close_connection(connectionId);
+			return;
+		}
+	}
+
+	found->second.in.erase(0, offset);
+
+	if(isClosed) m_close_connection(connectionId);
+
+}
+
+void EvaluationServer::m_write(uint64_t connectionId) {
+
+/*
+	Sends as much of the pending output of the connection as the socket
+	takes, and waits for EPOLLOUT for the rest. File descriptors are passed
+	with the first byte of their frame, which is sent with sendmsg().
+*/
+
+	auto found = m_connections.find(connectionId);
+	if(found == m_connections.end()) return;
+
+	Connection& connection = found->second;
+	size_t offset = 0;
+
+	while(offset < connection.out.size()) {
+		uint64_t position = connection.numSent + offset;
+		size_t size = connection.out.size() - offset;
+		int passedFd = -1;
+
+		if(!connection.outFds.empty()) {
+			uint64_t fdPosition = connection.outFds.front().first;
+
+			if(fdPosition == position) passedFd = connection.outFds.front().second;
+			else size = std::min<uint64_t>(size, fdPosition - position);
+		}
+
+		ssize_t length;
+
+		if(passedFd < 0) {
+			length = send(connection.fd, connection.out.data() + offset, size,
+				MSG_NOSIGNAL);
+		}
+		else {
+			iovec data {&connection.out[offset], size};
+			char control[CMSG_SPACE(sizeof(int))];
+			std::memset(control, 0, sizeof(control));
+
+			msghdr message;
+			std::memset(&message, 0, sizeof(message));
+			message.msg_iov = &data;
+			message.msg_iovlen = 1;
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+
+			cmsghdr* header = CMSG_FIRSTHDR(&message);
+			header->cmsg_level = SOL_SOCKET;
+			header->cmsg_type = SCM_RIGHTS;
+			header->cmsg_len = CMSG_LEN(sizeof(int));
+			std::memcpy(CMSG_DATA(header), &passedFd, sizeof(int));
+
+			length = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+		}
+
+		if(length > 0) {
+			offset += length;
+			if(passedFd >= 0) connection.outFds.pop_front();
+			continue;
+		}
+
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+		m_close_connection(connectionId);
+		return;
+	}
+
+	connection.out.erase(0, offset);
+	connection.numSent += offset;
+
+	bool isWaitingOut = !connection.out.empty();
+	if(isWaitingOut == connection.isWaitingOut) return;
+
+	epoll_event event;
+	event.events = isWaitingOut ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	event.data.u64 = connectionId;
+
+	epoll_ctl(m_epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+	connection.isWaitingOut = isWaitingOut;
+
+}
+
+void EvaluationServer::m_send(uint64_t connectionId,
+	const std::string& frame, int passedFd) {
+
+/*
+	Sends the frame, and the file descriptor with it if one is given, unless
+	the connection was closed meanwhile. The descriptor must stay open until
+	the connection is closed.
+*/
+
+	auto found = m_connections.find(connectionId);
+	if(found == m_connections.end()) return;
+
+	Connection& connection = found->second;
+
+	if(passedFd >= 0) {
+		connection.outFds.emplace_back(
+			connection.numSent + connection.out.size(), passedFd);
+	}
+
+	connection.out += frame;
+
+	if(!found->second.isWaitingOut) m_write(connectionId);
+
+}
+
+void EvaluationServer::m_close_connection(uint64_t connectionId) {
+
+	auto found = m_connections.find(connectionId);
+	if(found == m_connections.end()) return;
+
+	for(auto& channel: found->second.channels) {
+		channel->ring.close_channel();
+		channel->thread.join();
+	}
+
+	close(found->second.fd);
+	m_connections.erase(found);
+
+}
+
+bool EvaluationServer::m_handle_request(uint64_t connectionId,
+	const std::string& payload) {
+
+/*
+	Handles a request frame. Returns false if it is malformed.
+*/
+
+	const size_t HEADER_SIZE = 1 + sizeof(uint32_t);
+	if(payload.size() < HEADER_SIZE) return false;
+
+	Opcode opcode = (Opcode)payload[0];
+	uint32_t requestId = m_read_u32(payload.data() + 1);
+
+	if(opcode == Opcode::COMPILE) {
+		std::string text = payload.substr(HEADER_SIZE);
+
+		m_post([this, connectionId, requestId, text](WorkerExprs&) {
+			m_compile(connectionId, requestId, text);
+		});
+
+		return true;
+	}
+
+	if(opcode == Opcode::OPEN_CHANNEL) {
+		if(payload.size() != HEADER_SIZE + 2 * sizeof(uint32_t)) return false;
+
+		m_open_channel(connectionId, requestId,
+			m_read_u32(payload.data() + HEADER_SIZE),
+			m_read_u32(payload.data() + HEADER_SIZE + sizeof(uint32_t)));
+
+		return true;
+	}
+
+	if(opcode != Opcode::EVALUATE) return false;
+
+	const size_t EVALUATE_SIZE = HEADER_SIZE + 2 * sizeof(uint32_t);
+	if(payload.size() < EVALUATE_SIZE) return false;
+
+	uint32_t exprId = m_read_u32(payload.data() + HEADER_SIZE);
+	uint32_t numRows = m_read_u32(payload.data() + HEADER_SIZE +
+		sizeof(uint32_t));
+
+	m_numEvaluations++;
+
+	std::shared_ptr<const Expression> expression = m_expression(exprId);
+
+	if(!expression) {
+		m_send(connectionId, m_error_frame(requestId,
+			"Unknown expression id: " + std::to_string(exprId)));
+		return true;
+	}
+
+	size_t numVars = expression->varNames.size();
+
+	// the response must fit in a frame, whatever the size of the request 
+	// (which is only the header for an expression without variables)
+	const size_t RESULT_HEADER_SIZE = HEADER_SIZE + sizeof(uint32_t);
+	const size_t maxFrameSize = std::min<size_t>(m_config.maxFrameSize, 
+		UINT32_MAX);
+	const size_t maxRows = maxFrameSize < RESULT_HEADER_SIZE ? 0 : 
+		(maxFrameSize - RESULT_HEADER_SIZE) / sizeof(double);
+
+	if(numRows == 0 || numRows > maxRows) {
+		m_send(connectionId, m_error_frame(requestId, "Expected from 1 to " +
+			std::to_string(maxRows) + " rows"));
+		return true;
+	}
+
+	if(payload.size() != EVALUATE_SIZE +
+		(size_t)numRows * numVars * sizeof(double)) {
+		m_send(connectionId, m_error_frame(requestId, "Expected " +
+			std::to_string(numRows) + " rows of " + std::to_string(numVars) +
+			" values"));
+		return true;
+	}
+
+	m_add_to_batch(connectionId, requestId, exprId, numVars,
+		payload.data() + EVALUATE_SIZE, numRows);
+
+	return true;
+
+}
+
+void EvaluationServer::m_compile(uint64_t connectionId, uint32_t requestId,
+	const std::string& text) {
+
+/*
+	Runs in a worker. Initializes the expression, unless it was compiled
+	before, and responds with its id and variables.
+*/
+
+	m_numCompiles++;
+
+	std::shared_ptr<const Expression> expression;
+	uint32_t exprId = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_exprMutex);
+
+		auto found = m_exprIds.find(text);
+
+		if(found != m_exprIds.end()) {
+			exprId = found->second;
+			expression = m_exprs[exprId];
+		}
+	}
+
+	if(!expression) {
+		auto created = std::make_shared<Expression>();
+
+		try {
+			created->expr.init_with_expr(text);
+			created->varNames = created->expr.variable_names();
+		}
+		catch(const std::exception& e) {
+			m_complete(connectionId, m_error_frame(requestId, e.what()));
+			return;
+		}
+		catch(...) {
+			m_complete(connectionId, m_error_frame(requestId,
+				"Unknown error while compiling the expression"));
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_exprMutex);
+
+		// another worker may have compiled the same text meanwhile
+		auto inserted = m_exprIds.emplace(text, (uint32_t)m_exprs.size());
+		if(inserted.second) m_exprs.push_back(created);
+
+		exprId = inserted.first->second;
+		expression = m_exprs[exprId];
+	}
+
+	std::string body;
+	m_append_u32(body, exprId);
+	m_append_u32(body, (uint32_t)expression->varNames.size());
+
+	for(const auto& varName: expression->varNames) {
+		m_append_u32(body, (uint32_t)varName.size());
+		body += varName;
+	}
+
+	m_complete(connectionId,
+		m_frame_header(Status::OK, requestId, body.size()) + body);
+
+}
+
+void EvaluationServer::m_open_channel(uint64_t connectionId,
+	uint32_t requestId, uint32_t numSlots, uint32_t slotValues) {
+
+/*
+	Creates a shared memory channel, starts its thread, and sends its file
+	descriptor. The channel is closed with the connection.
+*/
+
+	if(numSlots == 0 || slotValues == 0 || (uint64_t)numSlots *
+		(slotValues * sizeof(double) + 64) > m_config.maxChannelSize) {
+		m_send(connectionId, m_error_frame(requestId,
+			"Bad channel size, at most " +
+			std::to_string(m_config.maxChannelSize) + " bytes"));
+		return;
+	}
+
+	std::shared_ptr<Channel> channel;
+
+	try {
+		channel = std::make_shared<Channel>(Channel {
+			SharedMemoryChannel::create(numSlots, slotValues), std::thread()});
+	}
+	catch(const std::exception& e) {
+		m_send(connectionId, m_error_frame(requestId, e.what()));
+		return;
+	}
+
+	channel->thread = std::thread(&EvaluationServer::m_serve_channel, this,
+		std::ref(*channel));
+
+	m_connections[connectionId].channels.push_back(channel);
+	m_numChannels++;
+
+	std::string frame = m_frame_header(Status::OK, requestId,
+		2 * sizeof(uint32_t));
+	m_append_u32(frame, numSlots);
+	m_append_u32(frame, slotValues);
+
+	m_send(connectionId, frame, channel->ring.fd());
+
+}
+
+void EvaluationServer::m_serve_channel(Channel& channel) {
+
+/*
+	The thread of a channel. Calculates its requests one by one, with its own
+	copies of the expressions.
+*/
+
+	std::unordered_map<uint32_t, std::pair<MathInterpreter,
+		std::shared_ptr<const Expression>>> exprs;
+
+	channel.ring.serve([&](uint32_t exprId, const double* values,
+		size_t numRows, size_t numValues, double* results,
+		std::string& error) {
+		auto found = exprs.find(exprId);
+
+		if(found == exprs.end()) {
+			std::shared_ptr<const Expression> expression =
+				m_expression(exprId);
+
+			if(!expression) {
+				error = "Unknown expression id: " + std::to_string(exprId);
+				m_numErrors++;
+				return false;
+			}
+
+			found = exprs.emplace(exprId,
+				std::make_pair(expression->expr, expression)).first;
+		}
+
+		const std::vector<std::string>& varNames =
+			found->second.second->varNames;
+
+		if(numValues != numRows * varNames.size()) {
+			error = "Expected " + std::to_string(numRows) + " rows of " +
+				std::to_string(varNames.size()) + " values";
+			m_numErrors++;
+			return false;
+		}
+
+		std::vector<double> rowResults = m_calculate_rows(found->second.first,
+			varNames, values, numRows);
+		std::copy(rowResults.begin(), rowResults.end(), results);
+
+		m_numEvaluations++;
+		m_numRows += numRows;
+
+		return true;
+	});
+
+}
+
+void EvaluationServer::m_add_to_batch(uint64_t connectionId,
+	uint32_t requestId, uint32_t exprId, size_t numVars, const char* values,
+	size_t numRows) {
+
+/*
+	Adds the rows of an EVALUATE request to the open batch of the
+	expression, opening one if there is none. The batch is calculated when
+	full, or by m_flush_batches() at the end of its window.
+*/
+
+	auto found = m_batches.find(exprId);
+
+	if(found == m_batches.end()) {
+		Batch batch {exprId, numVars, std::vector<double>(), 0,
+			std::vector<Waiter>(),
+			std::chrono::steady_clock::now() + m_config.batchWindow};
+
+		found = m_batches.emplace(exprId, std::move(batch)).first;
+	}
+
+	Batch& batch = found->second;
+
+	size_t valueOffset = batch.values.size();
+	batch.values.resize(valueOffset + numRows * numVars);
+	std::memcpy(batch.values.data() + valueOffset, values,
+		numRows * numVars * sizeof(double));
+
+	batch.numRows += numRows;
+	batch.waiters.push_back(Waiter {connectionId, requestId, numRows});
+
+	if(batch.numRows >= m_config.maxBatchRows ||
+		m_config.batchWindow.count() <= 0) {
+		auto full = std::make_shared<Batch>(std::move(batch));
+		m_batches.erase(found);
+
+		m_post([this, full](WorkerExprs& exprs) { m_calculate(*full, exprs); });
+	}
+
+	m_arm_timer();
+
+}
+
+void EvaluationServer::m_flush_batches(bool isAll) {
+
+/*
+	Hands the batches whose window ended, or all of them, to the workers.
+*/
+
+	auto now = std::chrono::steady_clock::now();
+
+	for(auto it = m_batches.begin(); it != m_batches.end(); ) {
+		if(!isAll && it->second.deadline > now) {
+			it++;
+			continue;
+		}
+
+		auto batch = std::make_shared<Batch>(std::move(it->second));
+		it = m_batches.erase(it);
+
+		m_post([this, batch](WorkerExprs& exprs) { m_calculate(*batch, exprs); });
+	}
+
+	m_arm_timer();
+
+}
+
+void EvaluationServer::m_arm_timer() {
+
+/*
+	Sets the timer to the end of the earliest window of the open batches, or
+	disarms it if there are none.
+*/
+
+	itimerspec timer;
+	std::memset(&timer, 0, sizeof(timer));
+
+	if(!m_batches.empty()) {
+		auto deadline = m_batches.begin()->second.deadline;
+
+		for(const auto& batch: m_batches) {
+			deadline = std::min(deadline, batch.second.deadline);
+		}
+
+		int64_t delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			deadline - std::chrono::steady_clock::now()).count();
+
+		// a zero it_value would disarm the timer
+		delay = std::max<int64_t>(delay, 1);
+
+		timer.it_value.tv_sec = delay / 1000000000;
+		timer.it_value.tv_nsec = delay % 1000000000;
+	}
+
+	timerfd_settime(m_timerFd, 0, &timer, nullptr);
+
+}
+
+void EvaluationServer::m_calculate(const Batch& batch, WorkerExprs& exprs) {
+
+/*
+	Runs in a worker. Calculates the rows of all requests of the batch at
+	once, and responds to each request with its own rows.
+*/
+
+	auto found = exprs.find(batch.exprId);
+
+	if(found == exprs.end()) {
+		found = exprs.emplace(batch.exprId,
+			m_expression(batch.exprId)->expr).first;
+	}
+
+	std::vector<double> results;
+
+	try {
+		results = m_calculate_rows(found->second,
+			m_expression(batch.exprId)->varNames, batch.values.data(),
+			batch.numRows);
+	}
+	catch(const std::exception& e) {
+		for(const auto& waiter: batch.waiters) {
+			m_complete(waiter.connectionId,
+				m_error_frame(waiter.requestId, e.what()));
+		}
+
+		return;
+	}
+
+	m_numBatches++;
+	m_numRows += batch.numRows;
+
+	size_t rowOffset = 0;
+
+	for(const auto& waiter: batch.waiters) {
+		size_t resultSize = waiter.numRows * sizeof(double);
+
+		std::string frame = m_frame_header(Status::OK, waiter.requestId,
+			sizeof(uint32_t) + resultSize);
+		m_append_u32(frame, (uint32_t)waiter.numRows);
+		frame.append((const char*)(results.data() + rowOffset), resultSize);
+
+		rowOffset += waiter.numRows;
+
+		m_complete(waiter.connectionId, std::move(frame));
+	}
+
+}
+
+std::vector<double> EvaluationServer::m_calculate_rows(MathInterpreter& expr,
+	const std::vector<std::string>& varNames, const double* values,
+	size_t numRows) {
+
+/*
+	Calculates the rows of variable values, given row by row, with 
+	calculate_batch().
+*/
+
+	if(varNames.empty()) return std::vector<double>(numRows, expr.calculate());
+
+	std::vector<MathInterpreter::BatchColumn> columns;
+
+	for(size_t var = 0; var < varNames.size(); var++) {
+		columns.emplace_back(varNames[var], std::vector<double>(numRows));
+
+		std::vector<double>& column = columns.back().second;
+
+		for(size_t row = 0; row < numRows; row++) {
+			column[row] = values[row * varNames.size() + var];
+		}
+	}
+
+	return expr.calculate_batch(columns);
+
+}
+
+void EvaluationServer::m_post(Task task) {
+
+	{
+		std::lock_guard<std::mutex> lock(m_taskMutex);
+		m_tasks.push_back(std::move(task));
+	}
+
+	m_taskCondition.notify_one();
+
+}
+
+void EvaluationServer::m_work() {
+
+/*
+	The loop of a worker. Each worker keeps its own copies of the
+	expressions, since calculating changes the state of an interpreter.
+*/
+
+	WorkerExprs exprs;
+
+	while(true) {
+		Task task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_taskMutex);
+
+			m_taskCondition.wait(lock, [this]() {
+				return m_isStopping || !m_tasks.empty();
+			});
+
+			if(m_isStopping) return;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task(exprs);
+	}
+
+}
+
+void EvaluationServer::m_complete(uint64_t connectionId, std::string frame) {
+
+/*
+	Called by the workers. Hands a response to the event loop, and wakes it
+	up if it was not already woken up for an earlier one.
+*/
+
+	bool isFirst;
+
+	{
+		std::lock_guard<std::mutex> lock(m_completionMutex);
+
+		isFirst = m_completions.empty();
+		m_completions.emplace_back(connectionId, std::move(frame));
+	}
+
+	if(isFirst) {
+		uint64_t one = 1;
+		ssize_t written = write(m_wakeFd, &one, sizeof(one));
+		(void)written;
+	}
+
+}
+
+void EvaluationServer::m_drain_completions() {
+
+	std::vector<std::pair<uint64_t, std::string>> completions;
+
+	{
+		std::lock_guard<std::mutex> lock(m_completionMutex);
+		completions.swap(m_completions);
+	}
+
+	for(const auto& completion: completions) {
+		m_send(completion.first, completion.second);
+	}
+
+}
+
+std::shared_ptr<const EvaluationServer::Expression>
+	EvaluationServer::m_expression(uint32_t exprId) const {
+
+	std::lock_guard<std::mutex> lock(m_exprMutex);
+
+	if(exprId >= m_exprs.size()) return nullptr;
+
+	return m_exprs[exprId];
+
+}
+
+std::string EvaluationServer::m_error_frame(uint32_t requestId,
+	const std::string& message) {
+
+	m_numErrors++;
+
+	return m_frame_header(Status::ERROR, requestId, message.size()) + message;
+
+}
+
+std::string EvaluationServer::m_frame_header(Status status,
+	uint32_t requestId, size_t bodySize) {
+
+/*
+	Returns the frame length, the status and the request id of a response
+	whose body has the given size. Throws SERVER_ERROR if the frame length
+	does not fit in its uint32.
+*/
+
+	if(bodySize > UINT32_MAX - 1 - sizeof(uint32_t)) {
+		throw SERVER_ERROR("Response of " + std::to_string(bodySize) + 
+			" bytes is too long for a frame");
+	}
+
+	std::string header;
+
+	m_append_u32(header, (uint32_t)(1 + sizeof(uint32_t) + bodySize));
+	header.push_back((char)status);
+	m_append_u32(header, requestId);
+
+	return header;
+
+}
+
+void EvaluationServer::m_append_u32(std::string& str, uint32_t val) {
+
+	char bytes[sizeof(val)];
+	std::memcpy(bytes, &val, sizeof(val));
+
+	str.append(bytes, sizeof(val));
+
+}
+
+uint32_t EvaluationServer::m_read_u32(const char* bytes) noexcept {
+
+	uint32_t val;
+	std::memcpy(&val, bytes, sizeof(val));
+
+	return val;
+
+}
+
+void EvaluationServer::m_close() noexcept {
+
+	const int fds[] = {m_listenFd, m_epollFd, m_wakeFd, m_timerFd};
+
+	for(const auto& fd: fds) {
+		if(fd >= 0) close(fd);
+	}
+
+	m_listenFd = m_epollFd = m_wakeFd = m_timerFd = -1;
+
+}
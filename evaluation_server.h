@@ -0,0 +1,302 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef EVALUATION_SERVER_H
+#define EVALUATION_SERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+#include "math_interpreter.h"
+#include "shm_channel.h"
+
+
+class SERVER_ERROR: public std::exception {
+
+public:
+	SERVER_ERROR(const std::string& details) {
+		m_returnMessage = "Evaluation server error: " + details;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class EvaluationServer {
+
+/*
+	Serves compile and evaluate requests over a Unix domain socket, for 
+	programs that cannot link the library. Linux only (epoll). See 
+	math_server.cpp for the server binary.
+
+	Protocol:
+		Every message, in both directions, is a frame: a uint32 length 
+		followed by that many bytes of payload. All integers and doubles
+		are little-endian (the byte order of the host).
+
+		Request payload:
+			uint8  opcode     COMPILE (1), EVALUATE (2) or OPEN_CHANNEL (3)
+			uint32 requestId  returned in the response, to match them
+			COMPILE:
+				the expression text, to the end of the payload
+			EVALUATE:
+				uint32 exprId     returned by COMPILE
+				uint32 numRows    at least 1, and few enough that the 
+				                  response is not longer than 
+				                  maxFrameSize
+				double values[numRows][numVars]  row by row, the variables 
+				                                 in the order given by 
+				                                 COMPILE
+			OPEN_CHANNEL:
+				uint32 numSlots
+				uint32 slotValues
+
+		Response payload:
+			uint8  status     OK (0) or ERROR (1)
+			uint32 requestId
+			ERROR:
+				the error message, to the end of the payload
+			COMPILE:
+				uint32 exprId
+				uint32 numVars
+				numVars times: uint32 length, and the variable name
+			EVALUATE:
+				uint32 numRows
+				double results[numRows]
+			OPEN_CHANNEL:
+				uint32 numSlots
+				uint32 slotValues
+				and the file descriptor of the channel, passed with the 
+				frame (SCM_RIGHTS)
+
+		Responses are sent when ready, so that they may come in another 
+		order than the requests of a connection. Compiling the same text 
+		again returns the same exprId, on every connection. A COMPILE of
+		text that is not a valid expression (e.g. "sin()" or "1+") gets an
+		ERROR response with the reason, and the connection stays open. A
+		malformed frame, or one longer than maxFrameSize, closes the 
+		connection.
+
+	How to use:
+
+		e.g. EvaluationServer::Config config;
+			 config.socketPath = "/run/math/eval.sock";
+			 EvaluationServer server(config);
+			 server.run(); // until stop() is called from another thread
+
+	A single thread runs the event loop (epoll) for all connections, and a
+	pool of workers compiles and calculates. EVALUATE requests are not 
+	calculated one by one: those of the same expression that arrive within
+	batchWindow of the first one, from any connection, are calculated 
+	together with calculate_batch(), which is much faster per row than 
+	calculate() for small requests. A batch is calculated as soon as it has
+	maxBatchRows rows, without waiting for the window to end. Set 
+	batchWindow to zero to calculate every request on its own.
+
+	OPEN_CHANNEL creates a SharedMemoryChannel (shm_channel.h), for clients
+	on the same host that cannot afford a round trip through the socket. 
+	The client attaches to the file descriptor it receives, and sends the 
+	rows of the expressions compiled with COMPILE through the channel. A 
+	thread per channel calculates its requests, each one on its own, until
+	the connection that opened the channel is closed.
+
+	stop() is safe to call from a signal handler. The compiled expressions,
+	and the copies the workers calculate them with, are kept until the 
+	server is destroyed.
+*/
+
+public:
+	struct Config {
+		std::string socketPath;
+		std::chrono::microseconds batchWindow {200};
+		size_t maxBatchRows = 4096;
+		size_t numWorkers = 0;             // 0 for one per core
+		size_t maxFrameSize = 64 << 20;    // bytes
+		size_t maxChannelSize = 64 << 20;  // bytes of the ring
+	};
+
+	struct Stats {
+		size_t connections; // accepted
+		size_t compiles;
+		size_t evaluations; // EVALUATE requests
+		size_t batches;     // calculate_batch() calls
+		size_t rows;
+		size_t errors;      // ERROR responses
+		size_t channels;    // opened
+	};
+
+	enum class Opcode: uint8_t {
+		COMPILE = 1,
+		EVALUATE = 2,
+		OPEN_CHANNEL = 3
+	};
+
+	enum class Status: uint8_t {
+		OK = 0,
+		ERROR = 1
+	};
+
+	EvaluationServer(const Config& config);
+
+	EvaluationServer(const EvaluationServer&) = delete;
+	EvaluationServer& operator=(const EvaluationServer&) = delete;
+
+	void run();
+	void stop() noexcept;
+
+	Stats stats() const;
+
+	virtual ~EvaluationServer();
+
+protected:
+	// epoll ids of the file descriptors that are not connections
+	static const uint64_t LISTEN_ID = 0;
+	static const uint64_t WAKE_ID = 1;
+	static const uint64_t TIMER_ID = 2;
+	static const uint64_t FIRST_CONNECTION_ID = 3;
+
+	struct Expression {
+		MathInterpreter expr;
+		std::vector<std::string> varNames;
+	};
+
+	struct Channel {
+		SharedMemoryChannel ring;
+		std::thread thread;
+	};
+
+	struct Connection {
+		int fd;
+		std::string in;  // received, not yet handled
+		std::string out; // not yet sent
+		bool isWaitingOut;
+		uint64_t numSent; // bytes
+		// file descriptors to pass, with the position in the output stream
+		// of the frame they go with
+		std::deque<std::pair<uint64_t, int>> outFds;
+		std::vector<std::shared_ptr<Channel>> channels;
+	};
+
+	// an EVALUATE request in a batch
+	struct Waiter {
+		uint64_t connectionId;
+		uint32_t requestId;
+		size_t numRows;
+	};
+
+	struct Batch {
+		uint32_t exprId;
+		size_t numVars;
+		std::vector<double> values; // row by row
+		size_t numRows;
+		std::vector<Waiter> waiters;
+		std::chrono::steady_clock::time_point deadline;
+	};
+
+	// the copies of the expressions a worker calculates with
+	using WorkerExprs = std::unordered_map<uint32_t, MathInterpreter>;
+	using Task = std::function<void(WorkerExprs&)>;
+
+	Config m_config;
+
+	int m_listenFd = -1;
+	int m_epollFd = -1;
+	int m_wakeFd = -1;  // eventfd, for completions and stop()
+	int m_timerFd = -1; // timerfd, for the end of the batch windows
+
+	std::atomic<bool> m_isStopping {false};
+
+	// used by the event loop only
+	std::map<uint64_t, Connection> m_connections;
+	uint64_t m_nextConnectionId = FIRST_CONNECTION_ID;
+	std::map<uint32_t, Batch> m_batches; // open batches, by exprId
+
+	mutable std::mutex m_exprMutex;
+	std::vector<std::shared_ptr<const Expression>> m_exprs; // by exprId
+	std::unordered_map<std::string, uint32_t> m_exprIds;
+
+	std::mutex m_taskMutex;
+	std::condition_variable m_taskCondition;
+	std::deque<Task> m_tasks;
+	std::vector<std::thread> m_workers;
+
+	// responses made by the workers, to be sent by the event loop
+	std::mutex m_completionMutex;
+	std::vector<std::pair<uint64_t, std::string>> m_completions;
+
+	std::atomic<size_t> m_numConnections {0};
+	std::atomic<size_t> m_numCompiles {0};
+	std::atomic<size_t> m_numEvaluations {0};
+	std::atomic<size_t> m_numBatches {0};
+	std::atomic<size_t> m_numRows {0};
+	std::atomic<size_t> m_numErrors {0};
+	std::atomic<size_t> m_numChannels {0};
+
+	void m_accept();
+	void m_read(uint64_t connectionId);
+	void m_write(uint64_t connectionId);
+	void m_send(uint64_t connectionId, const std::string& frame, 
+		int passedFd = -1);
+	void m_close_connection(uint64_t connectionId);
+
+	bool m_handle_request(uint64_t connectionId, const std::string& payload);
+	void m_compile(uint64_t connectionId, uint32_t requestId, 
+		const std::string& text);
+	void m_add_to_batch(uint64_t connectionId, uint32_t requestId,
+		uint32_t exprId, size_t numVars, const char* values, size_t numRows);
+
+	void m_open_channel(uint64_t connectionId, uint32_t requestId,
+		uint32_t numSlots, uint32_t slotValues);
+	void m_serve_channel(Channel& channel);
+
+	void m_flush_batches(bool isAll);
+	void m_arm_timer();
+	void m_calculate(const Batch& batch, WorkerExprs& exprs);
+	std::vector<double> m_calculate_rows(MathInterpreter& expr, 
+		const std::vector<std::string>& varNames, const double* values, 
+		size_t numRows);
+
+	void m_post(Task task);
+	void m_work();
+	void m_complete(uint64_t connectionId, std::string frame);
+	void m_drain_completions();
+
+	std::shared_ptr<const Expression> m_expression(uint32_t exprId) const;
+	std::string m_error_frame(uint32_t requestId, const std::string& message);
+	static std::string m_frame_header(Status status, uint32_t requestId, 
+		size_t bodySize);
+	static void m_append_u32(std::string& str, uint32_t val);
+	static uint32_t m_read_u32(const char* bytes) noexcept;
+
+	void m_close() noexcept;
+
+};
+
+#endif // !EVALUATION_SERVER_H
@@ -0,0 +1,337 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef EXPR_DSL_H
+#define EXPR_DSL_H
+
+#include <array>
+#include <cmath>
+#include <exception>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <type_traits>
+
+#include "static_expr.h"
+#include "math_interpreter.h"
+
+
+namespace expr_dsl {
+
+class NON_FINITE_CONSTANT: public std::exception {
+
+public:
+	virtual const char* what() const noexcept {
+		return "Infinite or NaN constants cannot be written as an expression.";
+	}
+
+};
+
+/*
+	Builds expressions in C++ code from the same functions and operators as 
+	MathInterpreter. Requires C++20.
+
+	How to use:
+		1. Create the variables with var(), giving each variable its position
+		   in the list of values and its name.
+
+			e.g. auto x = expr_dsl::var<0>("x");
+				 auto y = expr_dsl::var<1>("y");
+
+		2. Write the expression with the operators +, -, *, /, %, ^ and the
+		   functions under enum FUNCTION. Note that ^ has the precedence it
+		   has in C++, not the one it has in MathInterpreter, so put it in
+		   parentheses.
+
+			e.g. auto expr = sin(rad(x)) * y + (x ^ 2);
+
+		3. Either call the expression with the values of the variables, which
+		   runs inlined code just like StaticExpr:
+
+			e.g. double result = expr(37.81, 75.0);
+
+		   There must be a value for every position up to the largest one 
+		   used by the expression, or the call does not compile.
+
+		   or convert it to a MathInterpreter, to use it like an expression
+		   given as a string (batches, specialize() etc.):
+
+			e.g. MathInterpreter inter = expr_dsl::to_interpreter(expr);
+*/
+
+using static_expr_detail::Function;
+
+template<typename Derived>
+struct ExprBase {
+
+	// numSlots of Derived is the number of values the expression reads: one
+	// more than the largest position of its variables
+	template<typename... Args>
+		requires (sizeof...(Args) >= Derived::numSlots)
+	inline double operator()(Args... args) const {
+		const std::array<double, sizeof...(Args)> vars {(double)args...};
+		return static_cast<const Derived&>(*this).template eval<double>(
+			vars.data());
+	}
+
+};
+
+template<typename T>
+concept Expression = std::is_base_of_v<ExprBase<T>, T>;
+
+struct Number: ExprBase<Number> {
+
+	static constexpr std::size_t numSlots = 0;
+
+	double value;
+
+	explicit Number(double val) : value(val) {}
+
+	template<typename Real>
+	inline Real eval(const Real*) const {
+		return (Real)value;
+	}
+
+	std::string str() const {
+		if(!std::isfinite(value)) throw NON_FINITE_CONSTANT();
+
+		// negative numbers are only recognized at the beginning of the 
+		// expression, or after an operator or a left parenthesis
+		if(std::signbit(value)) return "(-" + m_plain(-value) + ")";
+
+		return m_plain(value);
+	}
+
+private:
+	static std::string m_plain(double val) {
+
+	/*
+		Writes the number with all the digits needed to convert it back 
+		exactly, and without an exponent, which MathInterpreter does not 
+		accept: e.g. 1e-05 as 0.000010000000000000001.
+	*/
+
+		std::ostringstream oss;
+		oss.precision(std::numeric_limits<double>::max_digits10 - 1);
+		oss << std::scientific << val;
+
+		// d.dddde[+-]xx
+		std::string sci = oss.str();
+		size_t e = sci.find('e');
+		std::string digits = sci.substr(0, 1) + sci.substr(2, e - 2);
+		int exponent = std::stoi(sci.substr(e + 1));
+
+		size_t last = digits.find_last_not_of('0');
+		digits.erase(last == std::string::npos ? 1 : last + 1);
+
+		// the number of digits before the decimal point
+		long point = exponent + 1;
+
+		if(point <= 0) return "0." + std::string(-point, '0') + digits;
+
+		if((size_t)point >= digits.size()) {
+			return digits + std::string(point - digits.size(), '0');
+		}
+
+		return digits.substr(0, point) + "." + digits.substr(point);
+
+	}
+
+};
+
+template<std::size_t Slot>
+struct Variable: ExprBase<Variable<Slot>> {
+
+	static constexpr std::size_t numSlots = Slot + 1;
+
+	std::string name;
+
+	explicit Variable(const std::string& varName) : name(varName) {}
+
+	template<typename Real>
+	inline Real eval(const Real* vars) const {
+		return vars[Slot];
+	}
+
+	std::string str() const {
+		return "$" + name + "$";
+	}
+
+};
+
+template<char Op, Expression L, Expression R>
+struct Operator: ExprBase<Operator<Op, L, R>> {
+
+	static constexpr std::size_t numSlots = 
+		L::numSlots > R::numSlots ? L::numSlots : R::numSlots;
+
+	L lhs;
+	R rhs;
+
+	Operator(const L& l, const R& r) : lhs(l), rhs(r) {}
+
+	template<typename Real>
+	inline Real eval(const Real* vars) const {
+		Real lVal = lhs.template eval<Real>(vars);
+		Real rVal = rhs.template eval<Real>(vars);
+
+		if constexpr(Op == '+') return lVal + rVal;
+		else if constexpr(Op == '-') return lVal - rVal;
+		else if constexpr(Op == '*') return lVal * rVal;
+		else if constexpr(Op == '/') return lVal / rVal;
+		else if constexpr(Op == '%') return std::fmod(lVal, rVal);
+		else return std::pow(lVal, rVal);
+	}
+
+	std::string str() const {
+		return "(" + lhs.str() + Op + rhs.str() + ")";
+	}
+
+};
+
+template<Function Func, Expression A>
+struct Call: ExprBase<Call<Func, A>> {
+
+	static constexpr std::size_t numSlots = A::numSlots;
+
+	A arg;
+
+	explicit Call(const A& a) : arg(a) {}
+
+	template<typename Real>
+	inline Real eval(const Real* vars) const {
+		return static_expr_detail::apply_function<Func>(
+			arg.template eval<Real>(vars));
+	}
+
+	std::string str() const {
+		return std::string(m_name()) + "(" + arg.str() + ")";
+	}
+
+private:
+	static constexpr const char* m_name() {
+		switch(Func) {
+			case Function::LOG: return "log";
+			case Function::LOG10: return "log10";
+			case Function::SIN: return "sin";
+			case Function::COS: return "cos";
+			case Function::TAN: return "tan";
+			case Function::COT: return "cot";
+			case Function::ASIN: return "asin";
+			case Function::ACOS: return "acos";
+			case Function::ATAN: return "atan";
+			case Function::ACOT: return "acot";
+			case Function::DEG: return "deg";
+			case Function::RAD: return "rad";
+			case Function::SQRT: return "sqrt";
+			case Function::EXP: return "exp";
+			default: return "abs";
+		}
+	}
+
+};
+
+template<std::size_t Slot>
+inline Variable<Slot> var(const std::string& name) {
+	return Variable<Slot>(name);
+}
+
+// numbers mixed into expressions become Number nodes
+template<typename T>
+inline auto as_expr(const T& val) {
+	if constexpr(Expression<T>) return val;
+	else return Number((double)val);
+}
+
+template<typename L, typename R>
+concept Operands = (Expression<L> || Expression<R>) && 
+	(Expression<L> || std::is_arithmetic_v<L>) &&
+	(Expression<R> || std::is_arithmetic_v<R>);
+
+#define EXPR_DSL_OPERATOR(op, opChar) \
+	template<typename L, typename R> requires Operands<L, R> \
+	inline auto operator op(const L& l, const R& r) { \
+		using LE = decltype(as_expr(l)); \
+		using RE = decltype(as_expr(r)); \
+		return Operator<opChar, LE, RE>(as_expr(l), as_expr(r)); \
+	}
+
+EXPR_DSL_OPERATOR(+, '+')
+EXPR_DSL_OPERATOR(-, '-')
+EXPR_DSL_OPERATOR(*, '*')
+EXPR_DSL_OPERATOR(/, '/')
+EXPR_DSL_OPERATOR(%, '%')
+EXPR_DSL_OPERATOR(^, '^')
+
+#undef EXPR_DSL_OPERATOR
+
+template<Expression E>
+inline auto operator-(const E& e) {
+	// multiplying by -1 flips the sign exactly
+	return Operator<'*', Number, E>(Number(-1.0), e);
+}
+
+#define EXPR_DSL_FUNCTION(name, func) \
+	template<Expression A> \
+	inline Call<Function::func, A> name(const A& arg) { \
+		return Call<Function::func, A>(arg); \
+	}
+
+EXPR_DSL_FUNCTION(log, LOG)
+EXPR_DSL_FUNCTION(log10, LOG10)
+EXPR_DSL_FUNCTION(sin, SIN)
+EXPR_DSL_FUNCTION(cos, COS)
+EXPR_DSL_FUNCTION(tan, TAN)
+EXPR_DSL_FUNCTION(cot, COT)
+EXPR_DSL_FUNCTION(asin, ASIN)
+EXPR_DSL_FUNCTION(acos, ACOS)
+EXPR_DSL_FUNCTION(atan, ATAN)
+EXPR_DSL_FUNCTION(acot, ACOT)
+EXPR_DSL_FUNCTION(deg, DEG)
+EXPR_DSL_FUNCTION(rad, RAD)
+EXPR_DSL_FUNCTION(sqrt, SQRT)
+EXPR_DSL_FUNCTION(exp, EXP)
+EXPR_DSL_FUNCTION(abs, ABS)
+
+#undef EXPR_DSL_FUNCTION
+
+template<Expression E>
+inline std::string to_string(const E& e) {
+
+/*
+	Returns the expression as a string in the syntax of MathInterpreter. Every
+	operator is put in parentheses, so the precedences do not matter.
+*/
+
+	return e.str();
+
+}
+
+template<Expression E>
+inline MathInterpreter to_interpreter(const E& e) {
+
+/*
+	Throws NON_FINITE_CONSTANT if a constant of the expression is infinite or
+	NaN, since the syntax of MathInterpreter has no way to write them.
+*/
+
+	MathInterpreter inter;
+	inter.init_with_expr(e.str());
+
+	return inter;
+
+}
+
+} // namespace expr_dsl
+
+#endif // !EXPR_DSL_H
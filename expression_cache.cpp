@@ -0,0 +1,254 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "expression_cache.h"
+
+const size_t ExpressionCache::SHARDS;
+
+ExpressionCache::ExpressionCache(size_t l2Capacity, size_t l1Capacity) :
+	m_l2CapacityPerShard((l2Capacity + SHARDS - 1) / SHARDS),
+	m_shards(new Shard[SHARDS]) {
+
+/*
+	l2Capacity: The maximum number of interpreters kept in L2, rounded up to
+	            a multiple of SHARDS.
+	l1Capacity: The number of entries of the L1 table of each thread, 
+	            rounded up to a power of 2.
+*/
+
+	static std::atomic<uint64_t> lastId {0};
+	m_id = ++lastId;
+
+	m_l1Capacity = 1;
+	while(m_l1Capacity < l1Capacity) m_l1Capacity <<= 1;
+
+	if(m_l2CapacityPerShard == 0) m_l2CapacityPerShard = 1;
+
+}
+
+std::shared_ptr<const MathInterpreter> ExpressionCache::get(
+	const std::string& expression) {
+
+/*
+	Returns the interpreter of the expression, initializing it if it is not
+	cached. Throws like init_with_expr() if the expression is not valid.
+*/
+
+	uint64_t hash = m_hash(expression);
+
+	// read before looking up L2, so that an entry found in an L2 that was 
+	// invalidated meanwhile is stored in L1 with an old generation
+	uint64_t generation = m_generation.load(std::memory_order_acquire);
+
+	L1& l1 = m_l1();
+	L1Entry& entry = l1.entries[hash & (m_l1Capacity - 1)];
+
+	if(entry.generation == generation && entry.hash == hash && 
+		entry.expression == expression) {
+		l1.hits.add();
+		return entry.expr;
+	}
+
+	l1.misses.add();
+
+	ExprPtr expr = m_find(hash, expression);
+
+	if(!expr) {
+		auto compiled = std::make_shared<MathInterpreter>();
+		compiled->init_with_expr(expression);
+
+		expr = m_insert(hash, expression, compiled);
+	}
+
+	entry.generation = generation;
+	entry.hash = hash;
+	entry.expression = expression;
+	entry.expr = expr;
+
+	return expr;
+
+}
+
+void ExpressionCache::invalidate(const std::string& expression) {
+
+/*
+	Removes the interpreter of the expression from both levels.
+*/
+
+	Shard& shard = m_shards[m_hash(expression) & (SHARDS - 1)];
+
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto found = shard.entries.find(expression);
+
+		if(found != shard.entries.end()) {
+			shard.lru.erase(found->second.lruPosition);
+			shard.entries.erase(found);
+		}
+	}
+
+	// even when L2 did not have it, since L1 entries outlive L2 evictions
+	m_generation.fetch_add(1, std::memory_order_release);
+	m_invalidations++;
+
+}
+
+void ExpressionCache::clear() {
+
+/*
+	Removes all interpreters from both levels.
+*/
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+
+		m_shards[i].entries.clear();
+		m_shards[i].lru.clear();
+	}
+
+	m_generation.fetch_add(1, std::memory_order_release);
+	m_invalidations++;
+
+}
+
+ExpressionCache::Stats ExpressionCache::stats() const {
+
+	Stats stats {{m_l1Capacity, 0, 0}, {m_l2CapacityPerShard * SHARDS, 0, 0},
+		m_invalidations.load()};
+
+	{
+		std::lock_guard<std::mutex> lock(m_l1Mutex);
+
+		for(const auto& l1: m_l1s) {
+			stats.l1.hits += l1->hits.value.load(std::memory_order_relaxed);
+			stats.l1.misses += l1->misses.value.load(std::memory_order_relaxed);
+		}
+	}
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+
+		stats.l2.hits += m_shards[i].hits;
+		stats.l2.misses += m_shards[i].misses;
+	}
+
+	return stats;
+
+}
+
+ExpressionCache::L1& ExpressionCache::m_l1() {
+
+/*
+	Returns the L1 table of the calling thread, creating it on the first call.
+	The tables are owned by the cache, and found through a thread-local map 
+	keyed by the id of the cache, whose entries of destroyed caches are never
+	looked up again.
+*/
+
+	static thread_local std::unordered_map<uint64_t, L1*> tables;
+	static thread_local uint64_t lastId = 0;
+	static thread_local L1* lastTable = nullptr;
+
+	if(lastId == m_id) return *lastTable;
+
+	L1*& table = tables[m_id];
+
+	if(!table) {
+		std::unique_ptr<L1> l1(new L1());
+		l1->entries.resize(m_l1Capacity, L1Entry {0, 0, std::string(), 
+			ExprPtr()});
+
+		table = l1.get();
+
+		std::lock_guard<std::mutex> lock(m_l1Mutex);
+		m_l1s.push_back(std::move(l1));
+	}
+
+	lastId = m_id;
+	lastTable = table;
+
+	return *table;
+
+}
+
+ExpressionCache::ExprPtr ExpressionCache::m_find(uint64_t hash, 
+	const std::string& expression) {
+
+	Shard& shard = m_shards[hash & (SHARDS - 1)];
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto found = shard.entries.find(expression);
+
+	if(found == shard.entries.end()) {
+		shard.misses++;
+		return ExprPtr();
+	}
+
+	shard.lru.splice(shard.lru.begin(), shard.lru, found->second.lruPosition);
+	shard.hits++;
+
+	return found->second.expr;
+
+}
+
+ExpressionCache::ExprPtr ExpressionCache::m_insert(uint64_t hash, 
+	const std::string& expression, const ExprPtr& expr) {
+
+/*
+	Stores the interpreter in L2, evicting the least recently used one of 
+	the shard if it is full. Returns the interpreter stored by another thread
+	if it was faster, so that all threads share the same one.
+*/
+
+	Shard& shard = m_shards[hash & (SHARDS - 1)];
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto found = shard.entries.find(expression);
+	if(found != shard.entries.end()) return found->second.expr;
+
+	if(shard.entries.size() >= m_l2CapacityPerShard) {
+		shard.entries.erase(shard.lru.back());
+		shard.lru.pop_back();
+	}
+
+	shard.lru.push_front(expression);
+	shard.entries[expression] = L2Entry {expr, shard.lru.begin()};
+
+	return expr;
+
+}
+
+uint64_t ExpressionCache::m_hash(const std::string& str) const noexcept {
+
+/*
+	64-bit FNV-1a, mixed at the end. Without the mixing, the bits used to 
+	index both levels are the same for expressions that only differ in 
+	their last digit.
+*/
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for(const auto& c: str) {
+		hash = (hash ^ (unsigned char)c) * 0x100000001B3ULL;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+
+	return hash;
+
+}
@@ -0,0 +1,160 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "math_interpreter.h"
+
+
+class ExpressionCache {
+
+/*
+	Cache of initialized interpreters, keyed by the text of their expression,
+	for programs that initialize the same expressions over and over from many
+	threads. Safe to use from multiple threads.
+
+	How to use:
+
+		e.g. ExpressionCache cache(4096);
+
+			 // in any thread
+			 MathInterpreter expr = *cache.get("$x$ * 2");
+			 expr.set_value("x", 12.75);
+			 double result = expr.calculate();
+
+	The interpreters are shared by all threads, and must be copied to be 
+	calculated, since calculating changes the state of an interpreter.
+
+	The cache has two levels:
+		- L1: a small direct-mapped table per thread and per cache, used
+		  without any synchronization. A hit reads nothing shared but the 
+		  generation of the cache, which only changes on invalidation, so 
+		  that lookups from many threads do not bounce cache lines between
+		  cores.
+		- L2: shared by all threads, split into SHARDS shards each guarded
+		  by its own mutex, and evicting the least recently used entries of
+		  each shard.
+	A miss in both levels initializes the interpreter, outside of the locks,
+	and stores it in both. Invalid expressions throw like init_with_expr(), 
+	and are not cached.
+
+	invalidate() and clear() remove entries from L2, then advance the 
+	generation, which turns every L1 entry of every thread into a miss. 
+	Hence, once they return, no thread gets a removed entry. Call them when 
+	formulas are swapped, so that the interpreters of the replaced 
+	expressions are dropped rather than aged out.
+
+	stats() returns the hits and misses of each level, summed over all 
+	threads, to tune the capacities. The L1 tables of a thread stay until 
+	the cache is destroyed.
+*/
+
+public:
+	struct Level {
+		size_t capacity; // per thread for L1
+		size_t hits;
+		size_t misses;
+	};
+
+	struct Stats {
+		Level l1;
+		Level l2;
+		size_t invalidations;
+	};
+
+	ExpressionCache(size_t l2Capacity, size_t l1Capacity = 256);
+
+	ExpressionCache(const ExpressionCache&) = delete;
+	ExpressionCache& operator=(const ExpressionCache&) = delete;
+
+	std::shared_ptr<const MathInterpreter> get(const std::string& expression);
+	void invalidate(const std::string& expression);
+	void clear();
+
+	Stats stats() const;
+
+	virtual ~ExpressionCache() = default;
+
+protected:
+	static const size_t SHARDS = 16; // power of 2
+
+	using ExprPtr = std::shared_ptr<const MathInterpreter>;
+
+	// counter written by one thread only, and read by stats()
+	struct Counter {
+		std::atomic<size_t> value {0};
+
+		void add() noexcept {
+			value.store(value.load(std::memory_order_relaxed) + 1,
+				std::memory_order_relaxed);
+		}
+	};
+
+	struct L1Entry {
+		uint64_t generation; // 0 if empty
+		uint64_t hash;
+		std::string expression;
+		ExprPtr expr;
+	};
+
+	struct L1 {
+		std::vector<L1Entry> entries;
+		Counter hits;
+		Counter misses;
+	};
+
+	struct L2Entry {
+		ExprPtr expr;
+		std::list<std::string>::iterator lruPosition;
+	};
+
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<std::string, L2Entry> entries;
+		std::list<std::string> lru; // most recently used first
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	uint64_t m_id; // never reused, unlike the address
+	size_t m_l1Capacity;
+	size_t m_l2CapacityPerShard;
+
+	std::unique_ptr<Shard[]> m_shards;
+
+	std::atomic<uint64_t> m_generation {1};
+	std::atomic<size_t> m_invalidations {0};
+
+	mutable std::mutex m_l1Mutex;
+	std::vector<std::unique_ptr<L1>> m_l1s; // of all threads
+
+	L1& m_l1();
+	ExprPtr m_find(uint64_t hash, const std::string& expression);
+	ExprPtr m_insert(uint64_t hash, const std::string& expression, 
+		const ExprPtr& expr);
+
+	uint64_t m_hash(const std::string& str) const noexcept;
+
+};
+
+#endif // !EXPRESSION_CACHE_H
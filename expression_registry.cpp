@@ -0,0 +1,361 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "expression_registry.h"
+
+#include <algorithm>
+
+ExpressionRegistry::ExpressionRegistry(): m_names(new NameMap {1, {}}) {}
+
+ExpressionRegistry::~ExpressionRegistry() {
+
+	const NameMap* names = m_names.load();
+
+	for(const auto& entry: names->versions) delete entry.second;
+
+	delete names;
+
+}
+
+uint64_t ExpressionRegistry::publish(const std::string& name, 
+	const std::string& expression) {
+
+/*
+	Initializes an interpreter with the expression, and publishes it as the
+	new version of the name. Returns the version number, which starts from 1
+	for every name. Throws like init_with_expr() if the expression is bad, 
+	in which case the current version stays.
+*/
+
+	MathInterpreter expr;
+	expr.init_with_expr(expression);
+
+	return m_swap(Changes {{name, &expr}})[name];
+
+}
+
+uint64_t ExpressionRegistry::publish(const std::string& name, 
+	const MathInterpreter& expr) {
+
+/*
+	Publishes a copy of the initialized interpreter as the new version of the
+	name, e.g. one with a result cache or a specialization. Returns the 
+	version number.
+*/
+
+	return m_swap(Changes {{name, &expr}})[name];
+
+}
+
+std::vector<uint64_t> ExpressionRegistry::publish_all(
+	const std::vector<std::pair<std::string, MathInterpreter>>& exprs,
+	const std::vector<std::string>& removedNames) {
+
+/*
+	exprs:        The initialized interpreters to publish, by name.
+	removedNames: The names to remove.
+
+	Publishes copies of the interpreters and removes the names in one step,
+	so that readers see either all the changes or none of them. Returns the
+	version numbers of the published interpreters, in their order. A name 
+	given twice gets the last interpreter given for it.
+*/
+
+	Changes changes;
+
+	for(const auto& name: removedNames) changes[name] = nullptr;
+	for(const auto& expr: exprs) changes[expr.first] = &expr.second;
+
+	std::map<std::string, uint64_t> numbers = m_swap(changes);
+
+	std::vector<uint64_t> exprNumbers;
+	for(const auto& expr: exprs) exprNumbers.push_back(numbers[expr.first]);
+
+	return exprNumbers;
+
+}
+
+bool ExpressionRegistry::remove(const std::string& name) {
+
+/*
+	Removes the expression, so that get() throws for it. Returns false if 
+	there was no expression with the name.
+*/
+
+	{
+		std::lock_guard<std::mutex> lock(m_writerMutex);
+
+		const NameMap* names = m_names.load(std::memory_order_relaxed);
+
+		if(!names->versions.count(name)) return false;
+	}
+
+	m_swap(Changes {{name, nullptr}});
+
+	return true;
+
+}
+
+std::vector<std::string> ExpressionRegistry::names() const {
+
+/*
+	Returns the names that have an expression.
+*/
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	std::vector<std::string> names;
+
+	const NameMap* current = m_names.load(std::memory_order_relaxed);
+
+	for(const auto& entry: current->versions) names.push_back(entry.first);
+
+	return names;
+
+}
+
+size_t ExpressionRegistry::reclaim() {
+
+/*
+	Frees the retired versions that no reader can be using anymore, and 
+	returns how many are still waiting for readers.
+*/
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	return m_reclaim();
+
+}
+
+size_t ExpressionRegistry::pending() const {
+
+/*
+	Number of retired versions and name maps not freed yet.
+*/
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	return m_retired.size();
+
+}
+
+std::map<std::string, uint64_t> ExpressionRegistry::m_swap(
+	const Changes& changes) {
+
+/*
+	Publishes copies of the interpreters as the new versions of their names,
+	and removes the names given with nullptr, by publishing a copy of the 
+	name map with the changes. Retires the previous map and the versions it
+	replaced. Returns the numbers of the new versions, by name.
+*/
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	const NameMap* names = m_names.load(std::memory_order_relaxed);
+
+	std::unique_ptr<NameMap> newNames(new NameMap(*names));
+	newNames->generation++;
+
+	// owned here until the new map is published
+	std::vector<std::unique_ptr<const Version>> created;
+	std::map<std::string, uint64_t> numbers;
+
+	for(const auto& change: changes) {
+		if(!change.second) {
+			newNames->versions.erase(change.first);
+			continue;
+		}
+
+		uint64_t number = m_lastNumbers[change.first] + 1;
+
+		created.emplace_back(new Version {number, *change.second});
+		newNames->versions[change.first] = created.back().get();
+		numbers[change.first] = number;
+	}
+
+	std::vector<const Version*> replaced;
+
+	for(const auto& change: changes) {
+		auto found = names->versions.find(change.first);
+		if(found != names->versions.end()) replaced.push_back(found->second);
+	}
+
+	m_names.store(newNames.release());
+
+	for(auto& version: created) version.release();
+
+	for(const auto& number: numbers) {
+		m_lastNumbers[number.first] = number.second;
+	}
+
+	m_retire(std::shared_ptr<const NameMap>(names));
+
+	for(const auto& version: replaced) {
+		m_retire(std::shared_ptr<const Version>(version));
+	}
+
+	m_reclaim();
+
+	return numbers;
+
+}
+
+void ExpressionRegistry::m_retire(std::shared_ptr<const void> object) {
+
+/*
+	Keeps the unpublished object until the readers that may have loaded it
+	leave get(). Readers announcing the current epoch or an earlier one may 
+	have loaded it, the ones announcing a later epoch cannot: the epoch is 
+	advanced after the pointer was swapped.
+*/
+
+	uint64_t epoch = m_epoch.fetch_add(1);
+
+	m_retired.push_back(Retired {epoch, std::move(object)});
+
+}
+
+size_t ExpressionRegistry::m_reclaim() {
+
+	uint64_t minEpoch = UINT64_MAX;
+
+	for(const auto& record: m_readers) {
+		uint64_t epoch = record->epoch.load();
+		if(epoch != 0) minEpoch = std::min(minEpoch, epoch);
+	}
+
+	m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(),
+		[minEpoch](const Retired& retired) {
+			return retired.epoch < minEpoch;
+		}), m_retired.end());
+
+	return m_retired.size();
+
+}
+
+ExpressionRegistry::ReaderRecord* ExpressionRegistry::m_add_reader() {
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	m_readers.emplace_back(new ReaderRecord());
+
+	return m_readers.back().get();
+
+}
+
+void ExpressionRegistry::m_remove_reader(ReaderRecord* record) {
+
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	m_readers.erase(std::remove_if(m_readers.begin(), m_readers.end(),
+		[record](const std::unique_ptr<ReaderRecord>& reader) {
+			return reader.get() == record;
+		}), m_readers.end());
+
+	m_reclaim();
+
+}
+
+ExpressionRegistry::Reader::Reader(ExpressionRegistry& registry): 
+	m_registry(registry), m_record(registry.m_add_reader()) {}
+
+ExpressionRegistry::Reader::~Reader() {
+
+	m_registry.m_remove_reader(m_record);
+
+}
+
+MathInterpreter& ExpressionRegistry::Reader::get(const std::string& name) {
+
+/*
+	Returns this reader's copy of the current version of the expression. 
+	Throws UNKNOWN_EXPRESSION_NAME if there is none.
+*/
+
+	return m_refresh(name).expr;
+
+}
+
+uint64_t ExpressionRegistry::Reader::version(const std::string& name) {
+
+/*
+	Returns the number of the current version of the expression, as get() 
+	would. Throws UNKNOWN_EXPRESSION_NAME if there is none.
+*/
+
+	return m_refresh(name).number;
+
+}
+
+ExpressionRegistry::Reader::Cached& ExpressionRegistry::Reader::m_refresh(
+	const std::string& name) {
+
+/*
+	Loads the current version of the name, and copies it if it is not the 
+	one in the cache. The loads and the copy happen in the announced epoch,
+	so that the version is not freed meanwhile.
+*/
+
+	auto cached = m_cache.find(name);
+
+	// the announcement must be visible to the writers before the pointers
+	// are loaded, hence the sequentially consistent store
+	m_record->epoch.store(m_registry.m_epoch.load());
+
+	const NameMap* names = m_registry.m_names.load();
+
+	// nothing changed since the name was last looked up
+	if(cached != m_cache.end() && 
+		cached->second.generation == names->generation) {
+		m_record->epoch.store(0, std::memory_order_release);
+		return cached->second;
+	}
+
+	auto found = names->versions.find(name);
+
+	if(found == names->versions.end()) {
+		m_record->epoch.store(0, std::memory_order_release);
+
+		if(cached != m_cache.end()) m_cache.erase(cached);
+		throw UNKNOWN_EXPRESSION_NAME(name);
+	}
+
+	const Version* version = found->second;
+
+	// the epoch must not stay announced if the copy throws, e.g. bad_alloc,
+	// or no retired version could be freed anymore
+	try {
+		if(cached == m_cache.end()) {
+			cached = m_cache.emplace(name, Cached {names->generation, 
+				version->number, version->expr}).first;
+		}
+		else {
+			// the numbers last, so that a failed copy is made again
+			if(cached->second.number != version->number) {
+				cached->second.expr = version->expr;
+				cached->second.number = version->number;
+			}
+
+			cached->second.generation = names->generation;
+		}
+	}
+	catch(...) {
+		m_record->epoch.store(0, std::memory_order_release);
+		throw;
+	}
+
+	m_record->epoch.store(0, std::memory_order_release);
+
+	return cached->second;
+
+}
@@ -0,0 +1,204 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef EXPRESSION_REGISTRY_H
+#define EXPRESSION_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+#include "math_interpreter.h"
+
+
+class UNKNOWN_EXPRESSION_NAME: public std::exception {
+
+public:
+	UNKNOWN_EXPRESSION_NAME(const std::string& name) {
+		m_returnMessage = "No expression is registered with the name: " + name;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class ExpressionRegistry {
+
+/*
+	Named expressions that can be replaced at runtime while other threads
+	calculate them, RCU-style: writers publish a new map of the versions of
+	all names with an atomic pointer swap, readers load the current version 
+	without locking, and the old versions are freed once no reader can be 
+	using them.
+
+	How to use:
+		1. Publish the expressions, from any thread, at any time. This 
+		   initializes a new interpreter, and throws like init_with_expr()
+		   for bad expressions, leaving the current version in place.
+
+			e.g. ExpressionRegistry registry;
+				 registry.publish("price", "$base$ * (1 + $tax$)");
+
+		2. Create a Reader in every thread that calculates the expressions,
+		   and get the expressions from it by name.
+
+			e.g. ExpressionRegistry::Reader reader(registry);
+
+				 MathInterpreter& price = reader.get("price");
+				 price.set_value("base", 100);
+				 price.set_value("tax", 0.18);
+				 double result = price.calculate();
+
+		3. To change several expressions together, e.g. the ones of a file, 
+		   publish them with publish_all(). The new versions replace the old
+		   ones in one step: once a reader has got the new version of one of 
+		   them, it gets the new versions of the others too.
+
+			e.g. registry.publish_all({{"price", price}, {"cost", cost}},
+				 {"discount"});
+
+	Since calculating changes the state of an interpreter (the variable 
+	values, the memoization caches etc.), every Reader keeps its own copy of 
+	each expression, and copies the new version when get() finds one. The 
+	reference returned by get() stays valid until the next get() of the same 
+	name. Calling get() before every calculation, or every batch of them, 
+	picks up new versions; a reader that keeps using a reference keeps 
+	calculating the version it got.
+
+	Readers never block: get() is an atomic load of the current name map, 
+	plus a lookup and a copy of the interpreter when the map changed. 
+	Writers are serialized with a mutex, which readers never take, and copy
+	the name map (the pointers to the versions, not the interpreters) on 
+	every change.
+
+	Old versions are reclaimed with epochs. A reader announces the global 
+	epoch while it loads and copies a version, and zero otherwise. A writer 
+	swaps the name map pointer, then advances the global epoch, and keeps 
+	the old map and the versions it replaced with the epoch they were 
+	retired in. They are freed once every reader is either outside get() or
+	has announced a later epoch, since those readers can only have loaded 
+	the new pointer. Retired versions are reclaimed by later publish(), 
+	publish_all() and remove() calls, or by reclaim().
+
+	All Readers must be destroyed before the registry.
+*/
+
+protected:
+	struct Version {
+		uint64_t number;
+		MathInterpreter expr;
+	};
+
+	// the current versions, by name. The generation tells the readers 
+	// whether the map changed since they last looked up a name
+	struct NameMap {
+		uint64_t generation;
+		std::map<std::string, const Version*> versions;
+	};
+
+	// expressions to publish by name, nullptr for the ones to remove
+	using Changes = std::map<std::string, const MathInterpreter*>;
+
+	// the epoch announced by a reader, 0 if it is not in get()
+	struct ReaderRecord {
+		std::atomic<uint64_t> epoch {0};
+	};
+
+	struct Retired {
+		uint64_t epoch;
+		std::shared_ptr<const void> object;
+	};
+
+public:
+	class Reader {
+
+	public:
+		Reader(ExpressionRegistry& registry);
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		MathInterpreter& get(const std::string& name);
+		uint64_t version(const std::string& name);
+
+		virtual ~Reader();
+
+	protected:
+		struct Cached {
+			uint64_t generation; // of the name map the version was found in
+			uint64_t number;
+			MathInterpreter expr;
+		};
+
+		ExpressionRegistry& m_registry;
+		ReaderRecord* m_record;
+
+		std::unordered_map<std::string, Cached> m_cache;
+
+		Cached& m_refresh(const std::string& name);
+
+	};
+
+	ExpressionRegistry();
+
+	ExpressionRegistry(const ExpressionRegistry&) = delete;
+	ExpressionRegistry& operator=(const ExpressionRegistry&) = delete;
+
+	uint64_t publish(const std::string& name, const std::string& expression);
+	uint64_t publish(const std::string& name, const MathInterpreter& expr);
+	std::vector<uint64_t> publish_all(
+		const std::vector<std::pair<std::string, MathInterpreter>>& exprs,
+		const std::vector<std::string>& removedNames = 
+			std::vector<std::string>());
+	bool remove(const std::string& name);
+
+	std::vector<std::string> names() const;
+
+	size_t reclaim();
+	size_t pending() const;
+
+	virtual ~ExpressionRegistry();
+
+protected:
+	std::atomic<const NameMap*> m_names;
+	std::atomic<uint64_t> m_epoch {1};
+
+	// guards everything below, and serializes the writers
+	mutable std::mutex m_writerMutex;
+
+	std::map<std::string, uint64_t> m_lastNumbers; // kept after remove()
+	std::vector<std::unique_ptr<ReaderRecord>> m_readers;
+	std::vector<Retired> m_retired;
+
+	std::map<std::string, uint64_t> m_swap(const Changes& changes);
+	void m_retire(std::shared_ptr<const void> object);
+	size_t m_reclaim();
+
+	ReaderRecord* m_add_reader();
+	void m_remove_reader(ReaderRecord* record);
+
+};
+
+#endif // !EXPRESSION_REGISTRY_H
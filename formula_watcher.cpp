@@ -0,0 +1,468 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "formula_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FormulaWatcher::FormulaWatcher(ExpressionRegistry& registry, 
+	const Config& config): m_registry(registry), m_config(config) {
+
+/*
+	registry: The registry to publish the expressions to. Must outlive the 
+	          watcher.
+	config:   The path to watch and the reload settings.
+
+	Loads all formula files, and starts watching them. Throws 
+	FORMULA_WATCH_ERROR if the path (or the directory of the file) is not
+	a directory that can be watched.
+*/
+
+	struct stat pathStat;
+
+	if(stat(m_config.path.c_str(), &pathStat) == 0 && 
+		S_ISDIR(pathStat.st_mode)) {
+		m_dir = m_config.path;
+	}
+	else {
+		size_t slash = m_config.path.rfind('/');
+
+		m_dir = slash == std::string::npos ? "." : 
+			m_config.path.substr(0, std::max<size_t>(slash, 1));
+		m_fileName = m_config.path.substr(
+			slash == std::string::npos ? 0 : slash + 1);
+
+		if(m_fileName.empty()) {
+			throw FORMULA_WATCH_ERROR("No file name in " + m_config.path);
+		}
+	}
+
+	m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if(m_inotifyFd < 0 || pipe2(m_stopPipe, O_CLOEXEC) != 0) {
+		std::string error = std::strerror(errno);
+		m_close();
+		throw FORMULA_WATCH_ERROR(error);
+	}
+
+	if(inotify_add_watch(m_inotifyFd, m_dir.c_str(), IN_CLOSE_WRITE | 
+		IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+		std::string error = m_dir + ": " + std::strerror(errno);
+		m_close();
+		throw FORMULA_WATCH_ERROR(error);
+	}
+
+	// load before watching, so that the expressions are there when the
+	// constructor returns. Changes made meanwhile are seen by the watch, 
+	// since the inotify watch already exists
+	reload();
+
+	m_thread = std::thread(&FormulaWatcher::m_watch, this);
+
+}
+
+FormulaWatcher::~FormulaWatcher() {
+
+	if(m_thread.joinable()) {
+		char stop = 1;
+		while(write(m_stopPipe[1], &stop, 1) < 0 && errno == EINTR) {}
+
+		m_thread.join();
+	}
+
+	m_close();
+
+}
+
+void FormulaWatcher::reload() {
+
+/*
+	Reloads all formula files now, including the ones that were deleted. 
+	The background thread does this on its own after changes.
+*/
+
+	std::set<std::string> paths;
+
+	for(const auto& path: m_formula_files()) paths.insert(path);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(const auto& published: m_published) paths.insert(published.first);
+	}
+
+	m_reload_files(paths);
+
+}
+
+FormulaWatcher::Stats FormulaWatcher::stats() const {
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_stats;
+
+}
+
+void FormulaWatcher::m_watch() {
+
+/*
+	The background thread. Collects the formula files named in the inotify
+	events until none come for the debounce time, then reloads them.
+*/
+
+	pollfd fds[2] = {{m_inotifyFd, POLLIN, 0}, {m_stopPipe[0], POLLIN, 0}};
+	std::set<std::string> changedFiles;
+	bool isOverflown = false;
+
+	alignas(inotify_event) char buffer[4096];
+
+	while(true) {
+		int timeout = changedFiles.empty() && !isOverflown ? -1 : 
+			(int)m_config.debounce.count();
+
+		int numReady = poll(fds, 2, timeout);
+
+		if(numReady < 0) {
+			if(errno == EINTR) continue;
+
+			m_report(Failure {m_dir, 0, std::string(), 
+				std::string("poll() failed: ") + std::strerror(errno)});
+			return;
+		}
+
+		if(fds[1].revents) return;
+
+		if(numReady == 0) {
+			if(isOverflown) {
+				reload();
+			}
+			else {
+				std::set<std::string> paths;
+
+				for(const auto& fileName: changedFiles) {
+					paths.insert(m_dir + "/" + fileName);
+				}
+
+				m_reload_files(paths);
+			}
+
+			changedFiles.clear();
+			isOverflown = false;
+			continue;
+		}
+
+		ssize_t length;
+
+		while((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for(char* ptr = buffer; ptr < buffer + length; ) {
+				const inotify_event* event = (const inotify_event*)ptr;
+				ptr += sizeof(inotify_event) + event->len;
+
+				if(event->mask & IN_Q_OVERFLOW) isOverflown = true;
+
+				if(event->len && m_is_formula_file(event->name)) {
+					changedFiles.insert(event->name);
+				}
+			}
+		}
+	}
+
+}
+
+bool FormulaWatcher::m_is_formula_file(const std::string& fileName) const {
+
+	if(!m_fileName.empty()) return fileName == m_fileName;
+
+	const std::string& extension = m_config.extension;
+
+	return fileName.size() > extension.size() && fileName[0] != '.' &&
+		fileName.compare(fileName.size() - extension.size(), extension.size(),
+			extension) == 0;
+
+}
+
+std::vector<std::string> FormulaWatcher::m_formula_files() const {
+
+/*
+	Returns the paths of the formula files that exist now.
+*/
+
+	std::vector<std::string> paths;
+
+	if(!m_fileName.empty()) {
+		paths.push_back(m_dir + "/" + m_fileName);
+		return paths;
+	}
+
+	DIR* dir = opendir(m_dir.c_str());
+	if(!dir) return paths;
+
+	while(const dirent* entry = readdir(dir)) {
+		if(!m_is_formula_file(entry->d_name)) continue;
+
+		std::string path = m_dir + "/" + entry->d_name;
+		struct stat pathStat;
+
+		if(stat(path.c_str(), &pathStat) == 0 && S_ISREG(pathStat.st_mode)) {
+			paths.push_back(path);
+		}
+	}
+
+	closedir(dir);
+
+	std::sort(paths.begin(), paths.end());
+
+	return paths;
+
+}
+
+void FormulaWatcher::m_reload_files(const std::set<std::string>& paths) {
+
+/*
+	Reloads the files, in turns: the files that fail because a name is 
+	still defined in another file are tried again after the others, since
+	reloading the others may have removed the name, e.g. when an expression
+	moved from one file to another. The failures are reported once no turn
+	makes progress.
+*/
+
+	std::vector<std::string> pending(paths.begin(), paths.end());
+
+	while(!pending.empty()) {
+		std::vector<std::string> deferred;
+
+		for(const auto& path: pending) {
+			if(!m_reload_file(path, false)) deferred.push_back(path);
+		}
+
+		if(deferred.size() == pending.size()) {
+			for(const auto& path: deferred) m_reload_file(path, true);
+			break;
+		}
+
+		pending.swap(deferred);
+	}
+
+}
+
+bool FormulaWatcher::m_reload_file(const std::string& path, 
+	bool isLastTry) {
+
+/*
+	Initializes the changed expressions of the file, and publishes them, or
+	reports the failures and keeps the published ones. Returns false, 
+	without reporting anything, if a name of the file is defined in another 
+	file and this is not the last try.
+*/
+
+	std::vector<Failure> failures;
+	Entries entries = m_parse(path, failures);
+
+	std::vector<std::pair<std::string, MathInterpreter>> exprs;
+	std::vector<std::string> removedNames;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const Entries& published = m_published[path];
+		Entries changed;
+		bool isDefinedElsewhere = false;
+
+		for(const auto& entry: entries) {
+			for(const auto& file: m_published) {
+				if(file.first == path || !file.second.count(entry.first)) {
+					continue;
+				}
+
+				failures.push_back(Failure {path, entry.second.second, 
+					entry.first, "Already defined in " + file.first});
+				isDefinedElsewhere = true;
+			}
+
+			auto found = published.find(entry.first);
+
+			if(found == published.end() || 
+				found->second.first != entry.second.first) {
+				changed.insert(entry);
+			}
+		}
+
+		if(isDefinedElsewhere && !isLastTry) {
+			if(published.empty()) m_published.erase(path);
+			return false;
+		}
+
+		if(failures.empty()) m_compile(changed, exprs, path, failures);
+
+		if(!failures.empty()) {
+			m_stats.failures += failures.size();
+			if(published.empty()) m_published.erase(path);
+		}
+		else {
+			for(const auto& entry: published) {
+				if(!entries.count(entry.first)) {
+					removedNames.push_back(entry.first);
+				}
+			}
+
+			// all changes of the file at once
+			if(!exprs.empty() || !removedNames.empty()) {
+				m_registry.publish_all(exprs, removedNames);
+			}
+
+			if(entries.empty()) m_published.erase(path);
+			else m_published[path] = entries;
+
+			if(!exprs.empty() || !removedNames.empty()) m_stats.reloads++;
+			m_stats.published += exprs.size();
+			m_stats.removed += removedNames.size();
+		}
+	}
+
+	for(const auto& failure: failures) m_report(failure);
+
+	if(failures.empty() && (!exprs.empty() || !removedNames.empty()) && 
+		m_config.onReload) {
+		m_config.onReload(path, exprs.size(), removedNames.size());
+	}
+
+	return true;
+
+}
+
+FormulaWatcher::Entries FormulaWatcher::m_parse(const std::string& path,
+	std::vector<Failure>& failures) const {
+
+/*
+	Reads the named expressions of the file. A missing file has none.
+*/
+
+	Entries entries;
+	struct stat pathStat;
+
+	if(stat(path.c_str(), &pathStat) != 0 && errno == ENOENT) return entries;
+
+	std::ifstream file(path);
+
+	if(!file) {
+		failures.push_back(Failure {path, 0, std::string(), 
+			"Cannot read the file"});
+		return entries;
+	}
+
+	auto trim = [](const std::string& str) {
+		size_t begin = str.find_first_not_of(" \t\r");
+		if(begin == std::string::npos) return std::string();
+
+		size_t end = str.find_last_not_of(" \t\r");
+
+		return str.substr(begin, end - begin + 1);
+	};
+
+	std::string line;
+
+	for(size_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+		line = trim(line);
+
+		if(line.empty() || line[0] == '#') continue;
+
+		size_t equals = line.find('=');
+		std::string name = trim(line.substr(0, equals));
+
+		if(equals == std::string::npos || name.empty()) {
+			failures.push_back(Failure {path, lineNumber, std::string(), 
+				"Expected name = expression"});
+			continue;
+		}
+
+		if(entries.count(name)) {
+			failures.push_back(Failure {path, lineNumber, name, 
+				"Defined twice in the file"});
+			continue;
+		}
+
+		entries[name] = std::make_pair(trim(line.substr(equals + 1)), 
+			lineNumber);
+	}
+
+	return entries;
+
+}
+
+void FormulaWatcher::m_compile(const Entries& entries, 
+	std::vector<std::pair<std::string, MathInterpreter>>& exprs,
+	const std::string& path, std::vector<Failure>& failures) const {
+
+/*
+	Initializes an interpreter per entry, on all cores if there are at least
+	parallelThreshold entries.
+*/
+
+	std::vector<std::string> inputs;
+	for(const auto& entry: entries) inputs.push_back(entry.second.first);
+
+	MathInterpreter::CompileResults results = MathInterpreter::compile_all(
+		inputs, inputs.size() >= m_config.parallelThreshold ? 0 : 1);
+
+	std::vector<Entries::const_iterator> indexed;
+	for(auto it = entries.cbegin(); it != entries.cend(); it++) {
+		indexed.push_back(it);
+	}
+
+	for(const auto& diagnostic: results.diagnostics) {
+		const auto& entry = *indexed[diagnostic.index];
+
+		failures.push_back(Failure {path, entry.second.second, entry.first, 
+			diagnostic.message});
+	}
+
+	for(size_t i = 0; i < indexed.size(); i++) {
+		exprs.emplace_back(indexed[i]->first, results.exprs[i]);
+	}
+
+}
+
+void FormulaWatcher::m_report(const Failure& failure) {
+
+	if(m_config.onFailure) {
+		m_config.onFailure(failure);
+		return;
+	}
+
+	std::cerr << "formula " << failure.path;
+	if(failure.line) std::cerr << ":" << failure.line;
+	if(!failure.name.empty()) std::cerr << " (" << failure.name << ")";
+	std::cerr << ": " << failure.message << std::endl;
+
+}
+
+void FormulaWatcher::m_close() {
+
+	if(m_inotifyFd >= 0) close(m_inotifyFd);
+	if(m_stopPipe[0] >= 0) close(m_stopPipe[0]);
+	if(m_stopPipe[1] >= 0) close(m_stopPipe[1]);
+
+	m_inotifyFd = m_stopPipe[0] = m_stopPipe[1] = -1;
+
+}
@@ -0,0 +1,167 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef FORMULA_WATCHER_H
+#define FORMULA_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <exception>
+
+#include "expression_registry.h"
+
+
+class FORMULA_WATCH_ERROR: public std::exception {
+
+public:
+	FORMULA_WATCH_ERROR(const std::string& details) {
+		m_returnMessage = "Cannot watch the formula files: " + details;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class FormulaWatcher {
+
+/*
+	Loads named expressions from formula files into an ExpressionRegistry, 
+	and reloads them when the files change, on a background thread. Linux 
+	only (inotify).
+
+	A formula file has an expression per line, named:
+
+		# comments and empty lines are skipped
+		price = $base$ * (1 + $tax$)
+		discounted = $base$ * (1 - $rate$)
+
+	The watched path is a formula file, or a directory, in which case every
+	file in it with the configured extension is a formula file. The 
+	directory is watched rather than the files, so that files replaced by 
+	editors (written under another name, and renamed) are seen.
+
+	How to use:
+
+		e.g. ExpressionRegistry registry;
+
+			 FormulaWatcher::Config config;
+			 config.path = "/etc/pricing/formulas";
+			 FormulaWatcher watcher(registry, config);
+
+			 // calculate through ExpressionRegistry::Reader as usual
+
+	The constructor loads all files before returning. Later, when a file 
+	changes, and no further change is seen for the debounce time, the 
+	expressions of the file that changed are initialized again (on several
+	threads when there are many), and published if all of them are valid. 
+	Otherwise the failures are reported through the callback, and the 
+	currently published versions of all expressions of the file stay, so
+	that a file is either served as a whole or not at all. Expressions 
+	taken out of a file, or of a deleted file, are removed from the 
+	registry. An expression defined in two files is a failure of the second,
+	unless the other file changed at the same time and no longer defines it
+	(an expression moved from a file to another): the files that changed 
+	together are tried again until no more of them can be published.
+
+	The changes of a file are published in one step, with 
+	ExpressionRegistry::publish_all(): once a reader has got the new 
+	version of an expression of the file, it gets the new versions of the 
+	others too, and not the removed ones.
+*/
+
+public:
+	struct Failure {
+		std::string path;
+		size_t line;      // 0 if the failure is not about a line
+		std::string name; // empty if the failure is not about an expression
+		std::string message;
+	};
+
+	struct Config {
+		std::string path;
+		std::string extension = ".formulas";
+		std::chrono::milliseconds debounce {100};
+		size_t parallelThreshold = 64; // expressions
+		std::function<void(const Failure&)> onFailure; // default: stderr
+		// called after a file is published, with the numbers of published 
+		// and removed expressions
+		std::function<void(const std::string& path, size_t numPublished, 
+			size_t numRemoved)> onReload;
+	};
+
+	struct Stats {
+		size_t reloads;   // files published
+		size_t published; // expressions published
+		size_t removed;   // expressions removed
+		size_t failures;
+	};
+
+	FormulaWatcher(ExpressionRegistry& registry, const Config& config);
+
+	FormulaWatcher(const FormulaWatcher&) = delete;
+	FormulaWatcher& operator=(const FormulaWatcher&) = delete;
+
+	void reload();
+	Stats stats() const;
+
+	virtual ~FormulaWatcher();
+
+protected:
+	// name, and expression with its line number
+	using Entries = std::map<std::string, std::pair<std::string, size_t>>;
+
+	ExpressionRegistry& m_registry;
+	Config m_config;
+
+	std::string m_dir;
+	std::string m_fileName; // empty if a directory is watched
+
+	int m_inotifyFd = -1;
+	int m_stopPipe[2] = {-1, -1};
+	std::thread m_thread;
+
+	// guards everything below
+	mutable std::mutex m_mutex;
+
+	// the published expressions of each file
+	std::map<std::string, Entries> m_published;
+	Stats m_stats {0, 0, 0, 0};
+
+	void m_watch();
+	bool m_is_formula_file(const std::string& fileName) const;
+	std::vector<std::string> m_formula_files() const;
+
+	void m_reload_files(const std::set<std::string>& paths);
+	bool m_reload_file(const std::string& path, bool isLastTry);
+	Entries m_parse(const std::string& path, std::vector<Failure>& failures) const;
+	void m_compile(const Entries& entries, 
+		std::vector<std::pair<std::string, MathInterpreter>>& exprs,
+		const std::string& path, std::vector<Failure>& failures) const;
+	void m_report(const Failure& failure);
+
+	void m_close();
+
+};
+
+#endif // !FORMULA_WATCHER_H
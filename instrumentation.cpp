@@ -0,0 +1,135 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "instrumentation.h"
+
+const size_t Instrumentation::NUM_OPCODES;
+const size_t Instrumentation::NUM_FUNCTIONS;
+const size_t Instrumentation::LATENCY_BUCKETS;
+const uint64_t Instrumentation::LATENCY_PERIOD;
+const uint64_t Instrumentation::OPCODE_PERIOD;
+
+const char* const Instrumentation::OPCODE_NAMES[NUM_OPCODES] = {
+	"number", "variable", "+", "-", "*", "/", "%", "^"};
+
+bool Instrumentation::is_enabled() noexcept {
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	return true;
+#else
+	return false;
+#endif
+
+}
+
+void Instrumentation::count_batch(uint64_t numRows, 
+	uint64_t numCycles) noexcept {
+
+	m_batchCalls++;
+	m_batchRows += numRows;
+	m_batchCycles += numCycles;
+
+}
+
+void Instrumentation::add_latency(uint64_t numCycles) noexcept {
+
+	size_t bucket = 0;
+	while(bucket < LATENCY_BUCKETS - 1 && (numCycles >> (bucket + 1))) bucket++;
+
+	m_latencyHistogram[bucket]++;
+	m_timedCalls++;
+	m_timedCycles += numCycles;
+
+}
+
+void Instrumentation::add_opcode_timing(size_t opcode, 
+	uint64_t numCycles) noexcept {
+
+	m_timedOpcodes[opcode]++;
+	m_opcodeCycles[opcode] += numCycles;
+
+}
+
+void Instrumentation::add_function_timing(size_t func, 
+	uint64_t numCycles) noexcept {
+
+	m_timedFunctions[func]++;
+	m_functionCycles[func] += numCycles;
+
+}
+
+void Instrumentation::set_program(const OpcodeCounts& opcodeCounts, 
+	const FunctionCounts& functionCounts) noexcept {
+
+/*
+	Sets the instruction counts of a new program. The executions of the 
+	previous program are kept.
+*/
+
+	for(size_t i = 0; i < NUM_OPCODES; i++) {
+		m_pastOpcodes[i] += m_programOpcodes[i] * m_programEvaluations;
+	}
+
+	for(size_t i = 0; i < NUM_FUNCTIONS; i++) {
+		m_pastFunctions[i] += m_programFunctions[i] * m_programEvaluations;
+	}
+
+	m_programOpcodes = opcodeCounts;
+	m_programFunctions = functionCounts;
+	m_programEvaluations = 0;
+
+}
+
+void Instrumentation::reset() noexcept {
+
+/*
+	Zeroes the counters, keeping the instruction counts of the program.
+*/
+
+	OpcodeCounts programOpcodes = m_programOpcodes;
+	FunctionCounts programFunctions = m_programFunctions;
+
+	*this = Instrumentation();
+
+	m_programOpcodes = programOpcodes;
+	m_programFunctions = programFunctions;
+
+}
+
+Instrumentation::Snapshot Instrumentation::snapshot(
+	const std::string& expression, 
+	const std::array<std::string, NUM_FUNCTIONS>& functionNames) const {
+
+	Snapshot snapshot {is_enabled(), expression, m_calls, m_evaluations, 
+		m_batchCalls, m_batchRows, m_batchCycles, {}, {}, m_timedCalls, 
+		m_timedCycles, m_latencyHistogram};
+
+	for(size_t i = 0; i < NUM_OPCODES; i++) {
+		snapshot.opcodes.push_back(Counter {OPCODE_NAMES[i], 
+			m_pastOpcodes[i] + m_programOpcodes[i] * m_programEvaluations,
+			m_timedOpcodes[i], m_opcodeCycles[i]});
+	}
+
+	for(size_t i = 0; i < NUM_FUNCTIONS; i++) {
+		uint64_t executions = m_pastFunctions[i] + 
+			m_programFunctions[i] * m_programEvaluations;
+
+		if(executions == 0 && m_programFunctions[i] == 0) continue;
+
+		snapshot.functions.push_back(Counter {functionNames[i], executions,
+			m_timedFunctions[i], m_functionCycles[i]});
+	}
+
+	return snapshot;
+
+}
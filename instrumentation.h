@@ -0,0 +1,172 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+class Instrumentation {
+
+/*
+	Runtime counters and timings of the calculations of one expression, kept
+	by MathInterpreter when built with MATH_INTERPRETER_INSTRUMENT defined. 
+	The macro must be the same in every translation unit, e.g. given with 
+	-DMATH_INTERPRETER_INSTRUMENT. Without it, calculations never touch the 
+	counters, and snapshot() returns zeros with enabled set to false.
+
+	Calls, calculations and batch rows are counted exactly. Since every 
+	calculation runs each instruction of the program once, the executions per
+	opcode and per function are derived from the instruction counts of the 
+	program instead of being counted one by one. Timings are sampled with the
+	time stamp counter (rdtsc on x86, steady_clock nanoseconds elsewhere):
+		- every LATENCY_PERIOD-th call to calculate() is timed as a whole, 
+		  into a histogram with power-of-2 buckets of cycles.
+		- every OPCODE_PERIOD-th call to calculate() times each instruction 
+		  on its own, for the cycles per opcode and per function. These 
+		  include the cost of reading the counter itself, tens of cycles, 
+		  which is about what the number opcode shows.
+*/
+
+public:
+	static const size_t NUM_OPCODES = 8;    // number, variable, + - * / % ^
+	static const size_t NUM_FUNCTIONS = 17; // see MathInterpreter::FUNCTION
+	static const size_t LATENCY_BUCKETS = 48;
+	static const uint64_t LATENCY_PERIOD = 16;  // power of 2
+	static const uint64_t OPCODE_PERIOD = 1024; // power of 2
+
+	enum class Timing {
+		NONE,
+		LATENCY,
+		OPCODES
+	};
+
+	struct Counter {
+		std::string name;
+		uint64_t executions;
+		uint64_t timedExecutions;
+		uint64_t timedCycles;
+	};
+
+	struct Snapshot {
+		bool enabled;
+		std::string expression;
+		uint64_t calls;        // calls to calculate()
+		uint64_t evaluations;  // calculations, without result cache hits
+		uint64_t batchCalls;
+		uint64_t batchRows;
+		uint64_t batchCycles;
+		std::vector<Counter> opcodes;
+		std::vector<Counter> functions; // the ones used by the expression
+		uint64_t timedCalls;
+		uint64_t timedCycles;
+		// bucket i counts the timed calls of 2^i to 2^(i+1) - 1 cycles
+		std::array<uint64_t, LATENCY_BUCKETS> latencyHistogram;
+	};
+
+	using OpcodeCounts = std::array<uint64_t, NUM_OPCODES>;
+	using FunctionCounts = std::array<uint64_t, NUM_FUNCTIONS>;
+
+	static const char* const OPCODE_NAMES[NUM_OPCODES];
+
+	static bool is_enabled() noexcept;
+	static inline uint64_t cycles() noexcept;
+
+	inline Timing count_call() noexcept;
+	inline void count_evaluations(uint64_t numEvaluations) noexcept;
+	void count_batch(uint64_t numRows, uint64_t numCycles) noexcept;
+
+	void add_latency(uint64_t numCycles) noexcept;
+	void add_opcode_timing(size_t opcode, uint64_t numCycles) noexcept;
+	void add_function_timing(size_t func, uint64_t numCycles) noexcept;
+
+	void set_program(const OpcodeCounts& opcodeCounts, 
+		const FunctionCounts& functionCounts) noexcept;
+	void reset() noexcept;
+
+	Snapshot snapshot(const std::string& expression, 
+		const std::array<std::string, NUM_FUNCTIONS>& functionNames) const;
+
+protected:
+	uint64_t m_calls = 0;
+	uint64_t m_evaluations = 0;
+	uint64_t m_batchCalls = 0;
+	uint64_t m_batchRows = 0;
+	uint64_t m_batchCycles = 0;
+
+	// instruction counts of the current program, the executions of the 
+	// previous programs, and the evaluations of the current one
+	OpcodeCounts m_programOpcodes {};
+	FunctionCounts m_programFunctions {};
+	OpcodeCounts m_pastOpcodes {};
+	FunctionCounts m_pastFunctions {};
+	uint64_t m_programEvaluations = 0;
+
+	OpcodeCounts m_timedOpcodes {};
+	OpcodeCounts m_opcodeCycles {};
+	FunctionCounts m_timedFunctions {};
+	FunctionCounts m_functionCycles {};
+
+	uint64_t m_timedCalls = 0;
+	uint64_t m_timedCycles = 0;
+	std::array<uint64_t, LATENCY_BUCKETS> m_latencyHistogram {};
+
+};
+
+uint64_t Instrumentation::cycles() noexcept {
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+
+}
+
+Instrumentation::Timing Instrumentation::count_call() noexcept {
+
+/*
+	Counts a call to calculate(), and tells whether to time it.
+*/
+
+	uint64_t call = m_calls++;
+
+	if((call & (LATENCY_PERIOD - 1)) != 0) return Timing::NONE;
+	if((call & (OPCODE_PERIOD - 1)) == 0) return Timing::OPCODES;
+
+	return Timing::LATENCY;
+
+}
+
+void Instrumentation::count_evaluations(uint64_t numEvaluations) noexcept {
+
+	m_evaluations += numEvaluations;
+	m_programEvaluations += numEvaluations;
+
+}
+
+#endif // !INSTRUMENTATION_H
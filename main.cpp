@@ -1,8 +1,15 @@
 #include <iostream>
 #include <exception>
 #include <time.h>
+#include <vector>
+#include <string>
 #include "math_interpreter.h"
 
+#if __cplusplus >= 202002L
+#include "static_expr.h"
+#include "expr_dsl.h"
+#endif
+
 using namespace std;
 
 
@@ -94,7 +101,97 @@ int main() {
 	catch(const std::exception& e) {
 		std::cout << e.what() << std::endl;
 	}
-	
+
+	/*
+	Example 4:  Malformed expressions.
+	Expressions with missing operands or parentheses are rejected when the
+	interpreter is initialized.
+	Result    : Syntax error for each expression
+	*/
+
+	std::vector<std::string> malformedExprs {"1+", "*2", "$x$+", "sin()", 
+		"()", "(1+2", "1+2)"};
+
+	for(const auto& expr4: malformedExprs) {
+		try {
+			MathInterpreter inter;
+			inter.init_with_expr(expr4);
+
+			std::cout << expr4 << " was accepted." << std::endl;
+		}
+		catch(const std::exception& e) {
+			std::cout << expr4 << ": " << e.what() << std::endl;
+		}
+	}
+
+#if __cplusplus >= 202002L
+	/*
+	Example 5:  Expressions built in C++ (C++20).
+	Constants that print with an exponent by default are converted to an 
+	interpreter that gives the same results as the expression itself.
+	Result    : the same value twice for each expression, and an error for
+	            the infinite constant
+	*/
+
+	auto x = expr_dsl::var<0>("x");
+
+	auto small = x * 0.00001;
+	auto large = x + 1e20;
+	auto tiny = x + 4.9406564584124654e-320;
+
+	try {
+		MathInterpreter smallInter = expr_dsl::to_interpreter(small);
+		MathInterpreter largeInter = expr_dsl::to_interpreter(large);
+		MathInterpreter tinyInter = expr_dsl::to_interpreter(tiny);
+
+		smallInter.set_value("x", 3);
+		largeInter.set_value("x", 3);
+		tinyInter.set_value("x", 0);
+
+		std::cout << small(3) << " " << smallInter.calculate() << std::endl;
+		std::cout << large(3) << " " << largeInter.calculate() << std::endl;
+		std::cout << tiny(0) << " " << tinyInter.calculate() << std::endl;
+
+		expr_dsl::to_interpreter(x + 1e308 * 10);
+	}
+	catch(const std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	/*
+	Example 6:  Expressions parsed at compile time (C++20).
+	Expression: sin($pi$) + $x$ and 1.56 + sin(rad($theta$)) * log(sqrt($len$))
+	for x = 0, theta = 37.81 degrees and len = 75
+	Result    : the same results as the interpreter, bit for bit
+	*/
+
+	try {
+		MathInterpreter piInter;
+		piInter.init_with_expr("sin($pi$) + $x$");
+		piInter.set_value("x", 0);
+
+		double piResult = MATH_EXPR("sin($pi$) + $x$")(0.0);
+
+		std::cout << piResult << " " << piInter.calculate() << 
+			(piResult == piInter.calculate() ? " same" : " different") << 
+			std::endl;
+
+		MathInterpreter trigInter;
+		trigInter.init_with_expr("1.56 + sin(rad($theta$)) * log(sqrt($len$))");
+		trigInter.set_value("theta", 37.81);
+		trigInter.set_value("len", 75);
+
+		double trigResult = MATH_EXPR(
+			"1.56 + sin(rad($theta$)) * log(sqrt($len$))")(37.81, 75.0);
+
+		std::cout << trigResult << " " << trigInter.calculate() << 
+			(trigResult == trigInter.calculate() ? " same" : " different") << 
+			std::endl;
+	}
+	catch(const std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+#endif
 
 	getchar();
 	return 0;
@@ -0,0 +1,315 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef MATH_ASYNC_H
+#define MATH_ASYNC_H
+
+#if __cplusplus < 202002L
+#error "math_async.h requires C++20."
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "math_interpreter.h"
+
+
+namespace math_async {
+
+/*
+	Batch calculations as C++20 coroutines, for programs that run on a
+	coroutine executor and must not block its threads with large batches.
+	Requires C++20.
+
+	The batch is calculated in chunks of rows on the executor of the caller,
+	and the coroutine goes back to the end of the queue of the executor
+	after each chunk, so that other work (e.g. small, latency-sensitive
+	requests) runs between the chunks of large batches. By default the
+	chunks are sized to take about Options::timeSlice each.
+
+	The executor can be of any type with a post() member function taking a
+	callable with no arguments, to be called later on one of its threads.
+
+	How to use:
+
+		e.g. math_async::CancellationToken token;
+
+			 math_async::Options options;
+			 options.deadline = std::chrono::steady_clock::now() + 50ms;
+			 options.token = token;
+
+			 // in a coroutine
+			 const double* columns[] = {xs.data(), ys.data()};
+			 math_async::BatchResult result = co_await
+				 math_async::calculate_batch(inter, executor, columns,
+				 xs.size(), results.data(), options);
+
+			 // from anywhere, e.g. when the client disconnects
+			 token.cancel();
+
+	The columns are given in the order of variable_names(), as for
+	MathInterpreter::calculate_batch() with pointers. The interpreter, the
+	array of columns, the columns and the results must not be used elsewhere
+	and must outlive the returned task until it is finished; use a copy of
+	the interpreter per task to calculate several batches of the same
+	expression at once.
+
+	A cancelled batch, or one past its deadline, stops before its next
+	chunk. The result tells how it ended and how many rows were calculated.
+	Exceptions of the interpreter are thrown from co_await.
+*/
+
+template<typename Executor>
+concept AsyncExecutor = requires(Executor& executor) {
+	executor.post([]() {});
+};
+
+class CancellationToken {
+
+/*
+	Shared flag to cancel a task from any thread. Copies share the flag.
+*/
+
+public:
+	CancellationToken(): m_isCancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void cancel() noexcept {
+		m_isCancelled->store(true, std::memory_order_release);
+	}
+
+	bool is_cancelled() const noexcept {
+		return m_isCancelled->load(std::memory_order_acquire);
+	}
+
+protected:
+	std::shared_ptr<std::atomic<bool>> m_isCancelled;
+
+};
+
+struct Options {
+	// rows per chunk, or 0 to size the chunks to take about timeSlice
+	size_t chunkRows = 0;
+	std::chrono::microseconds timeSlice {200};
+
+	std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::time_point::max();
+	CancellationToken token;
+};
+
+enum class Status {
+	COMPLETED,
+	CANCELLED,
+	DEADLINE_EXCEEDED
+};
+
+struct BatchResult {
+	Status status;
+	size_t numRowsDone; // the rows from 0 to numRowsDone have results
+};
+
+template<typename T>
+class Task {
+
+/*
+	Lazily started coroutine with a result of type T. It starts when awaited,
+	and resumes its awaiter when finished. It can be awaited from any other
+	coroutine type.
+*/
+
+public:
+	struct promise_type {
+		std::variant<std::monostate, T, std::exception_ptr> result;
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+
+		Task get_return_object() noexcept {
+			return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		auto final_suspend() noexcept {
+			struct FinalAwaiter {
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				std::coroutine_handle<> await_suspend(
+					std::coroutine_handle<promise_type> handle) noexcept {
+					return handle.promise().continuation;
+				}
+
+				void await_resume() noexcept {}
+			};
+
+			return FinalAwaiter {};
+		}
+
+		template<typename Value>
+			requires std::convertible_to<Value, T>
+		void return_value(Value&& value) {
+			result.template emplace<1>(std::forward<Value>(value));
+		}
+
+		void unhandled_exception() noexcept {
+			result.template emplace<2>(std::current_exception());
+		}
+	};
+
+	Task(Task&& other) noexcept: m_handle(std::exchange(other.m_handle, {})) {}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	~Task() {
+		if(m_handle) m_handle.destroy();
+	}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(
+		std::coroutine_handle<> awaiter) noexcept {
+		m_handle.promise().continuation = awaiter;
+		return m_handle;
+	}
+
+	T await_resume() {
+		auto& result = m_handle.promise().result;
+
+		if(result.index() == 2) std::rethrow_exception(std::get<2>(result));
+
+		return std::move(std::get<1>(result));
+	}
+
+protected:
+	std::coroutine_handle<promise_type> m_handle;
+
+	explicit Task(std::coroutine_handle<promise_type> handle) noexcept:
+		m_handle(handle) {}
+
+};
+
+template<AsyncExecutor Executor>
+auto schedule_on(Executor& executor) noexcept {
+
+/*
+	Awaitable that resumes the coroutine on the executor, behind the work
+	already queued on it.
+*/
+
+	struct ScheduleAwaiter {
+		Executor& executor;
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) {
+			executor.post([handle]() { handle.resume(); });
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	return ScheduleAwaiter {executor};
+
+}
+
+namespace detail {
+
+static const size_t FIRST_CHUNK_ROWS = 1024;
+static const size_t MIN_CHUNK_ROWS = 64;
+
+inline size_t next_chunk_rows(size_t numRows,
+	std::chrono::steady_clock::duration elapsed,
+	std::chrono::microseconds timeSlice) {
+
+/*
+	Scales the rows of the last chunk by how far it was from the time slice,
+	at most 4 times per chunk so that a single slow chunk (e.g. preempted)
+	does not shrink the next ones too much.
+*/
+
+	double ratio = std::chrono::duration<double>(timeSlice).count() /
+		std::max(std::chrono::duration<double>(elapsed).count(), 1e-9);
+	ratio = std::min(std::max(ratio, 0.25), 4.0);
+
+	return std::max(static_cast<size_t>(numRows * ratio), MIN_CHUNK_ROWS);
+
+}
+
+} // namespace detail
+
+template<AsyncExecutor Executor>
+Task<BatchResult> calculate_batch(MathInterpreter& inter, Executor& executor,
+	const double* const* columns, size_t numRows, double* results,
+	Options options = {}) {
+
+/*
+	Calculates numRows rows of the columns into results, in chunks on the
+	executor. See the description of the namespace above.
+*/
+
+	const size_t numVars = inter.variable_names().size();
+	std::vector<const double*> chunkColumns(numVars);
+
+	size_t chunkRows = options.chunkRows ? options.chunkRows :
+		detail::FIRST_CHUNK_ROWS;
+	size_t row = 0;
+
+	while(row < numRows) {
+		co_await schedule_on(executor);
+
+		if(options.token.is_cancelled()) {
+			co_return BatchResult {Status::CANCELLED, row};
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		if(start >= options.deadline) {
+			co_return BatchResult {Status::DEADLINE_EXCEEDED, row};
+		}
+
+		size_t rows = std::min(chunkRows, numRows - row);
+
+		for(size_t i = 0; i < numVars; i++) {
+			chunkColumns[i] = columns[i] ? columns[i] + row : nullptr;
+		}
+
+		inter.calculate_batch(chunkColumns.data(), rows, results + row);
+		row += rows;
+
+		if(!options.chunkRows) {
+			chunkRows = detail::next_chunk_rows(rows,
+				std::chrono::steady_clock::now() - start, options.timeSlice);
+		}
+	}
+
+	co_return BatchResult {Status::COMPLETED, row};
+
+}
+
+} // namespace math_async
+
+#endif // !MATH_ASYNC_H
@@ -12,6 +12,37 @@ Please do not delete this section.
 */
 
 #include "math_interpreter.h"
+#include "reproducible_math.h"
+#include "math_metrics.h"
+#include "math_probes.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include <array>
+#include <type_traits>
+#include <chrono>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+const size_t MathInterpreter::MEMO_SLOT_BITS;
+const size_t MathInterpreter::MEMO_SLOTS;
+const size_t MathInterpreter::MEMO_WINDOW;
+const size_t MathInterpreter::MEMO_MIN_HIT_PERCENT;
+const size_t MathInterpreter::MEMO_COOLDOWN;
+const size_t MathInterpreter::BATCH_CHUNK;
+const size_t MathInterpreter::DISTINCT_MIN_ROWS;
+const size_t MathInterpreter::DISTINCT_SAMPLE;
+const size_t MathInterpreter::DISTINCT_MAX_PERCENT;
+const size_t MathInterpreter::MAX_FIXED_VARS;
+const size_t MathInterpreter::COMPILE_CHUNK;
 
 void MathInterpreter::init_with_expr(const std::string& input) {
 
@@ -20,9 +51,32 @@ void MathInterpreter::init_with_expr(const std::string& input) {
 */
 
 	m_inputExpr = input;
+	m_exprHash = m_hash(input);
 
-	m_make_input_bits();
-	m_make_rpn();
+	try {
+		m_make_input_bits();
+		m_make_rpn();
+	}
+	catch(const INPUT_EXPR_SYNTAX_ERROR&) {
+		MathMetrics::count_rejection(MathMetrics::Rejection::SYNTAX_ERROR);
+		throw;
+	}
+	catch(const UNKNOWN_EXPRESSION&) {
+		MathMetrics::count_rejection(
+			MathMetrics::Rejection::UNKNOWN_EXPRESSION);
+		throw;
+	}
+	catch(const BAD_INIT&) {
+		MathMetrics::count_rejection(MathMetrics::Rejection::EMPTY);
+		throw;
+	}
+
+	m_sourceRpn = m_rpn;
+
+	m_fold_constants();
+	m_compile();
+
+	m_specializations.clear();
 
 }
 
@@ -42,202 +96,2396 @@ void MathInterpreter::set_value(const std::string& varName,
 
 }
 
-void MathInterpreter::m_make_input_bits() {
+MathInterpreter::CompileResults MathInterpreter::compile_all(
+	const std::vector<std::string>& inputs, size_t numThreads) {
 
 /*
-	Generates input bits for the given input expression.
+	inputs:     The input expressions.
+	numThreads: The threads to initialize the interpreters on, 0 for one per
+	            core.
+
+	Initializes an interpreter per input expression, as init_with_expr() 
+	does, and returns them in the order of the inputs. Input expressions 
+	that only differ in whitespace are initialized once, and copied, so that
+	their interpreters report the text of the first one as expression(). 
+	The errors of the invalid input expressions, e.g. "1+" or "sin()", are 
+	returned as diagnostics instead of being thrown.
+
+	The threads take chunks of COMPILE_CHUNK expressions in turn, and each 
+	one writes only the interpreters of its own chunks, so that they share 
+	nothing but the chunk counter.
+*/
 
-	Consider the input expression "-1.7512  + sin($f$)"
-	When this expression is divided into input bits, the resulting bits are as
-	below:
+	CompileResults results;
+	results.exprs.resize(inputs.size());
 
-	-1.7512    +            sin         (               $f$         )
-	NUMBER     OPERATOR     FUNCTION    LPARENTHESIS    VARIABLE    RPARENTHESIS
+	// index of the first input of each distinct expression, and of the 
+	// distinct expression of each input
+	std::unordered_map<std::string, size_t> distinctIndices;
+	std::vector<size_t> firstInputs;
+	std::vector<size_t> duplicateInputs;
+	std::vector<size_t> distinctOf(inputs.size());
 
-	This function identifies these bits and saves them in the m_inputBits 
-	vector. After the bits are created, conversion from the infix notation to
-	reverse polish (postfix) notation is done by only respecting the bit types
-	and not the bit values (strings).
-*/
+	// the interpreter ignores whitespace, so the text without it is the key
+	std::vector<size_t> offsets;
 
-	// clear whitespaces from the input expression
-	std::string inputExprNoWS = m_clear_whitespaces(m_inputExpr);
+	for(size_t i = 0; i < inputs.size(); i++) {
+		auto inserted = distinctIndices.emplace(
+			m_clear_whitespaces(inputs[i], offsets), firstInputs.size());
 
-	if(inputExprNoWS.empty()) throw BAD_INIT();
+		if(inserted.second) firstInputs.push_back(i);
+		else duplicateInputs.push_back(i);
 
-	auto it = inputExprNoWS.cbegin();
-	auto itBegin = inputExprNoWS.cbegin();
-	auto itEnd = inputExprNoWS.cend();
+		distinctOf[i] = inserted.first->second;
+	}
 
-	while(it != itEnd) {
-		InputBit extractedBit;
+	results.numDistinct = firstInputs.size();
 
-		if(m_isNumber(it, itBegin, itEnd)) {
-			extractedBit = m_extract_number(it, itBegin, itEnd);
+	std::vector<std::string> errors(firstInputs.size());
+
+	if(numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	numThreads = std::max<size_t>(1, std::min(numThreads, 
+		(firstInputs.size() + COMPILE_CHUNK - 1) / COMPILE_CHUNK));
+
+	auto runChunks = [numThreads](size_t numTasks, 
+		const std::function<void(size_t)>& task) {
+		std::atomic<size_t> nextTask(0);
+
+		auto work = [&]() {
+			for(size_t begin = nextTask.fetch_add(COMPILE_CHUNK); 
+				begin < numTasks; begin = nextTask.fetch_add(COMPILE_CHUNK)) {
+				size_t end = std::min(begin + COMPILE_CHUNK, numTasks);
+
+				for(size_t i = begin; i < end; i++) task(i);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(size_t t = 1; t < numThreads; t++) threads.emplace_back(work);
+
+		work();
+
+		for(auto& thread: threads) thread.join();
+	};
+
+	runChunks(firstInputs.size(), [&](size_t distinct) {
+		MathInterpreter& expr = results.exprs[firstInputs[distinct]];
+
+		try {
+			expr.init_with_expr(inputs[firstInputs[distinct]]);
 		}
-		else if(m_isOperator(it, itBegin, itEnd)) {
-			extractedBit = m_extract_operator(it, itBegin, itEnd);
+		catch(const std::exception& e) {
+			errors[distinct] = e.what();
+			expr = MathInterpreter();
 		}
-		else if(*it == '$') {
-			extractedBit = m_extract_variable(it, itBegin, itEnd);
+	});
+
+	runChunks(duplicateInputs.size(), [&](size_t duplicate) {
+		size_t input = duplicateInputs[duplicate];
+
+		if(errors[distinctOf[input]].empty()) {
+			results.exprs[input] = 
+				results.exprs[firstInputs[distinctOf[input]]];
 		}
-		else if(*it == '(' || *it == ')') {
-			extractedBit = m_extract_parenthesis(it, itEnd);
+	});
+
+	for(size_t i = 0; i < inputs.size(); i++) {
+		const std::string& error = errors[distinctOf[i]];
+
+		if(!error.empty()) {
+			results.diagnostics.push_back(CompileDiagnostic {i, error});
 		}
-		else { // consider all the rest to be functions (known or unknown)
-			extractedBit = m_extract_function(it, itBegin, itEnd);
+	}
+
+	return results;
+
+}
+
+void MathInterpreter::set_values(const double* values) {
+
+/*
+	Sets the values of all variables, given in the order of variable_names(),
+	without looking them up by name.
+*/
+
+	for(size_t i = 0; i < m_usedVars.size(); i++) {
+		m_varTable[m_usedVars[i]].second = values[i];
+	}
+
+}
+
+MathInterpreter MathInterpreter::specialize(const VarTable& boundValues) {
+
+/*
+	Returns a copy of the interpreter in which the given variables are replaced
+	with the given values, and in which the constant parts of the expression
+	are calculated in advance. The variables that are not bound are set with
+	set_value() on the returned interpreter, as usual. Throws if a variable is
+	not found.
+
+	Specializations are kept, so that specializing with the same values again
+	only costs a copy. At most MAX_SPECIALIZATIONS are kept: when there are 
+	more, e.g. when every call binds new values, the kept ones are dropped 
+	and the cache starts over, so that its memory stays bounded.
+*/
+
+	std::map<std::string, double> bindings;
+
+	for(const auto& boundValue: boundValues) {
+		if(!m_isVariable(boundValue.first)) {
+			throw UNKNOWN_VARIABLE(boundValue.first);
 		}
 
-		m_inputBits.push_back(extractedBit);
+		bindings[boundValue.first] = boundValue.second;
+	}
+
+	// the key lists the bit patterns of the values, so that e.g. 0.0 and -0.0
+	// give different specializations
+	std::string key;
+
+	for(const auto& binding: bindings) {
+		uint64_t bits;
+		std::memcpy(&bits, &binding.second, sizeof(bits));
+
+		key += binding.first + '=' + std::to_string(bits) + ';';
+	}
+
+	auto found = m_specializations.find(key);
+	if(found != m_specializations.end()) return *found->second;
+
+	auto specialized = std::make_shared<MathInterpreter>(*this);
+	specialized->m_specializations.clear();
+
+	for(auto& bit: specialized->m_sourceRpn) {
+		if(bit.type != BitType::VARIABLE) continue;
+
+		auto& var = specialized->m_varTable[std::stoi(bit.text)];
+		auto binding = bindings.find(var.first);
+
+		if(binding == bindings.end()) continue;
+
+		var.second = binding->second;
+		bit.text = m_number_to_string(binding->second);
+		bit.type = BitType::NUMBER;
+	}
+
+	specialized->m_rpn = specialized->m_sourceRpn;
+	specialized->m_fold_constants();
+	specialized->m_compile();
+
+	if(m_specializations.size() >= MAX_SPECIALIZATIONS) {
+		m_specializations.clear();
 	}
 
+	m_specializations[key] = specialized;
+
+	return *specialized;
+
 }
 
-void MathInterpreter::m_make_rpn() {
+const std::string& MathInterpreter::expression() const noexcept {
+
+	return m_inputExpr;
+
+}
+
+uint64_t MathInterpreter::expression_hash() const noexcept {
 
 /*
-	Converts infix notation to reverse polish notation (RPN) based on the input
-	bit types.
+	Hash of the input expression, given to the probes in math_probes.h to
+	tell the expressions apart.
+*/
 
-	Once the conversion is done, checks and validates the resulting RPN to look
-	for errors.
+	return m_exprHash;
+
+}
+
+std::vector<std::string> MathInterpreter::variable_names() const {
+
+/*
+	Returns the names of the variables used in the expression, without 
+	repetitions, in the order in which they first appear. This is also the 
+	order of the variable values taken by the functions of to_c_source().
 */
 
-	for(const auto& bit: m_inputBits) {
-		switch(bit.second) {
-			case BitType::OPERATOR:
-				m_handle_operator(bit);
-				break;
+	std::vector<std::string> varNames;
+
+	for(const auto& varIndex: m_used_vars()) {
+		varNames.push_back(m_varTable[varIndex].first);
+	}
+
+	return varNames;
+
+}
+
+std::string MathInterpreter::to_c_source(const std::string& funcName) const {
+
+/*
+	Translates the expression to C source code defining two functions:
+
+	double funcName(const double* vars);
+		Calculates the expression for the given variable values.
+
+	void funcName_batch(const double* const* columns, size_t numRows,
+		double* results);
+		Calculates the expression for each row of the given variable columns.
+
+	The variables are given in the order of variable_names(). The functions
+	calculate exactly the same operations as calculate(), but the C compiler
+	may contract multiplications and additions into fused multiply-adds
+	unless -ffp-contract=off is given.
+
+	In the reproducible mode, the functions of the expression are called 
+	through the pointers math_reproducible_exp, math_reproducible_pow etc. 
+	defined by the source, which must be set to the functions of 
+	ReproducibleMath before calculating (NativeModule does this). The source 
+	must then be compiled with -ffp-contract=off to give the same results as
+	calculate().
+*/
+
+	std::vector<size_t> usedVars = m_used_vars();
+	std::vector<size_t> slotOf(m_varTable.size(), 0);
+
+	for(size_t i = 0; i < usedVars.size(); i++) slotOf[usedVars[i]] = i;
+
+	std::ostringstream src;
+
+	src << "#include <math.h>\n"
+		"#include <stddef.h>\n\n";
+
+	// the functions of the standard library, or the pointers to the ones of
+	// ReproducibleMath
+	std::string prefix = m_reproducible ? "math_reproducible_" : "";
+
+	if(m_reproducible) {
+		const char* names[] = {"exp", "log", "log10", "sin", "cos", "tan",
+			"asin", "acos", "atan"};
+
+		for(const auto& name: names) {
+			src << "double (*" << prefix << name << ")(double);\n";
+		}
+
+		src << "double (*" << prefix << "pow)(double, double);\n\n";
+	}
+
+	src << "static inline double " << funcName << "_kernel(";
+
+	for(size_t i = 0; i < usedVars.size(); i++) {
+		src << (i ? ", " : "") << "double v" << i;
+	}
+
+	src << (usedVars.empty() ? "void" : "") << ") {\n";
+
+	// every stack entry becomes a named constant of the C function
+	std::vector<std::string> stack;
+	size_t numTemps = 0;
+
+	for(const auto& bit: m_rpn) {
+		std::string value;
+
+		switch(bit.type) {
 			case BitType::NUMBER:
-				m_outputQueue.push(bit);
+				value = m_number_to_c_literal(m_string_to_number(bit.text));
 				break;
 			case BitType::VARIABLE:
-				m_handle_variable(bit);
+				stack.push_back("v" + std::to_string(
+					slotOf[std::stoi(bit.text)]));
+				continue;
+			case BitType::OPERATOR:
+			{
+				std::string rVal = stack.back();
+				stack.pop_back();
+				std::string lVal = stack.back();
+				stack.pop_back();
+
+				switch(bit.text[0]) {
+					case '%':
+						value = "fmod(" + lVal + ", " + rVal + ")";
+						break;
+					case '^':
+						value = prefix + "pow(" + lVal + ", " + rVal + ")";
+						break;
+					default:
+						value = lVal + " " + bit.text[0] + " " + rVal;
+						break;
+				}
+			}
 				break;
 			case BitType::FUNCTION:
-			case BitType::LPARENTHESIS:
-				m_operatorStack.push(bit);
-				break;
-			case BitType::RPARENTHESIS:
-				m_handle_rParenthesis(bit);
+			{
+				std::string val = stack.back();
+				stack.pop_back();
+
+				std::string pi = m_number_to_c_literal(M_PI);
+
+				switch((FUNCTION)std::stoi(bit.text)) {
+					case FUNCTION::LOG: 
+						value = prefix + "log(" + val + ")"; 
+						break;
+					case FUNCTION::LOG10: 
+						value = prefix + "log10(" + val + ")"; 
+						break;
+					case FUNCTION::SIN: 
+						value = prefix + "sin(" + val + ")"; 
+						break;
+					case FUNCTION::COS: 
+						value = prefix + "cos(" + val + ")"; 
+						break;
+					case FUNCTION::TAN: 
+						value = prefix + "tan(" + val + ")"; 
+						break;
+					case FUNCTION::COT: 
+						value = "1/" + prefix + "tan(" + val + ")"; 
+						break;
+					case FUNCTION::ASIN: 
+						value = prefix + "asin(" + val + ")"; 
+						break;
+					case FUNCTION::ACOS: 
+						value = prefix + "acos(" + val + ")"; 
+						break;
+					case FUNCTION::ATAN: 
+						value = prefix + "atan(" + val + ")"; 
+						break;
+					case FUNCTION::ACOT: 
+						value = prefix + "atan(1/" + val + ")"; 
+						break;
+					case FUNCTION::DEG:
+						value = "(" + val + "/(2*" + pi + "))*360";
+						break;
+					case FUNCTION::RAD:
+						value = "((" + val + "/360)*2)*" + pi;
+						break;
+					case FUNCTION::SQRT: value = "sqrt(" + val + ")"; break;
+					case FUNCTION::EXP: 
+						value = prefix + "exp(" + val + ")"; 
+						break;
+					case FUNCTION::ABS: value = "fabs(" + val + ")"; break;
+					default: value = "0.0"; break;
+				}
+			}
 				break;
 			default:
-				break;
+				continue;
 		}
 
+		std::string temp = "t" + std::to_string(numTemps++);
+		src << "\tconst double " << temp << " = " << value << ";\n";
+		stack.push_back(temp);
 	}
 
-	// Pop all items from the operator stack and push them to the output queue
-	while(!m_operatorStack.empty()) {
-		auto topBit = m_operatorStack.top();
-		m_outputQueue.push(topBit);
-		m_operatorStack.pop();
+	src << "\treturn " << stack.back() << ";\n"
+		"}\n\n";
+
+	src << "double " << funcName << "(const double* vars) {\n"
+		"\t(void)vars;\n"
+		"\treturn " << funcName << "_kernel(";
+
+	for(size_t i = 0; i < usedVars.size(); i++) {
+		src << (i ? ", " : "") << "vars[" << i << "]";
 	}
 
-	m_rpn.clear();
+	src << ");\n"
+		"}\n\n";
 
-	while(!m_outputQueue.empty()) {
-		m_rpn.push_back(m_outputQueue.front());
-		m_outputQueue.pop();
+	src << "void " << funcName << "_batch(const double* const* columns, "
+		"size_t numRows, double* results) {\n"
+		"\t(void)columns;\n"
+		"\tfor(size_t i = 0; i < numRows; i++) {\n"
+		"\t\tresults[i] = " << funcName << "_kernel(";
+
+	for(size_t i = 0; i < usedVars.size(); i++) {
+		src << (i ? ", " : "") << "columns[" << i << "][i]";
 	}
 
-	m_validate_rpn();
-	
+	src << ");\n"
+		"\t}\n"
+		"}\n";
+
+	return src.str();
+
 }
 
-void MathInterpreter::m_validate_rpn() {
+std::string MathInterpreter::explain(ExplainFormat format) const {
 
 /*
-	Checks and validates the RPN for errors. Looks for:
-		- Syntax errors in the input expression. (missing parentheses etc)
-		- Unknown expressions
+	Describes what the interpreter made of the expression:
+		- the tokens of the input expression, with their offsets
+		- the expression tree as parsed, and as calculated after the 
+		  constants were folded and the variables bound by specialize() were
+		  replaced. Folded constants, bound variables and memoized call 
+		  sites are marked.
+		- the instructions, each writing to a slot of the stack, which the
+		  fixed-size evaluators keep in registers
+		- the evaluator picked for the expression, and the other engines
+		- the estimated cost of a calculation in CPU cycles, from typical
+		  costs of the operators and functions on x86-64
+		- the maximum depth of the stack
 */
 
-	// firstly, look for a left parenthesis in the RPN to catch missing
-	// right parentheses. If this failure mode is not checked before others,
-	// missing right parentheses will trigger other errors and be masked by them
-	bool unknownExprFound = false;
-	InputBit unknownExprBit {std::string(), BitType::FUNCTION};
+	if(m_program.empty()) throw BAD_INIT();
 
-	for(auto& bit: m_rpn) {
-		switch(bit.second) {
-			case BitType::LPARENTHESIS:
-				throw INPUT_EXPR_SYNTAX_ERROR();
+	struct Row {
+		std::string code;
+		std::string opcode;
+		size_t slot;
+		bool isMemoized;
+		size_t cycles;
+	};
+
+	std::vector<Row> rows;
+	size_t depth = 0;
+	size_t maxDepth = 0;
+	size_t cycles = 0;
+
+	for(const auto& instruction: m_program) {
+		Row row {std::string(), std::string(), 0, instruction.memoSite != 0,
+			m_estimated_cycles(instruction)};
+		std::string slot;
+
+		switch(instruction.type) {
+			case BitType::NUMBER:
+				slot = "s" + std::to_string(depth++);
+				row.code = slot + " = " + m_number_to_string(instruction.value);
 				break;
 			case BitType::VARIABLE:
-			{
-				auto varIndex = m_isVariable(bit.first);
-				bit.first = std::to_string(varIndex - 1);
-			}
+				slot = "s" + std::to_string(depth++);
+				row.code = slot + " = $" + 
+					m_varTable[instruction.varIndex].first + "$";
+				break;
+			case BitType::OPERATOR:
+				slot = "s" + std::to_string(--depth - 1);
+				row.code = slot + " = " + slot + " " + instruction.op + " s" + 
+					std::to_string(depth);
 				break;
 			case BitType::FUNCTION:
-			{
-				auto funcType = m_isFunction(bit.first);
-
-				if(funcType == FUNCTION::NONE) {
-					unknownExprFound = true;
-					unknownExprBit.first = bit.first;
-				}
-
-				bit.first = std::to_string((int)funcType);
-			}
+				slot = "s" + std::to_string(depth - 1);
+				row.code = slot + " = " + m_function_name(instruction.func) + 
+					"(" + slot + ")";
 				break;
 			default:
 				break;
 		}
+
+		row.opcode = instruction.type == BitType::FUNCTION ? 
+			m_function_name(instruction.func) : 
+			Instrumentation::OPCODE_NAMES[m_opcode_of(instruction)];
+		row.slot = depth - 1;
+
+		maxDepth = std::max(maxDepth, depth);
+		cycles += row.cycles;
+		rows.push_back(row);
+	}
+
+	size_t stackSize = 2;
+	while(stackSize < maxDepth) stackSize *= 2;
+
+	std::string evaluator = m_evaluator ? "fixed" : "program";
+	MemoStats memoStats = memo_stats();
+
+	std::vector<ExplainNode> parsedNodes = m_explain_nodes(m_sourceRpn, false);
+	std::vector<ExplainNode> optimizedNodes = m_explain_nodes(m_rpn, true);
+
+	std::ostringstream oss;
+
+	if(format == ExplainFormat::JSON) {
+		oss << "{\n  \"expression\": " << m_json_string(m_inputExpr) << 
+			",\n  \"hash\": \"" << std::hex << std::setw(16) << 
+			std::setfill('0') << m_exprHash << std::dec << std::setfill(' ') <<
+			"\",\n  \"tokens\": [";
+
+		for(size_t i = 0; i < m_inputBits.size(); i++) {
+			const InputBit& bit = m_inputBits[i];
+
+			oss << (i ? ", " : "") << "{\"text\": " << m_json_string(bit.text) <<
+				", \"type\": \"" << m_bit_type_name(bit.type) << 
+				"\", \"begin\": " << bit.span.begin << ", \"end\": " << 
+				bit.span.end << "}";
+		}
+
+		oss << "],\n  \"parsed\": ";
+		m_explain_node_json(oss, parsedNodes, parsedNodes.size() - 1);
+		oss << ",\n  \"optimized\": ";
+		m_explain_node_json(oss, optimizedNodes, optimizedNodes.size() - 1);
+		oss << ",\n  \"instructions\": [";
+
+		for(size_t i = 0; i < rows.size(); i++) {
+			oss << (i ? "," : "") << "\n    {\"code\": " << 
+				m_json_string(rows[i].code) << ", \"opcode\": " << 
+				m_json_string(rows[i].opcode) << ", \"slot\": " << 
+				rows[i].slot << ", \"memoized\": " << 
+				(rows[i].isMemoized ? "true" : "false") << 
+				", \"estimatedCycles\": " << rows[i].cycles << "}";
+		}
+
+		oss << "\n  ],\n  \"engine\": {\"evaluator\": \"" << evaluator << "\"";
+
+		if(m_evaluator) {
+			oss << ", \"variables\": " << m_usedVars.size() << 
+				", \"stackSize\": " << stackSize;
+		}
+
+		oss << ", \"resultCache\": " << (m_resultCache ? 
+				m_resultCacheCapacity : 0) << 
+			", \"memoSites\": " << memoStats.sites << 
+			", \"activeMemoSites\": " << memoStats.activeSites << 
+			", \"reproducible\": " << (m_reproducible ? "true" : "false") <<
+			", \"shadow\": " << (m_shadow ? "true" : "false") << 
+			", \"profilingPeriod\": " << (m_profiler ? m_profilePeriod : 0) <<
+			"},\n  \"estimatedCycles\": " << cycles << 
+			",\n  \"maxStackDepth\": " << maxDepth << "\n}\n";
+
+		return oss.str();
 	}
 
-	if(unknownExprFound) throw UNKNOWN_EXPRESSION(unknownExprBit.first);
+	oss << "Expression: " << m_inputExpr << "\nHash:       " << std::hex << 
+		std::setw(16) << std::setfill('0') << m_exprHash << std::dec << 
+		std::setfill(' ') << "\n\nTokens:\n";
+
+	for(const auto& bit: m_inputBits) {
+		oss << "  " << std::left << std::setw(14) << 
+			m_bit_type_name(bit.type) << std::setw(12) << bit.text << 
+			std::right << "[" << bit.span.begin << ", " << bit.span.end << 
+			")\n";
+	}
+
+	oss << "\nParsed:\n";
+	m_explain_node_text(oss, parsedNodes, parsedNodes.size() - 1, 1);
+	oss << "\nOptimized:\n";
+	m_explain_node_text(oss, optimizedNodes, optimizedNodes.size() - 1, 1);
+	oss << "\nInstructions:\n";
+
+	for(size_t i = 0; i < rows.size(); i++) {
+		oss << std::setw(4) << i << "  " << std::left << std::setw(28) << 
+			rows[i].code << std::right << "~" << std::setw(3) << 
+			rows[i].cycles << " cycles" << 
+			(rows[i].isMemoized ? "  memoized" : "") << '\n';
+	}
+
+	oss << "\nEvaluator:       ";
+
+	if(m_evaluator) {
+		oss << "fixed (variables: " << m_usedVars.size() << ", stack size: " <<
+			stackSize << ")\n";
+	}
+	else {
+		oss << "program (generic RPN loop)\n";
+	}
+
+	oss << "Result cache:    ";
+	if(m_resultCache) oss << m_resultCacheCapacity << " entries\n";
+	else oss << "off\n";
+
+	oss << "Memoization:     " << memoStats.activeSites << " of " << 
+		memoStats.sites << " call sites active\n" <<
+		"Reproducible:    " << (m_reproducible ? "yes" : "no") << '\n' <<
+		"Shadow mode:     " << (m_shadow ? "on" : "off") << '\n' <<
+		"Profiling:       ";
+
+	if(m_profiler) oss << "every " << m_profilePeriod << " calculations\n";
+	else oss << "off\n";
+
+	oss << "Estimated cost:  ~" << cycles << " cycles per calculation\n" <<
+		"Max stack depth: " << maxDepth << '\n';
+
+	return oss.str();
 
 }
 
-double MathInterpreter::calculate() {
+void MathInterpreter::set_memoization(bool enabled) {
 
 /*
-	Calculates the expression given in reverse polish notation, and returns the 
-	result as double.
+	Enables or disables the memoization of expensive function calls. When
+	enabled, each call site decides on its own whether memoizing pays off,
+	based on the hit rate it observes at runtime.
 */
 
-	for(const auto& bit: m_rpn) {
-		switch(bit.second) {
-			case BitType::NUMBER:
-				m_numberStack.push(std::stod(bit.first));
-				break;
-			case BitType::OPERATOR:
-			{
-				double rVal = m_numberStack.top();
-				m_numberStack.pop();
-				double lVal = m_numberStack.top();
-				m_numberStack.pop();
-				std::string opName = bit.first;
+	m_memoEnabled = enabled;
+
+	for(auto& site: m_memoSites) {
+		site.enabled = enabled;
+		site.windowLookups = 0;
+		site.windowHits = 0;
+		site.idleCalls = 0;
+	}
+
+}
+
+void MathInterpreter::set_result_cache(size_t capacity) {
+
+/*
+	Keeps the results of up to the given number of calculations, keyed by the
+	values of the variables. Setting the capacity to 0 removes the cache.
+*/
+
+	m_resultCacheCapacity = capacity;
+
+	m_make_result_cache();
+
+}
+
+void MathInterpreter::set_reproducible(bool enabled) {
+
+/*
+	Enables or disables the reproducible mode, in which the functions and the
+	^ operator are calculated with ReproducibleMath. The other operators are
+	exact in IEEE 754 already, and the order of all operations is fixed by the
+	RPN, so that the results are bitwise identical on every host and in every
+	way of calculating them. The float batch calculations are reproducible as
+	well, but of course give different results than the double ones.
+
+	The constants of the expression are folded again, since they were folded
+	with the functions of the previous mode.
+*/
+
+	if(enabled == m_reproducible) return;
+
+	m_reproducible = enabled;
+
+	if(m_sourceRpn.empty()) return;
+
+	m_rpn = m_sourceRpn;
+
+	m_fold_constants();
+	m_compile();
+
+	m_specializations.clear();
+
+}
+
+bool MathInterpreter::is_reproducible() const noexcept {
+
+	return m_reproducible;
+
+}
+
+void MathInterpreter::set_shadow(const ShadowSampler::Config& config) {
+
+/*
+	Enables the shadow mode with the given sampling configuration, replacing
+	the previous sampler and its statistics. Copies of the interpreter, like
+	its specializations, report to the same sampler.
+*/
+
+	m_shadow = std::make_shared<ShadowSampler>(config);
+
+}
+
+void MathInterpreter::disable_shadow() noexcept {
+
+	m_shadow.reset();
+
+}
+
+Instrumentation::Snapshot MathInterpreter::instrumentation() const {
+
+/*
+	Returns the counters and timings of the instrumentation. All zero unless
+	built with MATH_INTERPRETER_INSTRUMENT defined.
+*/
+
+	std::array<std::string, Instrumentation::NUM_FUNCTIONS> functionNames;
+
+	for(size_t i = 0; i < functionNames.size(); i++) {
+		functionNames[i] = m_function_name((FUNCTION)i);
+	}
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	return m_instrumentation.snapshot(m_inputExpr, functionNames);
+#else
+	return Instrumentation().snapshot(m_inputExpr, functionNames);
+#endif
+
+}
+
+void MathInterpreter::reset_instrumentation() noexcept {
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	m_instrumentation.reset();
+#endif
+
+}
+
+void MathInterpreter::set_profiling(size_t period) {
+
+/*
+	Enables the profiling mode, in which every period-th calculation of 
+	calculate() is timed per instruction, and its time attributed to the 
+	subexpressions of the input expression. See Profiler. Sampled 
+	calculations run the generic RPN loop and are several times slower, so a
+	period of a few hundred keeps the overhead low. The batch calculations 
+	are not profiled.
+
+	Changing the expression, e.g. with set_reproducible(), restarts the 
+	profile. Copies of the interpreter add to the same profile, while 
+	specializations have their own.
+*/
+
+	m_profilePeriod = period;
+	m_profiler.reset();
+
+	if(m_profilePeriod && !m_program.empty()) m_make_profiler();
+
+}
+
+void MathInterpreter::disable_profiling() noexcept {
+
+	m_profilePeriod = 0;
+	m_profiler.reset();
+
+}
+
+Profiler::Profile MathInterpreter::profile() const {
+
+	if(!m_profiler) return Profiler::Profile {m_inputExpr, 0, 0, {}};
+
+	return m_profiler->profile();
+
+}
+
+ShadowSampler::Stats MathInterpreter::shadow_stats() const {
+
+	if(!m_shadow) return ShadowSampler::Stats {};
+
+	return m_shadow->stats();
+
+}
+
+ResultCache::Stats MathInterpreter::result_cache_stats() const {
+
+	if(!m_resultCache) return ResultCache::Stats {0, 0, 0};
+
+	return m_resultCache->stats();
+
+}
+
+MathInterpreter::MemoStats MathInterpreter::memo_stats() const noexcept {
+
+/*
+	Returns the hit/miss statistics of the memoization caches, summed over all
+	call sites of the expression.
+*/
+
+	MemoStats stats {m_memoSites.size(), 0, 0, 0};
+
+	for(const auto& site: m_memoSites) {
+		if(site.enabled) stats.activeSites++;
+		stats.hits += site.hits;
+		stats.misses += site.misses;
+	}
+
+	return stats;
+
+}
+
+void MathInterpreter::m_make_input_bits() {
+
+/*
+	Generates input bits for the given input expression.
+
+	Consider the input expression "-1.7512  + sin($f$)"
+	When this expression is divided into input bits, the resulting bits are as
+	below:
+
+	-1.7512    +            sin         (               $f$         )
+	NUMBER     OPERATOR     FUNCTION    LPARENTHESIS    VARIABLE    RPARENTHESIS
+
+	This function identifies these bits and saves them in the m_inputBits 
+	vector, along with the offsets of their text in the input expression.
+	After the bits are created, conversion from the infix notation to
+	reverse polish (postfix) notation is done by only respecting the bit types
+	and not the bit values (strings).
+*/
+
+	MATH_PROBE2(lex_entry, m_exprHash, m_inputExpr.size());
+
+	// clear whitespaces from the input expression
+	std::vector<size_t> offsets;
+	std::string inputExprNoWS = m_clear_whitespaces(m_inputExpr, offsets);
+
+	if(inputExprNoWS.empty()) throw BAD_INIT();
+
+	auto it = inputExprNoWS.cbegin();
+	auto itBegin = inputExprNoWS.cbegin();
+	auto itEnd = inputExprNoWS.cend();
+
+	while(it != itEnd) {
+		InputBit extractedBit;
+		size_t begin = it - itBegin;
+
+		if(m_isNumber(it, itBegin, itEnd)) {
+			extractedBit = m_extract_number(it, itBegin, itEnd);
+		}
+		else if(m_isOperator(it, itBegin, itEnd)) {
+			extractedBit = m_extract_operator(it, itBegin, itEnd);
+		}
+		else if(*it == '$') {
+			extractedBit = m_extract_variable(it, itBegin, itEnd);
+		}
+		else if(*it == '(' || *it == ')') {
+			extractedBit = m_extract_parenthesis(it, itEnd);
+		}
+		else { // consider all the rest to be functions (known or unknown)
+			extractedBit = m_extract_function(it, itBegin, itEnd);
+		}
+
+		size_t end = it - itBegin;
+		extractedBit.span = SourceSpan {offsets[begin], 
+			end > begin ? offsets[end - 1] + 1 : offsets[begin]};
+
+		m_inputBits.push_back(extractedBit);
+	}
+
+	MATH_PROBE2(lex_return, m_exprHash, m_inputBits.size());
+
+}
+
+void MathInterpreter::m_make_rpn() {
+
+/*
+	Converts infix notation to reverse polish notation (RPN) based on the input
+	bit types.
+
+	Once the conversion is done, checks and validates the resulting RPN to look
+	for errors.
+*/
+
+	MATH_PROBE2(parse_entry, m_exprHash, m_inputBits.size());
+
+	for(const auto& bit: m_inputBits) {
+		switch(bit.type) {
+			case BitType::OPERATOR:
+				m_handle_operator(bit);
+				break;
+			case BitType::NUMBER:
+				m_outputQueue.push(bit);
+				break;
+			case BitType::VARIABLE:
+				m_handle_variable(bit);
+				break;
+			case BitType::FUNCTION:
+			case BitType::LPARENTHESIS:
+				m_operatorStack.push(bit);
+				break;
+			case BitType::RPARENTHESIS:
+				m_handle_rParenthesis(bit);
+				break;
+			default:
+				break;
+		}
+
+	}
+
+	// Pop all items from the operator stack and push them to the output queue
+	while(!m_operatorStack.empty()) {
+		auto topBit = m_operatorStack.top();
+		m_outputQueue.push(topBit);
+		m_operatorStack.pop();
+	}
+
+	m_rpn.clear();
+
+	while(!m_outputQueue.empty()) {
+		m_rpn.push_back(m_outputQueue.front());
+		m_outputQueue.pop();
+	}
+
+	m_validate_rpn();
+
+	MATH_PROBE2(parse_return, m_exprHash, m_rpn.size());
+	
+}
+
+void MathInterpreter::m_validate_rpn() {
+
+/*
+	Checks and validates the RPN for errors. Looks for:
+		- Syntax errors in the input expression. (missing parentheses etc)
+		- Unknown expressions
+		- Missing or extra operands, by following the depth of the stack the
+		  RPN would be calculated on: operators take 2 entries, functions 1,
+		  and exactly 1 entry, the result, must be left. Everything after
+		  parsing (folding, compiling, calculating) relies on this.
+*/
+
+	// firstly, look for a left parenthesis in the RPN to catch missing
+	// right parentheses. If this failure mode is not checked before others,
+	// missing right parentheses will trigger other errors and be masked by them
+	bool unknownExprFound = false;
+	InputBit unknownExprBit {std::string(), BitType::FUNCTION, SourceSpan {}};
+
+	bool isMissingOperand = false;
+	size_t stackDepth = 0;
+
+	for(auto& bit: m_rpn) {
+		switch(bit.type) {
+			case BitType::LPARENTHESIS:
+				throw INPUT_EXPR_SYNTAX_ERROR();
+				break;
+			case BitType::NUMBER:
+				stackDepth++;
+				break;
+			case BitType::VARIABLE:
+			{
+				auto varIndex = m_isVariable(bit.text);
+				bit.text = std::to_string(varIndex - 1);
+				stackDepth++;
+			}
+				break;
+			case BitType::OPERATOR:
+				if(stackDepth < 2) isMissingOperand = true;
+				else stackDepth--;
+				break;
+			case BitType::FUNCTION:
+			{
+				if(stackDepth < 1) isMissingOperand = true;
+
+				auto funcType = m_isFunction(bit.text);
+
+				if(funcType == FUNCTION::NONE) {
+					unknownExprFound = true;
+					unknownExprBit.text = bit.text;
+				}
+
+				bit.text = std::to_string((int)funcType);
+			}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if(unknownExprFound) throw UNKNOWN_EXPRESSION(unknownExprBit.text);
+
+	if(isMissingOperand || stackDepth != 1) throw INPUT_EXPR_SYNTAX_ERROR();
+
+}
+
+void MathInterpreter::m_fold_constants() {
+
+/*
+	Replaces the operators and functions whose arguments are all numbers with
+	their results, e.g. the RPN of "2 * sin(rad(30)) + $x$"
+
+	2    30    rad    sin    *    $x$    +
+
+	becomes
+
+	1    $x$    +
+
+	The RPN is scanned once while keeping track of which stack entries would be
+	constant. Since every constant argument has already been folded into a 
+	single number, the arguments of a foldable bit are always the last bits
+	of the folded RPN. The folded numbers span the text of the subexpression
+	they replace.
+*/
+
+	MATH_PROBE2(optimize_entry, m_exprHash, m_rpn.size());
+
+	std::vector<InputBit> foldedRpn;
+	std::vector<bool> isConstStack;
+
+	for(const auto& bit: m_rpn) {
+		switch(bit.type) {
+			case BitType::NUMBER:
+				foldedRpn.push_back(bit);
+				isConstStack.push_back(true);
+				break;
+			case BitType::VARIABLE:
+				foldedRpn.push_back(bit);
+				isConstStack.push_back(false);
+				break;
+			case BitType::OPERATOR:
+			{
+				bool rIsConst = isConstStack.back();
+				isConstStack.pop_back();
+				bool lIsConst = isConstStack.back();
+				isConstStack.pop_back();
+
+				if(!lIsConst || !rIsConst) {
+					foldedRpn.push_back(bit);
+					isConstStack.push_back(false);
+					break;
+				}
+
+				double rVal = m_string_to_number(foldedRpn.back().text);
+				SourceSpan rSpan = foldedRpn.back().span;
+				foldedRpn.pop_back();
+				double lVal = m_string_to_number(foldedRpn.back().text);
+
+				Instruction instruction;
+				m_resolve(instruction, bit);
+
+				foldedRpn.back().text = m_number_to_string(
+					instruction.operation(lVal, rVal));
+				foldedRpn.back().span = m_subexpression_span(bit.span,
+					foldedRpn.back().span, rSpan);
+				isConstStack.push_back(true);
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				if(!isConstStack.back()) {
+					foldedRpn.push_back(bit);
+					break;
+				}
+
+				double val = m_string_to_number(foldedRpn.back().text);
+
+				Instruction instruction;
+				m_resolve(instruction, bit);
+
+				foldedRpn.back().text = m_number_to_string(
+					instruction.function(val));
+				foldedRpn.back().span = m_subexpression_span(bit.span,
+					foldedRpn.back().span, foldedRpn.back().span);
+			}
+				break;
+			default:
+				foldedRpn.push_back(bit);
+				break;
+		}
+	}
+
+	m_rpn = std::move(foldedRpn);
+
+	MATH_PROBE2(optimize_return, m_exprHash, m_rpn.size());
+
+}
+
+void MathInterpreter::m_make_result_cache() {
+
+/*
+	Creates the result cache for the current expression, if one was requested.
+	Expressions whose result may change between calls with the same variable
+	values are never cached.
+*/
+
+	m_resultCache.reset();
+	m_cacheKeyVars.clear();
+
+	if(m_resultCacheCapacity == 0 || m_rpn.empty()) return;
+	if(!m_is_deterministic()) return;
+
+	// a variable that appears more than once in the expression has more than
+	// one entry in the variable table, but only the first entry is used
+	for(size_t i = 0; i < m_varTable.size(); i++) {
+		if(m_isVariable(m_varTable[i].first) == i+1) m_cacheKeyVars.push_back(i);
+	}
+
+	m_cacheKey.resize(m_cacheKeyVars.size());
+	m_resultCache = std::make_shared<ResultCache>(m_resultCacheCapacity,
+		m_cacheKeyVars.size());
+
+}
+
+void MathInterpreter::m_compile() {
+
+/*
+	Prepares the RPN for calculation. Must be called after every change to
+	the RPN.
+*/
+
+	MATH_PROBE2(compile_entry, m_exprHash, m_rpn.size());
+
+	auto start = std::chrono::steady_clock::now();
+
+	m_make_program();
+	m_make_memo_sites();
+	m_make_result_cache();
+	m_make_evaluator();
+
+	m_instructionCycles.assign(m_program.size(), 0);
+	if(m_profilePeriod) m_make_profiler();
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	m_make_instrumentation();
+#endif
+
+	MathMetrics::add_compile(MathMetrics::Compile::EXPRESSION, 
+		std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count());
+
+	MATH_PROBE2(compile_return, m_exprHash, m_program.size());
+
+}
+
+void MathInterpreter::m_make_program() {
+
+/*
+	Resolves every bit of the RPN to an instruction, so that calculate() does
+	not parse strings, and calls the code of the operators and functions 
+	directly instead of going through a switch.
+*/
+
+	m_program.clear();
+
+	for(const auto& bit: m_rpn) {
+		Instruction instruction;
+		m_resolve(instruction, bit);
+
+		m_program.push_back(instruction);
+	}
+
+}
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+void MathInterpreter::m_make_instrumentation() {
+
+/*
+	Gives the instruction counts of the program to the instrumentation, which
+	derives the executions per opcode and function from them.
+*/
+
+	Instrumentation::OpcodeCounts opcodeCounts {};
+	Instrumentation::FunctionCounts functionCounts {};
+
+	for(const auto& instruction: m_program) {
+		if(instruction.type == BitType::FUNCTION) {
+			functionCounts[(size_t)instruction.func]++;
+		}
+		else {
+			opcodeCounts[m_opcode_of(instruction)]++;
+		}
+	}
+
+	m_instrumentation.set_program(opcodeCounts, functionCounts);
+
+}
+#endif
+
+void MathInterpreter::m_make_profiler() {
+
+/*
+	Creates the profiler of the current program, with the subexpression of
+	each instruction. The operands of an instruction are the subexpressions
+	on the top of a stack, as in the calculation.
+*/
+
+	std::vector<Profiler::Site> sites;
+	std::vector<Profiler::Site> stack;
+
+	for(size_t i = 0; i < m_program.size(); i++) {
+		const Instruction& instruction = m_program[i];
+		Profiler::Site site {std::string(), instruction.span, i};
+
+		switch(instruction.type) {
+			case BitType::OPERATOR:
+			{
+				Profiler::Site rSite = stack.back();
+				stack.pop_back();
+				Profiler::Site lSite = stack.back();
+				stack.pop_back();
+
+				site.label = std::string(1, instruction.op);
+				site.span = m_subexpression_span(instruction.span, lSite.span,
+					rSite.span);
+				site.first = lSite.first;
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				Profiler::Site argSite = stack.back();
+				stack.pop_back();
+
+				site.label = m_function_name(instruction.func);
+				site.span = m_subexpression_span(instruction.span, 
+					argSite.span, argSite.span);
+				site.first = argSite.first;
+			}
+				break;
+			default:
+				site.label = Instrumentation::OPCODE_NAMES[
+					m_opcode_of(instruction)];
+				break;
+		}
+
+		stack.push_back(site);
+		sites.push_back(site);
+	}
+
+	m_profiler = std::make_shared<Profiler>(m_profilePeriod, m_inputExpr, 
+		sites);
+	m_profileCountdown = m_profiler->period();
+
+}
+
+void MathInterpreter::m_make_evaluator() {
+
+/*
+	Picks the evaluator instantiated for the number of variables and the stack
+	depth of the expression from a table of evaluators, made at compile time.
+	Expressions that are too large for all of them use m_calculate_program().
+*/
+
+	#define FIXED_EVALUATORS(numVars) { \
+		&MathInterpreter::m_calculate_fixed<numVars, 2>, \
+		&MathInterpreter::m_calculate_fixed<numVars, 4>, \
+		&MathInterpreter::m_calculate_fixed<numVars, 8>, \
+		&MathInterpreter::m_calculate_fixed<numVars, 16> }
+
+	static const Evaluator fixedEvaluators[MAX_FIXED_VARS + 1][4] = {
+		FIXED_EVALUATORS(0),
+		FIXED_EVALUATORS(1),
+		FIXED_EVALUATORS(2),
+		FIXED_EVALUATORS(3),
+		FIXED_EVALUATORS(4),
+		FIXED_EVALUATORS(5),
+		FIXED_EVALUATORS(6),
+		FIXED_EVALUATORS(7),
+		FIXED_EVALUATORS(8)
+	};
+
+	#undef FIXED_EVALUATORS
+
+	m_usedVars = m_used_vars();
+
+	std::vector<size_t> slotOf(m_varTable.size(), 0);
+	for(size_t i = 0; i < m_usedVars.size(); i++) slotOf[m_usedVars[i]] = i;
+
+	size_t stackSize = 0;
+	size_t maxStackSize = 0;
+
+	for(auto& instruction: m_program) {
+		switch(instruction.type) {
+			case BitType::VARIABLE:
+				instruction.varSlot = slotOf[instruction.varIndex];
+				stackSize++;
+				break;
+			case BitType::NUMBER:
+				stackSize++;
+				break;
+			case BitType::OPERATOR:
+				stackSize--;
+				break;
+			default:
+				break;
+		}
+
+		maxStackSize = std::max(maxStackSize, stackSize);
+	}
+
+	m_evaluator = nullptr;
+
+	if(m_usedVars.size() > MAX_FIXED_VARS) return;
+
+	for(size_t i = 0, size = 2; i < 4; i++, size *= 2) {
+		if(maxStackSize <= size) {
+			m_evaluator = fixedEvaluators[m_usedVars.size()][i];
+			return;
+		}
+	}
+
+}
+
+void MathInterpreter::m_make_memo_sites() {
+
+/*
+	Creates a memoization cache for every call site in the RPN that is
+	expensive enough to be worth memoizing.
+*/
+
+	m_memoSites.clear();
+
+	for(size_t i = 0; i < m_rpn.size(); i++) {
+		if(!m_is_memoizable(m_rpn[i])) continue;
+
+		MemoSite site {std::vector<MemoEntry>(MEMO_SLOTS), m_memoEnabled,
+			0, 0, 0, 0, 0};
+
+		m_memoSites.push_back(std::move(site));
+		m_program[i].memoSite = m_memoSites.size();
+	}
+
+}
+
+double MathInterpreter::calculate() {
+
+/*
+	Calculates the expression given in reverse polish notation, and returns the 
+	result as double.
+*/
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	switch(m_instrumentation.count_call()) {
+		case Instrumentation::Timing::OPCODES:
+		{
+			m_instrumentation.count_evaluations(1);
+
+			double result = m_calculate_timed();
+			m_add_opcode_timings();
+
+			return result;
+		}
+		case Instrumentation::Timing::LATENCY:
+		{
+			uint64_t start = Instrumentation::cycles();
+			double result = m_calculate();
+			m_instrumentation.add_latency(Instrumentation::cycles() - start);
+
+			return result;
+		}
+		default:
+			break;
+	}
+#endif
+
+	return m_calculate();
+
+}
+
+double MathInterpreter::m_calculate() {
+
+/*
+	Calculates the expression through the result cache if there is one, and
+	checks the result in the shadow mode.
+*/
+
+	if(!m_resultCache) {
+		double result = m_evaluate();
+
+		if(m_shadow && m_evaluator) {
+			m_shadow_check(ShadowSampler::Tier::FIXED, result);
+		}
+
+		return result;
+	}
+
+	for(size_t i = 0; i < m_cacheKeyVars.size(); i++) {
+		m_cacheKey[i] = m_varTable[m_cacheKeyVars[i]].second;
+	}
+
+	double result;
+
+	MATH_PROBE2(cache_lookup_entry, m_exprHash, m_cacheKey.size());
+
+	bool isFound = m_resultCache->find(m_cacheKey, result);
+
+	MATH_PROBE2(cache_lookup_return, m_exprHash, isFound);
+
+	if(isFound) {
+		MathMetrics::count_result_cache(true);
+		MathMetrics::count_evaluations(MathMetrics::Engine::RESULT_CACHE, 1);
+
+		if(m_shadow) m_shadow_check(ShadowSampler::Tier::RESULT_CACHE, result);
+
+		return result;
+	}
+
+	MathMetrics::count_result_cache(false);
+
+	result = m_evaluate();
+	m_resultCache->insert(m_cacheKey, result);
+
+	if(m_shadow && m_evaluator) {
+		m_shadow_check(ShadowSampler::Tier::FIXED, result);
+	}
+
+	return result;
+
+}
+
+double MathInterpreter::calculate_reference() {
+
+/*
+	Calculates the expression with a plain RPN loop of its own, bypassing the
+	result cache, the fixed-size evaluators, the memoization caches and the
+	function pointers resolved for the instructions. Operators and functions
+	go through the switches of m_calc_operator() and m_calc_function(), so 
+	that a stale memoized result or a wrong pointer shows up as a divergence.
+	This is the reference the shadow mode compares the other engines with. 
+	Changes no state of the interpreter.
+*/
+
+	std::vector<double> stack;
+	stack.reserve(m_program.size());
+
+	for(const auto& instruction: m_program) {
+		switch(instruction.type) {
+			case BitType::NUMBER:
+				stack.push_back(instruction.value);
+				break;
+			case BitType::VARIABLE:
+				stack.push_back(m_varTable[instruction.varIndex].second);
+				break;
+			case BitType::OPERATOR:
+			{
+				double rVal = stack.back();
+				stack.pop_back();
+				double lVal = stack.back();
+
+				stack.back() = m_reproducible ? 
+					m_calc_reproducible_operator(lVal, rVal, instruction.op) :
+					m_calc_operator(lVal, rVal, instruction.op);
+			}
+				break;
+			case BitType::FUNCTION:
+				stack.back() = m_reproducible ? 
+					m_calc_reproducible_function(stack.back(), 
+						instruction.func) :
+					m_calc_function(stack.back(), instruction.func);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return stack.back();
+
+}
+
+double MathInterpreter::m_evaluate() {
+
+/*
+	Runs the evaluator picked by m_make_evaluator() for the shape of the 
+	expression, or the generic one for large expressions.
+*/
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	m_instrumentation.count_evaluations(1);
+#endif
+
+	MathMetrics::count_evaluations(m_evaluator ? MathMetrics::Engine::FIXED :
+		MathMetrics::Engine::PROGRAM, 1);
+
+	if(m_profiler && --m_profileCountdown == 0) {
+		m_profileCountdown = m_profiler->period();
+
+		double result = m_calculate_timed();
+		m_profiler->add_sample(m_instructionCycles);
+
+		return result;
+	}
+
+	if(m_evaluator) return (this->*m_evaluator)();
+
+	return m_calculate_program();
+
+}
+
+template<size_t NumVars, size_t StackSize>
+double MathInterpreter::m_calculate_fixed() {
+
+/*
+	Same as m_calculate_program(), for expressions with NumVars variables and
+	at most StackSize numbers on the stack. The stack and the variable values
+	are kept in fixed-size arrays, which the compiler can keep in registers 
+	instead of allocating and growing them.
+*/
+
+	std::array<double, NumVars == 0 ? 1 : NumVars> vars {};
+	std::array<double, StackSize> stack;
+	size_t stackSize = 0;
+
+	for(size_t i = 0; i < NumVars; i++) {
+		vars[i] = m_varTable[m_usedVars[i]].second;
+	}
+
+	for(const auto& instruction: m_program) {
+		switch(instruction.type) {
+			case BitType::NUMBER:
+				stack[stackSize++] = instruction.value;
+				break;
+			case BitType::VARIABLE:
+				stack[stackSize++] = vars[instruction.varSlot];
+				break;
+			case BitType::OPERATOR:
+			{
+				double rVal = stack[--stackSize];
+				double lVal = stack[stackSize - 1];
+
+				stack[stackSize - 1] = instruction.memoSite ?
+					m_apply_operator(instruction, lVal, rVal) :
+					instruction.operation(lVal, rVal);
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				double val = stack[stackSize - 1];
+
+				stack[stackSize - 1] = instruction.memoSite ?
+					m_apply_function(instruction, val) :
+					instruction.function(val);
+			}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return stack[0];
+
+}
+
+double MathInterpreter::m_calculate_program() {
+
+	for(const auto& instruction: m_program) {
+		switch(instruction.type) {
+			case BitType::NUMBER:
+				m_numberStack.push(instruction.value);
+				break;
+			case BitType::OPERATOR:
+			{
+				double rVal = m_numberStack.top();
+				m_numberStack.pop();
+				double lVal = m_numberStack.top();
+				m_numberStack.pop();
+
+				m_numberStack.push(m_apply_operator(instruction, lVal, rVal));
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				double val = m_numberStack.top();
+				m_numberStack.pop();
+
+				m_numberStack.push(m_apply_function(instruction, val));
+			}
+				break;
+			case BitType::VARIABLE:
+				m_numberStack.push(m_varTable[instruction.varIndex].second);
+				break;
+			default:
+				break;
+		}
+	}
+
+	double result = m_numberStack.top();
+	m_numberStack.pop();
+
+	return result;
+
+}
+
+double MathInterpreter::m_calculate_timed() {
+
+/*
+	Same as m_calculate_program(), timing each instruction into 
+	m_instructionCycles, for the instrumentation and the profiler.
+*/
+
+	for(size_t i = 0; i < m_program.size(); i++) {
+		const Instruction& instruction = m_program[i];
+		uint64_t start = Instrumentation::cycles();
+
+		switch(instruction.type) {
+			case BitType::NUMBER:
+				m_numberStack.push(instruction.value);
+				break;
+			case BitType::OPERATOR:
+			{
+				double rVal = m_numberStack.top();
+				m_numberStack.pop();
+				double lVal = m_numberStack.top();
+				m_numberStack.pop();
+
+				m_numberStack.push(m_apply_operator(instruction, lVal, rVal));
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				double val = m_numberStack.top();
+				m_numberStack.pop();
+
+				m_numberStack.push(m_apply_function(instruction, val));
+			}
+				break;
+			case BitType::VARIABLE:
+				m_numberStack.push(m_varTable[instruction.varIndex].second);
+				break;
+			default:
+				break;
+		}
+
+		m_instructionCycles[i] = Instrumentation::cycles() - start;
+	}
+
+	double result = m_numberStack.top();
+	m_numberStack.pop();
+
+	return result;
+
+}
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+void MathInterpreter::m_add_opcode_timings() {
+
+/*
+	Adds the cycles of the last m_calculate_timed() to the instrumentation,
+	per opcode and function.
+*/
+
+	for(size_t i = 0; i < m_program.size(); i++) {
+		const Instruction& instruction = m_program[i];
+
+		if(instruction.type == BitType::FUNCTION) {
+			m_instrumentation.add_function_timing((size_t)instruction.func, 
+				m_instructionCycles[i]);
+		}
+		else {
+			m_instrumentation.add_opcode_timing(m_opcode_of(instruction), 
+				m_instructionCycles[i]);
+		}
+	}
+
+}
+#endif
+
+size_t MathInterpreter::m_opcode_of(
+	const Instruction& instruction) const noexcept {
+
+/*
+	Index of the instruction in Instrumentation::OPCODE_NAMES.
+*/
+
+	switch(instruction.type) {
+		case BitType::NUMBER:
+			return 0;
+		case BitType::VARIABLE:
+			return 1;
+		default:
+			break;
+	}
+
+	const std::string operators = "+-*/%^";
+	size_t pos = operators.find(instruction.op);
+
+	return pos == std::string::npos ? 0 : pos + 2;
+
+}
+
+std::string MathInterpreter::m_function_name(const FUNCTION& func) {
+
+	switch(func) {
+		case FUNCTION::LOG: return "log";
+		case FUNCTION::LOG10: return "log10";
+		case FUNCTION::SIN: return "sin";
+		case FUNCTION::COS: return "cos";
+		case FUNCTION::TAN: return "tan";
+		case FUNCTION::COT: return "cot";
+		case FUNCTION::ASIN: return "asin";
+		case FUNCTION::ACOS: return "acos";
+		case FUNCTION::ATAN: return "atan";
+		case FUNCTION::ATAN2: return "atan2";
+		case FUNCTION::ACOT: return "acot";
+		case FUNCTION::DEG: return "deg";
+		case FUNCTION::RAD: return "rad";
+		case FUNCTION::SQRT: return "sqrt";
+		case FUNCTION::EXP: return "exp";
+		case FUNCTION::ABS: return "abs";
+		default: return "none";
+	}
+
+}
+
+const char* MathInterpreter::m_bit_type_name(const BitType& type) noexcept {
+
+	switch(type) {
+		case BitType::OPERATOR: return "operator";
+		case BitType::NUMBER: return "number";
+		case BitType::VARIABLE: return "variable";
+		case BitType::FUNCTION: return "function";
+		case BitType::LPARENTHESIS: return "lparenthesis";
+		case BitType::RPARENTHESIS: return "rparenthesis";
+		default: return "none";
+	}
+
+}
+
+size_t MathInterpreter::m_estimated_cycles(
+	const Instruction& instruction) noexcept {
+
+/*
+	Typical cost of the instruction in CPU cycles on x86-64, with the 
+	standard library functions, for the estimate of explain(). The 
+	reproducible functions cost about twice as much.
+*/
+
+	switch(instruction.type) {
+		case BitType::NUMBER:
+		case BitType::VARIABLE:
+			return 1;
+		case BitType::OPERATOR:
+			switch(instruction.op) {
+				case '+': case '-': case '*': return 4;
+				case '/': return 14;
+				case '%': return 20;
+				case '^': return 80;
+				default: return 4;
+			}
+		case BitType::FUNCTION:
+			switch(instruction.func) {
+				case FUNCTION::ABS: case FUNCTION::DEG: case FUNCTION::RAD:
+					return 4;
+				case FUNCTION::SQRT: return 18;
+				case FUNCTION::EXP: case FUNCTION::LOG: case FUNCTION::LOG10:
+					return 40;
+				case FUNCTION::SIN: case FUNCTION::COS: return 50;
+				case FUNCTION::TAN: case FUNCTION::COT: return 70;
+				default: return 70; // inverse trigonometric functions
+			}
+		default:
+			return 0;
+	}
+
+}
+
+std::vector<MathInterpreter::ExplainNode> MathInterpreter::m_explain_nodes(
+	const std::vector<InputBit>& rpn, bool isOptimized) const {
+
+/*
+	Builds the expression tree of the RPN, the root last, with the span of 
+	the subexpression of each node. In the optimized
+	RPN, numbers that are not tokens of the input expression are folded 
+	constants, and numbers that were variable tokens were bound by 
+	specialize().
+*/
+
+	std::vector<ExplainNode> nodes;
+	std::vector<size_t> stack;
+
+	for(size_t i = 0; i < rpn.size(); i++) {
+		const InputBit& bit = rpn[i];
+		ExplainNode node {bit.text, bit.type, bit.span, std::string(), {}};
+
+		switch(bit.type) {
+			case BitType::NUMBER:
+			{
+				if(!isOptimized) break;
+
+				node.note = "folded";
+
+				for(const auto& inputBit: m_inputBits) {
+					if(inputBit.span.begin != bit.span.begin || 
+						inputBit.span.end != bit.span.end) continue;
+
+					node.note = inputBit.type == BitType::VARIABLE ? 
+						"bound" : "";
+					break;
+				}
+			}
+				break;
+			case BitType::VARIABLE:
+				node.label = "$" + m_varTable[std::stoi(bit.text)].first + "$";
+				break;
+			case BitType::OPERATOR:
+				node.operands.push_back(stack[stack.size() - 2]);
+				node.operands.push_back(stack.back());
+				stack.resize(stack.size() - 2);
+
+				node.span = m_subexpression_span(bit.span, 
+					nodes[node.operands[0]].span, nodes[node.operands[1]].span);
+				break;
+			case BitType::FUNCTION:
+				node.label = m_function_name((FUNCTION)std::stoi(bit.text));
+				node.operands.push_back(stack.back());
+				stack.pop_back();
+
+				node.span = m_subexpression_span(bit.span, 
+					nodes[node.operands[0]].span, nodes[node.operands[0]].span);
+				break;
+			default:
+				break;
+		}
+
+		if(isOptimized && i < m_program.size() && m_program[i].memoSite) {
+			node.note = "memoized";
+		}
+
+		stack.push_back(nodes.size());
+		nodes.push_back(node);
+	}
+
+	return nodes;
+
+}
+
+void MathInterpreter::m_explain_node_text(std::ostream& os,
+	const std::vector<ExplainNode>& nodes, size_t index, size_t depth) const {
+
+	const ExplainNode& node = nodes[index];
+	std::string indent(2 * depth, ' ');
+
+	os << std::left << std::setw(24) << indent + node.label << std::right;
+
+	if(node.span.end <= m_inputExpr.size() && node.span.begin < node.span.end) {
+		os << "  " << m_inputExpr.substr(node.span.begin, 
+			node.span.end - node.span.begin);
+	}
+
+	if(!node.note.empty()) os << "  [" << node.note << "]";
+
+	os << '\n';
+
+	for(const auto& operand: node.operands) {
+		m_explain_node_text(os, nodes, operand, depth + 1);
+	}
+
+}
+
+void MathInterpreter::m_explain_node_json(std::ostream& os,
+	const std::vector<ExplainNode>& nodes, size_t index) const {
+
+	const ExplainNode& node = nodes[index];
+
+	os << "{\"label\": " << m_json_string(node.label) << ", \"type\": \"" << 
+		m_bit_type_name(node.type) << "\"";
+
+	if(node.type == BitType::NUMBER) {
+		os << ", \"value\": " << 
+			m_json_number(m_string_to_number(node.label));
+	}
+
+	os << ", \"begin\": " << node.span.begin << ", \"end\": " << 
+		node.span.end;
+
+	if(!node.note.empty()) os << ", \"note\": \"" << node.note << "\"";
+
+	if(!node.operands.empty()) {
+		os << ", \"operands\": [";
+
+		for(size_t i = 0; i < node.operands.size(); i++) {
+			if(i) os << ", ";
+			m_explain_node_json(os, nodes, node.operands[i]);
+		}
+
+		os << "]";
+	}
+
+	os << "}";
+
+}
+
+std::string MathInterpreter::m_json_number(const double& val) const {
+
+/*
+	JSON has no infinities and NaNs, which are given as strings instead.
+*/
+
+	if(std::isnan(val)) return "\"nan\"";
+	if(std::isinf(val)) return val > 0 ? "\"inf\"" : "\"-inf\"";
+
+	return m_number_to_string(val);
+
+}
+
+std::string MathInterpreter::m_json_string(const std::string& str) {
+
+	std::ostringstream oss;
+	oss << '"';
+
+	for(const auto& c: str) {
+		switch(c) {
+			case '"': oss << "\\\""; break;
+			case '\\': oss << "\\\\"; break;
+			case '\n': oss << "\\n"; break;
+			case '\r': oss << "\\r"; break;
+			case '\t': oss << "\\t"; break;
+			default:
+				if((unsigned char)c < 0x20) {
+					oss << "\\u" << std::hex << std::setw(4) << 
+						std::setfill('0') << (int)c << std::dec << 
+						std::setfill(' ');
+				}
+				else {
+					oss << c;
+				}
+				break;
+		}
+	}
+
+	oss << '"';
+
+	return oss.str();
+
+}
+
+double MathInterpreter::m_apply_operator(const Instruction& instruction,
+	const double& lVal, const double& rVal) {
+
+/*
+	Calculates the operator of the instruction, through the memoization cache
+	of the call site if it has one.
+*/
+
+	if(!instruction.memoSite) return instruction.operation(lVal, rVal);
+
+	double result;
+	MemoSite& site = m_memoSites[instruction.memoSite - 1];
+
+	if(!m_memo_lookup(site, lVal, rVal, result)) {
+		result = instruction.operation(lVal, rVal);
+		m_memo_store(site, lVal, rVal, result);
+	}
+
+	return result;
+
+}
+
+double MathInterpreter::m_apply_function(const Instruction& instruction,
+	const double& val) {
+
+/*
+	Calculates the function of the instruction, through the memoization cache
+	of the call site if it has one.
+*/
+
+	if(!instruction.memoSite) return instruction.function(val);
+
+	double result;
+	MemoSite& site = m_memoSites[instruction.memoSite - 1];
+
+	if(!m_memo_lookup(site, val, 0.0, result)) {
+		result = instruction.function(val);
+		m_memo_store(site, val, 0.0, result);
+	}
+
+	return result;
+
+}
+
+std::vector<double> MathInterpreter::calculate_batch(
+	const std::vector<BatchColumn>& columns) {
+
+/*
+	Calculates the expression for each row of the given variable columns, and
+	returns the results in row order. Variables that are not given a column
+	keep the value set with set_value(). Throws if a column belongs to an 
+	unknown variable or if the columns have different lengths.
+*/
+
+	std::vector<const double*> varColumns;
+	size_t numRows = m_map_columns(columns, varColumns);
+
+	std::vector<double> results(numRows);
+	m_calculate_rows<double>(varColumns, numRows, results.data());
+
+	return results;
+
+}
+
+std::vector<float> MathInterpreter::calculate_batch_float(
+	const std::vector<FloatBatchColumn>& columns, FloatPrecision precision) {
+
+/*
+	Same as calculate_batch(), for columns of floats. With 
+	FloatPrecision::SINGLE, the expression is calculated in single precision.
+	With FloatPrecision::MIXED, the values are converted to double, the
+	expression is calculated in double precision, and only the results are
+	rounded to float.
+*/
+
+	std::vector<const float*> varColumns;
+	size_t numRows = m_map_columns(columns, varColumns);
+
+	std::vector<float> results(numRows);
+
+	if(precision == FloatPrecision::MIXED) {
+		m_calculate_rows<double>(varColumns, numRows, results.data());
+	}
+	else {
+		m_calculate_rows<float>(varColumns, numRows, results.data());
+	}
+
+	return results;
+
+}
+
+void MathInterpreter::calculate_batch(const double* const* columns, 
+	size_t numRows, double* results) {
+
+/*
+	Same as calculate_batch(), for columns of numRows values given in the 
+	order of variable_names(), without copying them. The results are written
+	to numRows values. A nullptr column keeps the value set with 
+	set_value().
+*/
+
+	std::vector<const double*> varColumns;
+	m_map_column_pointers(columns, varColumns);
+
+	m_calculate_rows<double>(varColumns, numRows, results);
+
+}
+
+void MathInterpreter::calculate_batch_float(const float* const* columns, 
+	size_t numRows, float* results, FloatPrecision precision) {
+
+/*
+	Same as calculate_batch() with column pointers, for columns of floats.
+*/
+
+	std::vector<const float*> varColumns;
+	m_map_column_pointers(columns, varColumns);
+
+	if(precision == FloatPrecision::MIXED) {
+		m_calculate_rows<double>(varColumns, numRows, results);
+	}
+	else {
+		m_calculate_rows<float>(varColumns, numRows, results);
+	}
+
+}
+
+template<typename Elem>
+void MathInterpreter::m_map_column_pointers(const Elem* const* columns,
+	std::vector<const Elem*>& varColumns) const {
+
+/*
+	Same as m_map_columns(), for columns in the order of variable_names().
+*/
+
+	varColumns.assign(m_varTable.size(), nullptr);
+
+	for(size_t i = 0; i < m_usedVars.size(); i++) {
+		varColumns[m_usedVars[i]] = columns[i];
+	}
+
+}
+
+template<typename Elem>
+size_t MathInterpreter::m_map_columns(
+	const std::vector<std::pair<std::string, std::vector<Elem>>>& columns,
+	std::vector<const Elem*>& varColumns) const {
+
+/*
+	Fills varColumns with the column of each entry of the variable table, or
+	nullptr for the variables without a column. Returns the number of rows.
+*/
+
+	varColumns.assign(m_varTable.size(), nullptr);
+	size_t numRows = columns.empty() ? 1 : columns.front().second.size();
+
+	for(const auto& column: columns) {
+		int varIndex = m_isVariable(column.first) - 1;
+
+		if(varIndex < 0) throw UNKNOWN_VARIABLE(column.first);
+		if(column.second.size() != numRows) throw BATCH_SIZE_MISMATCH();
+
+		varColumns[varIndex] = column.second.data();
+	}
+
+	return numRows;
+
+}
+
+template<typename Real, typename Elem>
+void MathInterpreter::m_calculate_rows(
+	const std::vector<const Elem*>& varColumns, size_t numRows, 
+	Elem* results) {
+
+/*
+	Real:       The type the expression is calculated in.
+	Elem:       The type of the values in the columns and the results.
+	varColumns: Column of values per entry of the variable table, or nullptr
+	            for the variables that keep their current value.
+
+	Picks the evaluation strategy for the given columns and calculates all 
+	rows.
+*/
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	uint64_t start = Instrumentation::cycles();
+#endif
+
+	bool isDistinct = m_prefer_distinct(varColumns, numRows);
+
+	if(isDistinct) {
+		m_calculate_distinct<Real>(varColumns, numRows, results);
+	}
+	else {
+		std::vector<std::vector<Real>> batchStack;
+
+		for(size_t row = 0; row < numRows; row += BATCH_CHUNK) {
+			size_t chunkRows = std::min(numRows - row, BATCH_CHUNK);
+			m_calculate_chunk(varColumns, row, chunkRows, results + row, 
+				batchStack);
+		}
+	}
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	m_instrumentation.count_batch(numRows, Instrumentation::cycles() - start);
+#endif
+
+	ShadowSampler::Tier tier = ShadowSampler::Tier::BATCH;
+	MathMetrics::Engine engine = MathMetrics::Engine::BATCH;
+
+	if(std::is_same<Real, float>::value) {
+		tier = ShadowSampler::Tier::FLOAT_SINGLE;
+		engine = MathMetrics::Engine::FLOAT_SINGLE;
+	}
+	else if(std::is_same<Elem, float>::value) {
+		tier = ShadowSampler::Tier::FLOAT_MIXED;
+		engine = MathMetrics::Engine::FLOAT_MIXED;
+	}
+	else if(isDistinct) {
+		tier = ShadowSampler::Tier::DISTINCT;
+		engine = MathMetrics::Engine::DISTINCT;
+	}
+
+	MathMetrics::count_evaluations(engine, numRows);
+
+	if(!m_shadow) return;
+
+	m_shadow_rows(tier, varColumns, numRows, results);
+
+}
+
+template<typename Elem>
+void MathInterpreter::m_shadow_rows(ShadowSampler::Tier tier, 
+	const std::vector<const Elem*>& varColumns, size_t numRows,
+	const Elem* results) {
+
+/*
+	Calculates the sampled rows of a batch again with the reference 
+	interpreter, and compares the results. The values set with set_value() 
+	are restored afterwards.
+*/
+
+	std::vector<size_t> rows = m_shadow->sample_rows(tier, numRows);
+	if(rows.empty()) return;
+
+	std::vector<double> savedValues;
+	for(const auto& var: m_varTable) savedValues.push_back(var.second);
+
+	for(const auto& row: rows) {
+		for(size_t i = 0; i < m_varTable.size(); i++) {
+			if(varColumns[i]) m_varTable[i].second = varColumns[i][row];
+		}
+
+		m_shadow->check(tier, calculate_reference(), results[row], 
+			m_inputExpr, m_shadow_inputs());
+	}
+
+	for(size_t i = 0; i < m_varTable.size(); i++) {
+		m_varTable[i].second = savedValues[i];
+	}
+
+}
+
+void MathInterpreter::m_shadow_check(ShadowSampler::Tier tier, 
+	const double& result) {
+
+/*
+	Compares the result of calculate() with the reference interpreter, if 
+	the call is sampled.
+*/
+
+	if(!m_shadow->sample(tier)) return;
+
+	m_shadow->check(tier, calculate_reference(), result, m_inputExpr, 
+		m_shadow_inputs());
+
+}
+
+ShadowSampler::Inputs MathInterpreter::m_shadow_inputs() const {
+
+	ShadowSampler::Inputs inputs;
+
+	for(const auto& varIndex: m_usedVars) {
+		inputs.push_back(m_varTable[varIndex]);
+	}
+
+	return inputs;
+
+}
+
+template<>
+const MathInterpreter::BatchKernels<double>& 
+MathInterpreter::m_batch_kernels<double>(
+	const Instruction& instruction) noexcept {
+
+	return instruction.batch;
+
+}
+
+template<>
+const MathInterpreter::BatchKernels<float>& 
+MathInterpreter::m_batch_kernels<float>(
+	const Instruction& instruction) noexcept {
+
+	return instruction.batchFloat;
+
+}
+
+template<typename Real, typename Elem>
+void MathInterpreter::m_calculate_chunk(
+	const std::vector<const Elem*>& varColumns, size_t rowBegin, 
+	size_t numRows, Elem* results, std::vector<std::vector<Real>>& batchStack) {
+
+/*
+	Calculates up to BATCH_CHUNK rows at once. Works just like calculate(), but
+	every entry of the stack is a whole column of values instead of a single
+	value, so that each instruction is dispatched once per chunk instead of
+	once per row.
+
+	batchStack: Storage for the stack, kept between the chunks.
+*/
+
+	MATH_PROBE3(batch_chunk_entry, m_exprHash, rowBegin, numRows);
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	m_instrumentation.count_evaluations(numRows);
+#endif
+
+	size_t stackSize = 0;
+
+	for(const auto& instruction: m_program) {
+		switch(instruction.type) {
+			case BitType::NUMBER:
+			case BitType::VARIABLE:
+			{
+				if(batchStack.size() == stackSize) {
+					batchStack.emplace_back(BATCH_CHUNK);
+				}
+
+				Real* vals = batchStack[stackSize++].data();
+
+				if(instruction.type == BitType::NUMBER) {
+					std::fill(vals, vals + numRows, (Real)instruction.value);
+					break;
+				}
+
+				const Elem* column = varColumns[instruction.varIndex];
+
+				if(column) {
+					std::copy(column + rowBegin, column + rowBegin + numRows, 
+						vals);
+				}
+				else {
+					std::fill(vals, vals + numRows, 
+						(Real)m_varTable[instruction.varIndex].second);
+				}
+			}
+				break;
+			case BitType::OPERATOR:
+			{
+				const Real* rVals = batchStack[--stackSize].data();
+				Real* lVals = batchStack[stackSize - 1].data();
+
+				m_batch_kernels<Real>(instruction).operation(lVals, rVals, 
+					numRows);
+			}
+				break;
+			case BitType::FUNCTION:
+			{
+				Real* vals = batchStack[stackSize - 1].data();
+
+				m_batch_kernels<Real>(instruction).function(vals, numRows);
+			}
+				break;
+			default:
+				break;
+		}
+	}
+
+	const Real* vals = batchStack[0].data();
+	std::copy(vals, vals + numRows, results);
+
+	MATH_PROBE3(batch_chunk_return, m_exprHash, rowBegin, numRows);
+
+}
+
+template<typename Elem>
+bool MathInterpreter::m_prefer_distinct(
+	const std::vector<const Elem*>& varColumns, size_t numRows) const {
+
+/*
+	Estimates the number of distinct rows from a sample of the columns, and 
+	decides whether calculating once per distinct row pays off. Hashing the
+	rows is not free, so this is only done when the distinct rows are a small
+	fraction of all rows.
+*/
+
+	if(numRows < DISTINCT_MIN_ROWS) return false;
+
+	std::vector<const Elem*> usedColumns;
+
+	for(const auto& column: varColumns) {
+		if(column) usedColumns.push_back(column);
+	}
+
+	if(usedColumns.empty()) return false;
+
+	size_t stride = numRows / DISTINCT_SAMPLE;
+	std::unordered_set<std::string> sampledRows;
+	std::string rowKey(usedColumns.size() * sizeof(Elem), '\0');
+
+	for(size_t i = 0; i < DISTINCT_SAMPLE; i++) {
+		for(size_t j = 0; j < usedColumns.size(); j++) {
+			std::memcpy(&rowKey[j * sizeof(Elem)], usedColumns[j] + i*stride,
+				sizeof(Elem));
+		}
+
+		sampledRows.insert(rowKey);
+	}
+
+	return sampledRows.size() * 100 <= DISTINCT_SAMPLE * DISTINCT_MAX_PERCENT;
+
+}
+
+template<typename Real, typename Elem>
+void MathInterpreter::m_calculate_distinct(
+	const std::vector<const Elem*>& varColumns, size_t numRows, 
+	Elem* results) {
+
+/*
+	Dictionary-encodes the rows of the given columns, calculates the expression
+	once per distinct row, and scatters the results back to all rows by their
+	codes.
+*/
+
+	std::vector<size_t> usedVars;
+
+	for(size_t i = 0; i < varColumns.size(); i++) {
+		if(varColumns[i]) usedVars.push_back(i);
+	}
+
+	std::unordered_map<std::string, size_t> rowCodes;
+	std::vector<size_t> codes(numRows);
+	std::vector<std::vector<Elem>> distinctColumns(usedVars.size());
+	std::string rowKey(usedVars.size() * sizeof(Elem), '\0');
+
+	for(size_t row = 0; row < numRows; row++) {
+		for(size_t j = 0; j < usedVars.size(); j++) {
+			std::memcpy(&rowKey[j * sizeof(Elem)], 
+				varColumns[usedVars[j]] + row, sizeof(Elem));
+		}
 
-				double operatorCalcResult = m_calc_operator(lVal, rVal, opName);
-				m_numberStack.push(operatorCalcResult);
-			}
-				break;
-			case BitType::FUNCTION:
-			{
-				FUNCTION func = (FUNCTION)std::stoi(bit.first);
+		auto found = rowCodes.find(rowKey);
 
-				double val = m_numberStack.top();
-				m_numberStack.pop();
+		if(found == rowCodes.end()) {
+			found = rowCodes.emplace(rowKey, rowCodes.size()).first;
 
-				double functionCalcResult = m_calc_function(val, func);
-				m_numberStack.push(functionCalcResult);
-			}
-				break;
-			case BitType::VARIABLE:
-			{
-				int varIndex = std::stoi(bit.first);
-				m_numberStack.push(m_varTable[varIndex].second);
+			for(size_t j = 0; j < usedVars.size(); j++) {
+				distinctColumns[j].push_back(varColumns[usedVars[j]][row]);
 			}
-				break;
-			default:
-				break;
 		}
+
+		codes[row] = found->second;
+	}
+
+	std::vector<const Elem*> distinctVarColumns(varColumns.size(), nullptr);
+
+	for(size_t j = 0; j < usedVars.size(); j++) {
+		distinctVarColumns[usedVars[j]] = distinctColumns[j].data();
+	}
+
+	size_t numDistinct = rowCodes.size();
+	std::vector<Elem> distinctResults(numDistinct);
+	std::vector<std::vector<Real>> batchStack;
+
+	for(size_t row = 0; row < numDistinct; row += BATCH_CHUNK) {
+		size_t chunkRows = std::min(numDistinct - row, BATCH_CHUNK);
+		m_calculate_chunk(distinctVarColumns, row, chunkRows, 
+			distinctResults.data() + row, batchStack);
 	}
 
-	return m_numberStack.top();
+	for(size_t row = 0; row < numRows; row++) {
+		results[row] = distinctResults[codes[row]];
+	}
 
 }
 
@@ -358,7 +2606,7 @@ size_t MathInterpreter::m_isVariable(const std::string& token) const noexcept {
 
 int MathInterpreter::m_precedence(const InputBit& operatorBit) const noexcept {
 
-	std::string op = operatorBit.first;
+	std::string op = operatorBit.text;
 
 	if(op == "+" || op == "-") return 2;
 	if(op == "*" || op == "/" || op == "%") return 3;
@@ -368,10 +2616,11 @@ int MathInterpreter::m_precedence(const InputBit& operatorBit) const noexcept {
 
 }
 
-double MathInterpreter::m_calc_operator(const double& lVal, const double& rVal,
-	const std::string& operatorName) const noexcept {
+template<typename Real>
+Real MathInterpreter::m_calc_operator(const Real& lVal, const Real& rVal,
+	const char& op) noexcept {
 
-	switch(operatorName[0]) {
+	switch(op) {
 		case '+':
 			return lVal + rVal;
 		case '-':
@@ -390,8 +2639,9 @@ double MathInterpreter::m_calc_operator(const double& lVal, const double& rVal,
 
 }
 
-double MathInterpreter::m_calc_function(const double& val, 
-	const FUNCTION& func) const noexcept {
+template<typename Real>
+Real MathInterpreter::m_calc_function(const Real& val, 
+	const FUNCTION& func) noexcept {
 
 	switch(func) {
 		case FUNCTION::NONE:
@@ -418,9 +2668,9 @@ double MathInterpreter::m_calc_function(const double& val,
 		case FUNCTION::ACOT:
 			return std::atan(1/val);
 		case FUNCTION::DEG:
-			return (val/(2*M_PI))*360;
+			return (val/(2*(Real)M_PI))*360;
 		case FUNCTION::RAD:
-			return (val/360)*2*M_PI;
+			return (val/360)*2*(Real)M_PI;
 		case FUNCTION::SQRT:
 			return std::sqrt(val);
 		case FUNCTION::EXP:
@@ -433,18 +2683,516 @@ double MathInterpreter::m_calc_function(const double& val,
 
 }
 
-std::string MathInterpreter::m_clear_whitespaces(const std::string& str) const {
+template<typename Real>
+Real MathInterpreter::m_calc_reproducible_operator(const Real& lVal, 
+	const Real& rVal, const char& op) noexcept {
+
+/*
+	m_calc_operator() of the reproducible mode. Only ^ differs, the rest are
+	exact in IEEE 754.
+*/
+
+	if(op == '^') return (Real)ReproducibleMath::pow(lVal, rVal);
+
+	return m_calc_operator(lVal, rVal, op);
+
+}
+
+template<typename Real>
+Real MathInterpreter::m_calc_reproducible_function(const Real& val, 
+	const FUNCTION& func) noexcept {
+
+/*
+	m_calc_function() of the reproducible mode. Floats are calculated in 
+	double and rounded, which is reproducible as well.
+*/
+
+	switch(func) {
+		case FUNCTION::LOG:
+			return (Real)ReproducibleMath::log(val);
+		case FUNCTION::LOG10:
+			return (Real)ReproducibleMath::log10(val);
+		case FUNCTION::SIN:
+			return (Real)ReproducibleMath::sin(val);
+		case FUNCTION::COS:
+			return (Real)ReproducibleMath::cos(val);
+		case FUNCTION::TAN:
+			return (Real)ReproducibleMath::tan(val);
+		case FUNCTION::COT:
+			return 1/(Real)ReproducibleMath::tan(val);
+		case FUNCTION::ASIN:
+			return (Real)ReproducibleMath::asin(val);
+		case FUNCTION::ACOS:
+			return (Real)ReproducibleMath::acos(val);
+		case FUNCTION::ATAN:
+			return (Real)ReproducibleMath::atan(val);
+		case FUNCTION::ACOT:
+			return (Real)ReproducibleMath::atan(1/val);
+		case FUNCTION::EXP:
+			return (Real)ReproducibleMath::exp(val);
+		default:
+			return m_calc_function(val, func);
+	}
+
+}
+
+template<typename Real, char Op, bool Reproducible>
+Real MathInterpreter::m_operator(Real lVal, Real rVal) noexcept {
+
+/*
+	m_calc_operator() for a fixed operator. The switch is resolved at compile
+	time, so that each operator gets its own function to point to.
+*/
+
+	if(Reproducible) return m_calc_reproducible_operator(lVal, rVal, Op);
+
+	return m_calc_operator(lVal, rVal, Op);
+
+}
+
+template<typename Real, MathInterpreter::FUNCTION Func, bool Reproducible>
+Real MathInterpreter::m_function(Real val) noexcept {
+
+	if(Reproducible) return m_calc_reproducible_function(val, Func);
+
+	return m_calc_function(val, Func);
+
+}
+
+template<typename Real, char Op, bool Reproducible>
+void MathInterpreter::m_operator_kernel(Real* lVals, const Real* rVals, 
+	size_t numVals) noexcept {
+
+/*
+	Applies the operator element-wise, saving the results in lVals. With the
+	operator fixed at compile time, the loop has no branches, and the compiler
+	can vectorize it.
+*/
+
+	for(size_t i = 0; i < numVals; i++) {
+		lVals[i] = m_operator<Real, Op, Reproducible>(lVals[i], rVals[i]);
+	}
+
+}
+
+template<typename Real, MathInterpreter::FUNCTION Func, bool Reproducible>
+void MathInterpreter::m_function_kernel(Real* vals, size_t numVals) noexcept {
+
+/*
+	Applies the function element-wise, in place.
+*/
+
+	for(size_t i = 0; i < numVals; i++) {
+		vals[i] = m_function<Real, Func, Reproducible>(vals[i]);
+	}
+
+}
+
+void MathInterpreter::m_resolve(Instruction& instruction, 
+	const InputBit& bit) const {
+
+/*
+	Resolves the RPN bit to an instruction, with the operators and functions 
+	of the current mode.
+*/
+
+	instruction = Instruction {bit.type, 0.0, 0, 0, 0, '\0', 
+		FUNCTION::NONE, nullptr, nullptr, {nullptr, nullptr}, 
+		{nullptr, nullptr}, bit.span};
+
+	switch(bit.type) {
+		case BitType::NUMBER:
+			instruction.value = m_string_to_number(bit.text);
+			break;
+		case BitType::VARIABLE:
+			instruction.varIndex = std::stoi(bit.text);
+			break;
+		case BitType::OPERATOR:
+			instruction.op = bit.text[0];
+
+			if(m_reproducible) m_resolve_operator<true>(instruction, bit.text[0]);
+			else m_resolve_operator<false>(instruction, bit.text[0]);
+			break;
+		case BitType::FUNCTION:
+		{
+			FUNCTION func = (FUNCTION)std::stoi(bit.text);
+			instruction.func = func;
+
+			if(m_reproducible) m_resolve_function<true>(instruction, func);
+			else m_resolve_function<false>(instruction, func);
+		}
+			break;
+		default:
+			break;
+	}
+
+}
+
+template<bool Reproducible>
+void MathInterpreter::m_resolve_operator(Instruction& instruction,
+	const char& op) noexcept {
+
+/*
+	Points the instruction to the scalar function and the batch kernels of the
+	operator.
+*/
+
+	#define RESOLVE_OPERATOR(opChar) \
+		case opChar: \
+			instruction.operation = \
+				&m_operator<double, opChar, Reproducible>; \
+			instruction.batch.operation = \
+				&m_operator_kernel<double, opChar, Reproducible>; \
+			instruction.batchFloat.operation = \
+				&m_operator_kernel<float, opChar, Reproducible>; \
+			break;
+
+	switch(op) {
+		RESOLVE_OPERATOR('+')
+		RESOLVE_OPERATOR('-')
+		RESOLVE_OPERATOR('*')
+		RESOLVE_OPERATOR('/')
+		RESOLVE_OPERATOR('%')
+		RESOLVE_OPERATOR('^')
+		default:
+			RESOLVE_OPERATOR('\0')
+	}
+
+	#undef RESOLVE_OPERATOR
+
+}
+
+template<bool Reproducible>
+void MathInterpreter::m_resolve_function(Instruction& instruction,
+	const FUNCTION& func) noexcept {
+
+/*
+	Points the instruction to the scalar function and the batch kernels of the
+	function.
+*/
+
+	#define RESOLVE_FUNCTION(funcName) \
+		case FUNCTION::funcName: \
+			instruction.function = \
+				&m_function<double, FUNCTION::funcName, Reproducible>; \
+			instruction.batch.function = \
+				&m_function_kernel<double, FUNCTION::funcName, Reproducible>; \
+			instruction.batchFloat.function = \
+				&m_function_kernel<float, FUNCTION::funcName, Reproducible>; \
+			break;
+
+	switch(func) {
+		RESOLVE_FUNCTION(LOG)
+		RESOLVE_FUNCTION(LOG10)
+		RESOLVE_FUNCTION(SIN)
+		RESOLVE_FUNCTION(COS)
+		RESOLVE_FUNCTION(TAN)
+		RESOLVE_FUNCTION(COT)
+		RESOLVE_FUNCTION(ASIN)
+		RESOLVE_FUNCTION(ACOS)
+		RESOLVE_FUNCTION(ATAN)
+		RESOLVE_FUNCTION(ACOT)
+		RESOLVE_FUNCTION(DEG)
+		RESOLVE_FUNCTION(RAD)
+		RESOLVE_FUNCTION(SQRT)
+		RESOLVE_FUNCTION(EXP)
+		RESOLVE_FUNCTION(ABS)
+		default:
+			RESOLVE_FUNCTION(NONE)
+	}
+
+	#undef RESOLVE_FUNCTION
+
+}
+
+bool MathInterpreter::m_is_deterministic() const noexcept {
+
+/*
+	Checks if calculating the expression always gives the same result for the
+	same variable values, i.e. if its results can be cached. A function that
+	keeps state or depends on anything but its argument must return false 
+	here. All functions under enum FUNCTION are currently deterministic.
+*/
+
+	for(const auto& bit: m_rpn) {
+		if(bit.type != BitType::FUNCTION) continue;
+
+		switch((FUNCTION)std::stoi(bit.text)) {
+			case FUNCTION::NONE:
+				return false;
+			default:
+				break;
+		}
+	}
+
+	return true;
+
+}
+
+bool MathInterpreter::m_is_memoizable(const InputBit& bit) const noexcept {
+
+/*
+	Checks if the RPN bit is expensive enough to be memoized. Cheap operators
+	and functions are faster to recompute than to look up.
+
+	Must be called after m_validate_rpn(), i.e. when the function names in the
+	RPN have been replaced with their FUNCTION values.
+*/
+
+	if(bit.type == BitType::OPERATOR) return bit.text == "^";
+	if(bit.type != BitType::FUNCTION) return false;
+
+	switch((FUNCTION)std::stoi(bit.text)) {
+		case FUNCTION::LOG:
+		case FUNCTION::LOG10:
+		case FUNCTION::SIN:
+		case FUNCTION::COS:
+		case FUNCTION::TAN:
+		case FUNCTION::COT:
+		case FUNCTION::ASIN:
+		case FUNCTION::ACOS:
+		case FUNCTION::ATAN:
+		case FUNCTION::ACOT:
+		case FUNCTION::EXP:
+			return true;
+		default:
+			return false;
+	}
+
+}
+
+size_t MathInterpreter::m_memo_slot(const uint64_t& lKey, 
+	const uint64_t& rKey) const noexcept {
+
+	// Fibonacci hashing. The top bits of the product depend on all bits of
+	// the key, which matters because doubles often have all-zero low bits
+	uint64_t hash = (lKey ^ (rKey * 0x9E3779B97F4A7C15ULL)) * 
+		0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(hash >> (64 - MEMO_SLOT_BITS));
+
+}
+
+bool MathInterpreter::m_memo_lookup(MemoSite& site, const double& lVal,
+	const double& rVal, double& result) const noexcept {
+
+/*
+	Looks up the result for the given arguments in the cache of the call site.
+	Returns true and sets result on a hit.
+
+	The hit rate of each site is measured over windows of MEMO_WINDOW lookups.
+	A site whose hit rate falls below MEMO_MIN_HIT_PERCENT stops memoizing, and
+	probes again after MEMO_COOLDOWN calls in case the input has changed.
+*/
+
+	if(!site.enabled) {
+		if(!m_memoEnabled || ++site.idleCalls < MEMO_COOLDOWN) return false;
+
+		site.enabled = true;
+		site.idleCalls = 0;
+	}
+
+	uint64_t lKey, rKey;
+	std::memcpy(&lKey, &lVal, sizeof(lKey));
+	std::memcpy(&rKey, &rVal, sizeof(rKey));
+
+	const MemoEntry& entry = site.entries[m_memo_slot(lKey, rKey)];
+
+	bool hit = entry.valid && entry.lKey == lKey && entry.rKey == rKey;
+
+	if(hit) {
+		result = entry.value;
+		site.hits++;
+		site.windowHits++;
+	}
+	else {
+		site.misses++;
+	}
+
+	if(++site.windowLookups == MEMO_WINDOW) {
+		if(site.windowHits * 100 < MEMO_WINDOW * MEMO_MIN_HIT_PERCENT) {
+			site.enabled = false;
+		}
+
+		site.windowLookups = 0;
+		site.windowHits = 0;
+	}
+
+	return hit;
+
+}
+
+void MathInterpreter::m_memo_store(MemoSite& site, const double& lVal,
+	const double& rVal, const double& result) const noexcept {
+
+	if(!site.enabled) return;
+
+	uint64_t lKey, rKey;
+	std::memcpy(&lKey, &lVal, sizeof(lKey));
+	std::memcpy(&rKey, &rVal, sizeof(rKey));
+
+	MemoEntry& entry = site.entries[m_memo_slot(lKey, rKey)];
+
+	entry.lKey = lKey;
+	entry.rKey = rKey;
+	entry.value = result;
+	entry.valid = true;
+
+}
+
+std::string MathInterpreter::m_number_to_string(const double& val) const {
+
+/*
+	Converts the number to a string that m_string_to_number() converts back 
+	to exactly the same number.
+*/
+
+	std::ostringstream oss;
+	oss.precision(std::numeric_limits<double>::max_digits10);
+	oss << val;
+
+	return oss.str();
+
+}
+
+double MathInterpreter::m_string_to_number(const std::string& str) const {
+
+/*
+	Converts the string of a number, as std::stod() does except that it 
+	returns subnormal numbers, e.g. constants folded from 1/2^1070, instead
+	of throwing std::out_of_range.
+*/
+
+	const char* begin = str.c_str();
+	char* end;
+
+	double val = std::strtod(begin, &end);
+	if(end == begin) throw std::invalid_argument(str);
+
+	return val;
+
+}
+
+std::string MathInterpreter::m_number_to_c_literal(
+	const double& val) const {
+
+/*
+	Converts the number to an exact C literal. Finite numbers are written as
+	hexadecimal floating-point literals, which need no rounding.
+*/
+
+	if(std::isnan(val)) return "NAN";
+	if(std::isinf(val)) return val > 0 ? "INFINITY" : "(-INFINITY)";
+
+	std::ostringstream oss;
+	oss << std::hexfloat << val;
+
+	if(val < 0) return "(" + oss.str() + ")";
+
+	return oss.str();
+
+}
+
+std::vector<size_t> MathInterpreter::m_used_vars() const {
+
+/*
+	Returns the indices of the variable table entries that the RPN refers to,
+	in increasing order. Variables bound by specialize() are not included.
+*/
+
+	std::vector<bool> isUsed(m_varTable.size(), false);
+
+	for(const auto& bit: m_rpn) {
+		if(bit.type == BitType::VARIABLE) isUsed[std::stoi(bit.text)] = true;
+	}
+
+	std::vector<size_t> usedVars;
+
+	for(size_t i = 0; i < isUsed.size(); i++) {
+		if(isUsed[i]) usedVars.push_back(i);
+	}
+
+	return usedVars;
+
+}
+
+uint64_t MathInterpreter::m_hash(const std::string& str) const noexcept {
+
+/*
+	64-bit FNV-1a.
+*/
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for(const auto& c: str) {
+		hash = (hash ^ (unsigned char)c) * 0x100000001B3ULL;
+	}
+
+	return hash;
+
+}
+
+std::string MathInterpreter::m_clear_whitespaces(const std::string& str,
+	std::vector<size_t>& offsets) {
+
+/*
+	offsets: Filled with the offset in str of each character of the result.
+*/
 
-	std::istringstream iss(str);
 	std::string strNoWS;
-	std::string token;
+	offsets.clear();
 
-	while(iss >> token) strNoWS.append(token);
+	for(size_t i = 0; i < str.size(); i++) {
+		if(std::isspace((unsigned char)str[i])) continue;
+
+		strNoWS.push_back(str[i]);
+		offsets.push_back(i);
+	}
 
 	return strNoWS;
 
 }
 
+MathInterpreter::SourceSpan MathInterpreter::m_subexpression_span(
+	const SourceSpan& root, const SourceSpan& first, 
+	const SourceSpan& last) const noexcept {
+
+/*
+	Returns the span of the subexpression made of the root bit and its first
+	and last operands, with the parentheses enclosing the operands, e.g. 
+	"sin($x$)" for the function sin, whose operand spans "$x$".
+*/
+
+	auto enclose = [this](SourceSpan span) {
+		if(span.end > m_inputExpr.size()) return span;
+
+		while(true) {
+			size_t before = span.begin;
+			while(before > 0 && 
+				std::isspace((unsigned char)m_inputExpr[before - 1])) {
+				before--;
+			}
+
+			size_t after = span.end;
+			while(after < m_inputExpr.size() && 
+				std::isspace((unsigned char)m_inputExpr[after])) {
+				after++;
+			}
+
+			if(before == 0 || after == m_inputExpr.size()) break;
+			if(m_inputExpr[before - 1] != '(' || m_inputExpr[after] != ')') break;
+
+			span = SourceSpan {before - 1, after + 1};
+		}
+
+		return span;
+	};
+
+	return SourceSpan {std::min(root.begin, enclose(first).begin), 
+		std::max(root.end, enclose(last).end)};
+
+}
+
 MathInterpreter::InputBit MathInterpreter::m_extract_operator(ConstIter& it, 
 	const ConstIter& itBegin, const ConstIter& itEnd) const {
 
@@ -454,10 +3202,10 @@ MathInterpreter::InputBit MathInterpreter::m_extract_operator(ConstIter& it,
 	itEnd:   The iterator pointing at the end of the input expression.
 */
 
-	InputBit operatorBit {std::string(), BitType::OPERATOR};
+	InputBit operatorBit {std::string(), BitType::OPERATOR, SourceSpan {}};
 
 	while(m_isOperator(it, itBegin, itEnd)) {
-		operatorBit.first.push_back(*it);
+		operatorBit.text.push_back(*it);
 		it++;
 	}
 
@@ -474,10 +3222,10 @@ MathInterpreter::InputBit MathInterpreter::m_extract_number(ConstIter& it,
 	itEnd:   The iterator pointing at the end of the input expression.
 */
 
-	InputBit numberBit {std::string(), BitType::NUMBER};
+	InputBit numberBit {std::string(), BitType::NUMBER, SourceSpan {}};
 
 	while(m_isNumber(it, itBegin, itEnd)) {
-		numberBit.first.push_back(*it);
+		numberBit.text.push_back(*it);
 		it++;
 	}
 
@@ -486,7 +3234,7 @@ MathInterpreter::InputBit MathInterpreter::m_extract_number(ConstIter& it,
 }
 
 MathInterpreter::InputBit MathInterpreter::m_extract_variable(ConstIter& it,
-	const ConstIter& itBegin, const ConstIter& itEnd) const {
+	const ConstIter& /* itBegin */, const ConstIter& itEnd) const {
 
 /*
 	it:      The string iterator iterating over the input expression.
@@ -494,12 +3242,12 @@ MathInterpreter::InputBit MathInterpreter::m_extract_variable(ConstIter& it,
 	itEnd:   The iterator pointing at the end of the input expression.
 */
 
-	InputBit variableBit {std::string(), BitType::VARIABLE};
+	InputBit variableBit {std::string(), BitType::VARIABLE, SourceSpan {}};
 
 	if(it != itEnd) it++; // skip the left $ sign
 
 	while(it != itEnd && *it != '$') {
-		variableBit.first.push_back(*it);
+		variableBit.text.push_back(*it);
 		it++;
 	}
 
@@ -510,7 +3258,7 @@ MathInterpreter::InputBit MathInterpreter::m_extract_variable(ConstIter& it,
 }
 
 MathInterpreter::InputBit MathInterpreter::m_extract_function(ConstIter& it,
-	const ConstIter& itBegin, const ConstIter& itEnd) const {
+	const ConstIter& /* itBegin */, const ConstIter& itEnd) const {
 
 /*
 	it:      The string iterator iterating over the input expression.
@@ -518,10 +3266,10 @@ MathInterpreter::InputBit MathInterpreter::m_extract_function(ConstIter& it,
 	itEnd:   The iterator pointing at the end of the input expression.
 */
 
-	InputBit functionBit {std::string(), BitType::FUNCTION};
+	InputBit functionBit {std::string(), BitType::FUNCTION, SourceSpan {}};
 
 	while(it != itEnd && *it != '(') {
-		functionBit.first.push_back(*it);
+		functionBit.text.push_back(*it);
 		it++;
 	}
 
@@ -538,15 +3286,16 @@ MathInterpreter::InputBit MathInterpreter::m_extract_parenthesis(ConstIter& it,
 	itEnd:   The iterator pointing at the end of the input expression.
 */
 
-	InputBit parenthesisBit {std::string(), BitType::LPARENTHESIS};
+	InputBit parenthesisBit {std::string(), BitType::LPARENTHESIS, 
+		SourceSpan {}};
 
 	if(it != itEnd) {
 		if(*it == '(') {
-			parenthesisBit.first = std::string("(");
+			parenthesisBit.text = std::string("(");
 		}
 		else if(*it == ')') {
-			parenthesisBit.first = std::string(")");
-			parenthesisBit.second = BitType::RPARENTHESIS;
+			parenthesisBit.text = std::string(")");
+			parenthesisBit.type = BitType::RPARENTHESIS;
 		}
 
 		it++;
@@ -563,7 +3312,7 @@ void MathInterpreter::m_handle_operator(const InputBit& operatorBit) {
 	in the input expression.
 */
 
-	if(operatorBit.second == BitType::OPERATOR) {
+	if(operatorBit.type == BitType::OPERATOR) {
 		// pop all operators on the top of the operator stack with greater
 		// precedence than (or equal to) this operator and put them in the 
 		// output queue
@@ -591,15 +3340,16 @@ void MathInterpreter::m_handle_variable(const InputBit& variableBit) {
 	in the input expression.
 */
 
-	if(variableBit.second == BitType::VARIABLE) {
-		if(variableBit.first == "PI" || variableBit.first == "pi") {
+	if(variableBit.type == BitType::VARIABLE) {
+		if(variableBit.text == "PI" || variableBit.text == "pi") {
 			auto& variableToNumberBit = const_cast<InputBit&>(variableBit);
 
-			variableToNumberBit.first = std::to_string(M_PI);
-			variableToNumberBit.second = BitType::NUMBER;
+			// at full precision, std::to_string() keeps 6 decimals only
+			variableToNumberBit.text = m_number_to_string(M_PI);
+			variableToNumberBit.type = BitType::NUMBER;
 		}
 		else {
-			m_varTable.push_back(Variable {variableBit.first, 0.0});
+			m_varTable.push_back(Variable {variableBit.text, 0.0});
 		}
 
 		m_outputQueue.push(std::move(variableBit));
@@ -614,12 +3364,12 @@ void MathInterpreter::m_handle_rParenthesis(const InputBit& parenthesisBit) {
 	right parenthesis is encountered in the input expression.
 */
 
-	if(parenthesisBit.second == BitType::RPARENTHESIS) {
+	if(parenthesisBit.type == BitType::RPARENTHESIS) {
 		// pop all operators from the operator stack until the top element
 		// is a left parenthesis and put the popped operators in the output
 		// queue. Discard the right parenthesis
 		while(!m_operatorStack.empty()) {
-			if(m_operatorStack.top().first == "(") break;
+			if(m_operatorStack.top().text == "(") break;
 
 			auto topBit = m_operatorStack.top();
 			m_outputQueue.push(topBit);
@@ -26,6 +26,14 @@ Please do not delete this section.
 #include <vector>
 #include <utility>
 #include <exception>
+#include <cstdint>
+#include <memory>
+#include <map>
+
+#include "result_cache.h"
+#include "shadow_sampler.h"
+#include "instrumentation.h"
+#include "profiler.h"
 
 
 class INPUT_EXPR_SYNTAX_ERROR: public std::exception {
@@ -81,6 +89,15 @@ private:
 
 };
 
+class BATCH_SIZE_MISMATCH: public std::exception {
+
+public:
+	virtual const char* what() const noexcept {
+		return "Columns given for batch calculation have different lengths.";
+	}
+
+};
+
 class MathInterpreter {
 
 /*
@@ -131,11 +148,104 @@ class MathInterpreter {
 
 			e.g. double result = inter.calculate();
 
+	C. With columns of variable values
+		1. Initialize the interpreter as in B.
+
+		2. Put the values of each variable in a column, and call 
+		   calculate_batch() to calculate the expression for every row.
+		   Variables without a column keep the value set with set_value().
+
+			e.g. std::vector<double> xs {1.0, 2.0, 3.0};
+				 std::vector<double> ys {3.12, 3.12, 3.12};
+				 std::vector<double> results = 
+					inter.calculate_batch({{"x", xs}, {"y", ys}});
+
+		   When the columns hold only a few distinct rows, the expression is 
+		   calculated once per distinct row and the results are copied to
+		   the repeating rows. This is decided automatically by sampling the 
+		   columns.
+
+		3. Columns of floats are calculated with calculate_batch_float(), 
+		   which returns floats. By default the expression is calculated in
+		   single precision, which halves the memory traffic but gives 
+		   results accurate to about 1e-6 relative to the double results
+		   (more for long expressions or ill-conditioned functions like tan
+		   near pi/2). With FloatPrecision::MIXED the calculation is done in
+		   double precision and only the results are rounded to float.
+
+			e.g. std::vector<float> xs {1.0f, 2.0f, 3.0f};
+				 std::vector<float> results = inter.calculate_batch_float(
+					{{"x", xs}}, MathInterpreter::FloatPrecision::MIXED);
+
+		4. Columns that are already in memory can be given as pointers, in
+		   the order of variable_names(), without copying them, along with
+		   the memory of the results. See also the C interface in 
+		   math_interpreter_c.h.
+
+			e.g. const double* columns[] = {xs.data(), ys.data()};
+				 inter.calculate_batch(columns, xs.size(), results.data());
+
 
 	Notes:
 		- Function names can be all lowercase or all uppercase.
-		- Pi is recognized automatically when entered as a variable.
+		- Pi is recognized automatically when entered as a variable, with the
+		  full double precision of M_PI.
 			e.g. sin(2*$pi$*5) or sin(2*$PI$*5)
+		- compile_all() initializes many expressions at once, on all cores,
+		  and initializes the ones that only differ in whitespace once.
+
+			e.g. MathInterpreter::CompileResults results = 
+					MathInterpreter::compile_all(exprs);
+		- Calls to expensive functions (exp, log, trigonometric functions and
+		  the ^ operator) are memoized per call site when the same arguments
+		  repeat often enough. See set_memoization() and memo_stats().
+		- Variables that stay the same for many calculations can be bound to
+		  constants with specialize(), which returns a new interpreter for
+		  the rest of the variables. Parts of the expression that only depend
+		  on the bound variables are then calculated once, in specialize().
+		  Specializations are kept, so specializing again with the same
+		  values only costs a copy.
+
+			e.g. MathInterpreter lenOf75 = inter.specialize({{"len", 75}});
+		- set_shadow() enables the shadow mode, in which a sample of the 
+		  results of the optimized engines (the fixed-size evaluators, the
+		  result cache and the batch calculations) is compared with the 
+		  results of the reference interpreter, calculate_reference(). See 
+		  ShadowSampler in shadow_sampler.h for the sampling, the budget and
+		  the tolerances.
+		- set_profiling() samples the calculations, timing each instruction,
+		  and attributes the time to the subexpressions of the input 
+		  expression. Profiler::annotate(profile()) shows where the time 
+		  goes, e.g. to find the parts of a slow expression worth rewriting.
+		- Calculations, result cache lookups, compilations and rejected 
+		  expressions are counted process-wide, and exported in the 
+		  OpenMetrics text format by MathMetrics in math_metrics.h.
+		- The stages of the initialization, the result cache lookups and the
+		  batch chunks have static tracepoints for perf and bpftrace. See
+		  math_probes.h.
+		- When built with MATH_INTERPRETER_INSTRUMENT defined, the interpreter
+		  counts its calls and the executions of each opcode and function,
+		  and samples their cost in CPU cycles. See instrumentation() and
+		  Instrumentation in instrumentation.h. Otherwise, the interpreter has
+		  no instrumentation state at all.
+		- set_reproducible(true) makes the results bitwise identical on every
+		  host and in every way of calculating them (calculate(), the batch
+		  calculations and NativeModule), at the cost of slower functions.
+		  The functions are then calculated with ReproducibleMath instead of
+		  the standard library. See reproducible_math.h.
+		- explain() shows what the interpreter made of the expression: the
+		  tokens, the expression tree before and after the optimizations,
+		  the instructions, the evaluator it picked, and an estimate of the
+		  cost of a calculation. As text, or as JSON for tools.
+		- to_c_source() translates the expression to C functions, for the
+		  cases where compiling the expression with a C compiler pays off.
+		  See NativeModule in native_module.h, which does this at runtime.
+		- Call set_result_cache() to keep the results of up to the given 
+		  number of calculate() calls, keyed by the values of all variables.
+		  calculate() then returns the stored result without calculating when
+		  called with the same variable values again. Copies of the 
+		  interpreter share its cache, which is safe to use from multiple 
+		  threads. See result_cache_stats() for the hit/miss counts.
 
 
 	Limitations:
@@ -175,19 +285,179 @@ protected:
 		ABS
 	};
 
-	using InputBit = std::pair<std::string, BitType>;
-	using Variable = std::pair<std::string, double>;
-	using VarTable = std::vector<Variable>;
+	using SourceSpan = Profiler::Span;
+
+	// token of the input expression: its text, its type, and where it is in 
+	// the input expression. Bits made of several tokens, like folded 
+	// constants, span the text of all of them
+	struct InputBit {
+		std::string text;
+		BitType type;
+		SourceSpan span;
+	};
 
 	using ConstIter = std::string::const_iterator;
 
+	// Direct-mapped memoization cache of a single call site. The cache is
+	// keyed by the bit patterns of the arguments, so that only bitwise
+	// identical arguments hit.
+	struct MemoEntry {
+		uint64_t lKey;
+		uint64_t rKey;
+		double value;
+		bool valid;
+	};
+
+	struct MemoSite {
+		std::vector<MemoEntry> entries;
+		bool enabled;
+		size_t windowLookups;
+		size_t windowHits;
+		size_t idleCalls;
+		size_t hits;
+		size_t misses;
+	};
+
+	static const size_t MEMO_SLOT_BITS = 6;
+	static const size_t MEMO_SLOTS = 1 << MEMO_SLOT_BITS;
+	static const size_t MEMO_WINDOW = 256;
+	static const size_t MEMO_MIN_HIT_PERCENT = 30;
+	static const size_t MEMO_COOLDOWN = 4096;
+
+	static const size_t BATCH_CHUNK = 256;
+	static const size_t DISTINCT_MIN_ROWS = 4096;
+	static const size_t DISTINCT_SAMPLE = 1024;
+	static const size_t DISTINCT_MAX_PERCENT = 10;
+
+	static const size_t MAX_FIXED_VARS = 8;
+
+	static const size_t COMPILE_CHUNK = 64; // expressions per task
+
+	static const size_t MAX_SPECIALIZATIONS = 64; // kept by specialize()
+
+	using Evaluator = double (MathInterpreter::*)();
+
+	using ScalarFunction = double (*)(double val);
+	using ScalarOperator = double (*)(double lVal, double rVal);
+
+	template<typename Real>
+	struct BatchKernels {
+		void (*function)(Real* vals, size_t numVals);
+		void (*operation)(Real* lVals, const Real* rVals, size_t numVals);
+	};
+
+	// RPN bit resolved for calculation: numbers are parsed, variables point to
+	// their values, and operators and functions to the code calculating them
+	struct Instruction {
+		BitType type;
+		double value;    // NUMBER
+		size_t varIndex; // VARIABLE, index in the variable table
+		size_t varSlot;  // VARIABLE, index in the variable values
+		size_t memoSite; // OPERATOR, FUNCTION: site index + 1, 0 if none
+		char op;         // OPERATOR
+		FUNCTION func;   // FUNCTION
+		ScalarFunction function;
+		ScalarOperator operation;
+		BatchKernels<double> batch;
+		BatchKernels<float> batchFloat;
+		SourceSpan span;
+	};
+
+	// node of the expression tree shown by explain(), with the indices of its
+	// operands in the same vector
+	struct ExplainNode {
+		std::string label;
+		BitType type;
+		SourceSpan span;
+		std::string note;
+		std::vector<size_t> operands;
+	};
+
 public:
+	using Variable = std::pair<std::string, double>;
+	using VarTable = std::vector<Variable>;
+
+	struct MemoStats {
+		size_t sites;       // memoizable call sites in the expression
+		size_t activeSites; // call sites currently memoizing
+		size_t hits;
+		size_t misses;
+	};
+
+	struct CompileDiagnostic {
+		size_t index; // of the input expression
+		std::string message;
+	};
+
+	struct CompileResults {
+		// in the order of the input expressions, uninitialized where the 
+		// input expression is not valid
+		std::vector<MathInterpreter> exprs;
+		std::vector<CompileDiagnostic> diagnostics; // in the order of index
+		size_t numDistinct; // input expressions, apart from whitespace
+	};
+
+	using BatchColumn = std::pair<std::string, std::vector<double>>;
+	using FloatBatchColumn = std::pair<std::string, std::vector<float>>;
+
+	enum class FloatPrecision {
+		SINGLE, // calculate in float
+		MIXED   // calculate in double, round the results to float
+	};
+
+	enum class ExplainFormat {
+		TEXT,
+		JSON
+	};
+
 	MathInterpreter() = default;
 
 	double calculate();
 
 	void init_with_expr(const std::string& input);
+	static CompileResults compile_all(const std::vector<std::string>& inputs,
+		size_t numThreads = 0);
 	void set_value(const std::string& varName, const double& varValue);
+	void set_values(const double* values);
+
+	std::vector<double> calculate_batch(const std::vector<BatchColumn>& columns);
+	std::vector<float> calculate_batch_float(
+		const std::vector<FloatBatchColumn>& columns, 
+		FloatPrecision precision = FloatPrecision::SINGLE);
+	void calculate_batch(const double* const* columns, size_t numRows,
+		double* results);
+	void calculate_batch_float(const float* const* columns, size_t numRows,
+		float* results, FloatPrecision precision = FloatPrecision::SINGLE);
+
+	MathInterpreter specialize(const VarTable& boundValues);
+
+	const std::string& expression() const noexcept;
+	uint64_t expression_hash() const noexcept;
+	std::vector<std::string> variable_names() const;
+	std::string to_c_source(const std::string& funcName) const;
+	std::string explain(ExplainFormat format = ExplainFormat::TEXT) const;
+
+	void set_memoization(bool enabled);
+	MemoStats memo_stats() const noexcept;
+
+	void set_result_cache(size_t capacity);
+	ResultCache::Stats result_cache_stats() const;
+
+	void set_reproducible(bool enabled);
+	bool is_reproducible() const noexcept;
+
+	void set_shadow(const ShadowSampler::Config& config);
+	void disable_shadow() noexcept;
+	ShadowSampler::Stats shadow_stats() const;
+
+	double calculate_reference();
+
+	Instrumentation::Snapshot instrumentation() const;
+	void reset_instrumentation() noexcept;
+
+	void set_profiling(size_t period);
+	void disable_profiling() noexcept;
+	Profiler::Profile profile() const;
 
 	virtual ~MathInterpreter() = default;
 
@@ -198,12 +468,44 @@ protected:
 	std::stack<double> m_numberStack;
 
 	std::string m_inputExpr;
+	uint64_t m_exprHash = 0;
 
 	std::vector<InputBit> m_inputBits;
+	std::vector<InputBit> m_sourceRpn; // before folding the constants
 	std::vector<InputBit> m_rpn;
+	std::vector<Instruction> m_program;
 
 	VarTable m_varTable;
 
+	std::vector<MemoSite> m_memoSites;
+	bool m_memoEnabled = true;
+
+	size_t m_resultCacheCapacity = 0;
+	std::shared_ptr<ResultCache> m_resultCache;
+	std::vector<size_t> m_cacheKeyVars; // var table indices in the cache key
+	std::vector<double> m_cacheKey;
+
+	Evaluator m_evaluator = nullptr;
+	bool m_reproducible = false;
+
+	std::shared_ptr<ShadowSampler> m_shadow;
+
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	// only there when enabled, since every copy of the interpreter pays for
+	// its size
+	Instrumentation m_instrumentation;
+#endif
+	std::vector<size_t> m_usedVars; // var table indices, by variable slot
+
+	size_t m_profilePeriod = 0;
+	size_t m_profileCountdown = 0;
+	std::shared_ptr<Profiler> m_profiler;
+	std::vector<uint64_t> m_instructionCycles; // of the last timed calculation
+
+	// specializations of this expression, keyed by their bound values, at 
+	// most MAX_SPECIALIZATIONS
+	std::map<std::string, std::shared_ptr<MathInterpreter>> m_specializations;
+
 	bool m_isOperator(const ConstIter& it, 
 		const ConstIter& itBegin, const ConstIter& itEnd) const noexcept;
 	bool m_isNumber(const ConstIter& it,
@@ -228,16 +530,132 @@ protected:
 
 	int m_precedence(const InputBit& operatorBit) const noexcept;
 
-	double m_calc_operator(const double& lVal, const double& rVal,
-		const std::string& operatorName) const noexcept;
-	double m_calc_function(const double& val, 
-		const FUNCTION& func) const noexcept;
+	template<typename Real>
+	static Real m_calc_operator(const Real& lVal, const Real& rVal,
+		const char& op) noexcept;
+	template<typename Real>
+	static Real m_calc_function(const Real& val, 
+		const FUNCTION& func) noexcept;
+
+	template<typename Real>
+	static Real m_calc_reproducible_operator(const Real& lVal, 
+		const Real& rVal, const char& op) noexcept;
+	template<typename Real>
+	static Real m_calc_reproducible_function(const Real& val, 
+		const FUNCTION& func) noexcept;
+
+	template<typename Real, char Op, bool Reproducible>
+	static Real m_operator(Real lVal, Real rVal) noexcept;
+	template<typename Real, FUNCTION Func, bool Reproducible>
+	static Real m_function(Real val) noexcept;
+	template<typename Real, char Op, bool Reproducible>
+	static void m_operator_kernel(Real* lVals, const Real* rVals, 
+		size_t numVals) noexcept;
+	template<typename Real, FUNCTION Func, bool Reproducible>
+	static void m_function_kernel(Real* vals, size_t numVals) noexcept;
+	template<typename Real>
+	static const BatchKernels<Real>& m_batch_kernels(
+		const Instruction& instruction) noexcept;
+
+	void m_resolve(Instruction& instruction, const InputBit& bit) const;
+	template<bool Reproducible>
+	static void m_resolve_operator(Instruction& instruction, 
+		const char& op) noexcept;
+	template<bool Reproducible>
+	static void m_resolve_function(Instruction& instruction,
+		const FUNCTION& func) noexcept;
+
+	template<typename Elem>
+	size_t m_map_columns(
+		const std::vector<std::pair<std::string, std::vector<Elem>>>& columns,
+		std::vector<const Elem*>& varColumns) const;
+	template<typename Elem>
+	void m_map_column_pointers(const Elem* const* columns,
+		std::vector<const Elem*>& varColumns) const;
+	template<typename Real, typename Elem>
+	void m_calculate_rows(const std::vector<const Elem*>& varColumns, 
+		size_t numRows, Elem* results);
+	template<typename Real, typename Elem>
+	void m_calculate_chunk(const std::vector<const Elem*>& varColumns,
+		size_t rowBegin, size_t numRows, Elem* results,
+		std::vector<std::vector<Real>>& batchStack);
+	template<typename Real, typename Elem>
+	void m_calculate_distinct(const std::vector<const Elem*>& varColumns,
+		size_t numRows, Elem* results);
+	template<typename Elem>
+	void m_shadow_rows(ShadowSampler::Tier tier, 
+		const std::vector<const Elem*>& varColumns, size_t numRows,
+		const Elem* results);
+	void m_shadow_check(ShadowSampler::Tier tier, const double& result);
+	ShadowSampler::Inputs m_shadow_inputs() const;
+	template<typename Elem>
+	bool m_prefer_distinct(const std::vector<const Elem*>& varColumns,
+		size_t numRows) const;
+
+	bool m_is_memoizable(const InputBit& bit) const noexcept;
+	size_t m_memo_slot(const uint64_t& lKey, 
+		const uint64_t& rKey) const noexcept;
+	bool m_memo_lookup(MemoSite& site, const double& lVal, const double& rVal,
+		double& result) const noexcept;
+	void m_memo_store(MemoSite& site, const double& lVal, const double& rVal,
+		const double& result) const noexcept;
 
 	void m_make_input_bits();
 	void m_make_rpn();
 	void m_validate_rpn();
-
-	std::string m_clear_whitespaces(const std::string& str) const;
+	void m_compile();
+	void m_make_program();
+	void m_make_memo_sites();
+	void m_make_result_cache();
+	void m_make_evaluator();
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	void m_make_instrumentation();
+#endif
+	void m_make_profiler();
+	void m_fold_constants();
+
+	std::string m_number_to_string(const double& val) const;
+	double m_string_to_number(const std::string& str) const;
+	std::string m_number_to_c_literal(const double& val) const;
+
+	std::vector<size_t> m_used_vars() const;
+
+	bool m_is_deterministic() const noexcept;
+
+	double m_calculate();
+	double m_evaluate();
+	double m_calculate_program();
+	double m_calculate_timed();
+#ifdef MATH_INTERPRETER_INSTRUMENT
+	void m_add_opcode_timings();
+#endif
+	size_t m_opcode_of(const Instruction& instruction) const noexcept;
+	static std::string m_function_name(const FUNCTION& func);
+	static const char* m_bit_type_name(const BitType& type) noexcept;
+	static size_t m_estimated_cycles(const Instruction& instruction) noexcept;
+
+	std::vector<ExplainNode> m_explain_nodes(const std::vector<InputBit>& rpn,
+		bool isOptimized) const;
+	void m_explain_node_text(std::ostream& os, 
+		const std::vector<ExplainNode>& nodes, size_t index, 
+		size_t depth) const;
+	void m_explain_node_json(std::ostream& os, 
+		const std::vector<ExplainNode>& nodes, size_t index) const;
+	std::string m_json_number(const double& val) const;
+	static std::string m_json_string(const std::string& str);
+	template<size_t NumVars, size_t StackSize>
+	double m_calculate_fixed();
+
+	double m_apply_operator(const Instruction& instruction, 
+		const double& lVal, const double& rVal);
+	double m_apply_function(const Instruction& instruction, 
+		const double& val);
+
+	uint64_t m_hash(const std::string& str) const noexcept;
+	static std::string m_clear_whitespaces(const std::string& str, 
+		std::vector<size_t>& offsets);
+	SourceSpan m_subexpression_span(const SourceSpan& root, 
+		const SourceSpan& first, const SourceSpan& last) const noexcept;
 
 };
 
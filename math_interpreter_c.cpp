@@ -0,0 +1,336 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "math_interpreter_c.h"
+#include "math_interpreter.h"
+
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+
+struct math_expr {
+	MathInterpreter expr;
+	std::vector<std::string> varNames;
+};
+
+static thread_local std::string lastError;
+
+static math_status fail(math_status status, const char* message) noexcept {
+
+/*
+	Sets the message of the last error, or clears it if there is no memory
+	for it.
+*/
+
+	try {
+		lastError = message;
+	}
+	catch(...) {
+		lastError.clear();
+	}
+
+	return status;
+
+}
+
+static math_status fail(math_status status, const std::string& message) {
+
+/*
+	Same as above, for messages built at run time. May throw, so it must
+	only be called in call().
+*/
+
+	lastError = message;
+
+	return status;
+
+}
+
+template<typename Function>
+static math_status call(Function function) noexcept {
+
+/*
+	Runs the function and returns its status, and turns the exceptions it 
+	throws into status codes, since exceptions must not cross the C 
+	interface.
+*/
+
+	try {
+		return function();
+	}
+	catch(const INPUT_EXPR_SYNTAX_ERROR& e) {
+		return fail(MATH_ERROR_SYNTAX, e.what());
+	}
+	catch(const UNKNOWN_EXPRESSION& e) {
+		return fail(MATH_ERROR_UNKNOWN_EXPRESSION, e.what());
+	}
+	catch(const BAD_INIT& e) {
+		return fail(MATH_ERROR_EMPTY, e.what());
+	}
+	catch(const UNKNOWN_VARIABLE& e) {
+		return fail(MATH_ERROR_UNKNOWN_VARIABLE, e.what());
+	}
+	catch(const std::bad_alloc&) {
+		lastError.clear();
+		return MATH_ERROR_OUT_OF_MEMORY;
+	}
+	catch(const std::exception& e) {
+		return fail(MATH_ERROR_INTERNAL, e.what());
+	}
+	catch(...) {
+		return fail(MATH_ERROR_INTERNAL, "Unknown error");
+	}
+
+}
+
+extern "C" {
+
+uint32_t math_abi_version(void) {
+
+	return MATH_ABI_VERSION;
+
+}
+
+const char* math_status_string(math_status status) {
+
+	switch(status) {
+		case MATH_OK:
+			return "ok";
+		case MATH_ERROR_SYNTAX:
+			return "syntax error";
+		case MATH_ERROR_UNKNOWN_EXPRESSION:
+			return "unknown expression";
+		case MATH_ERROR_EMPTY:
+			return "empty expression";
+		case MATH_ERROR_UNKNOWN_VARIABLE:
+			return "unknown variable";
+		case MATH_ERROR_INVALID_ARGUMENT:
+			return "invalid argument";
+		case MATH_ERROR_OUT_OF_MEMORY:
+			return "out of memory";
+		case MATH_ERROR_INTERNAL:
+			return "internal error";
+	}
+
+	return "unknown status";
+
+}
+
+const char* math_last_error(void) {
+
+/*
+	Returns the message of the last error of the calling thread. Valid until
+	the next failing call of the thread.
+*/
+
+	return lastError.c_str();
+
+}
+
+math_status math_expr_compile(const char* text, size_t length,
+	math_expr** expr) {
+
+/*
+	Initializes a new expression from length characters of text, which does
+	not have to be null-terminated. Sets *expr to the handle, to be freed
+	with math_expr_free(), or to null on failure.
+*/
+
+	if(!expr) return fail(MATH_ERROR_INVALID_ARGUMENT, "expr is null");
+	*expr = nullptr;
+
+	if(!text && length) return fail(MATH_ERROR_INVALID_ARGUMENT, "text is null");
+
+	return call([&]() {
+		std::unique_ptr<math_expr> created(new math_expr());
+
+		created->expr.init_with_expr(std::string(text ? text : "", length));
+		created->varNames = created->expr.variable_names();
+
+		*expr = created.release();
+
+		return MATH_OK;
+	});
+
+}
+
+math_status math_expr_clone(const math_expr* expr, math_expr** copy) {
+
+	if(!expr || !copy) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr or copy is null");
+	}
+
+	*copy = nullptr;
+
+	return call([&]() {
+		*copy = new math_expr(*expr);
+
+		return MATH_OK;
+	});
+
+}
+
+void math_expr_free(math_expr* expr) {
+
+	delete expr;
+
+}
+
+size_t math_expr_num_vars(const math_expr* expr) {
+
+	return expr ? expr->varNames.size() : 0;
+
+}
+
+const char* math_expr_var_name(const math_expr* expr, size_t varIndex) {
+
+/*
+	Returns the name of the variable, valid until the handle is freed, or
+	null if there is no such variable.
+*/
+
+	if(!expr || varIndex >= expr->varNames.size()) return nullptr;
+
+	return expr->varNames[varIndex].c_str();
+
+}
+
+math_status math_expr_var_index(const math_expr* expr, const char* name,
+	size_t* varIndex) {
+
+	if(!expr || !name || !varIndex) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr, name or varIndex is "
+			"null");
+	}
+
+	return call([&]() {
+		for(size_t i = 0; i < expr->varNames.size(); i++) {
+			if(expr->varNames[i] == name) {
+				*varIndex = i;
+				return MATH_OK;
+			}
+		}
+
+		return fail(MATH_ERROR_UNKNOWN_VARIABLE, 
+			std::string("No variable named ") + name);
+	});
+
+}
+
+math_status math_expr_bind(math_expr* expr, size_t varIndex, double value) {
+
+/*
+	Sets the value of a variable, for math_expr_evaluate(), and for the
+	variables without a column in the batch functions.
+*/
+
+	if(!expr) return fail(MATH_ERROR_INVALID_ARGUMENT, "expr is null");
+
+	return call([&]() {
+		if(varIndex >= expr->varNames.size()) {
+			return fail(MATH_ERROR_UNKNOWN_VARIABLE, 
+				"No variable with the index " + std::to_string(varIndex));
+		}
+
+		expr->expr.set_value(expr->varNames[varIndex], value);
+
+		return MATH_OK;
+	});
+
+}
+
+math_status math_expr_bind_all(math_expr* expr, const double* values) {
+
+/*
+	Sets the values of all variables, given in the order of their indices.
+*/
+
+	if(!expr || (!values && !expr->varNames.empty())) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr or values is null");
+	}
+
+	expr->expr.set_values(values);
+
+	return MATH_OK;
+
+}
+
+math_status math_expr_evaluate(math_expr* expr, double* result) {
+
+	if(!expr || !result) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr or result is null");
+	}
+
+	return call([&]() {
+		*result = expr->expr.calculate();
+
+		return MATH_OK;
+	});
+
+}
+
+math_status math_expr_evaluate_batch(math_expr* expr,
+	const double* const* columns, size_t numRows, double* results) {
+
+/*
+	Calculates numRows rows, reading the values of variable i from
+	columns[i], and writing the results to results. A null column keeps the
+	value set with math_expr_bind(). columns may be null if the expression
+	has no variables.
+*/
+
+	if(!expr || (!columns && !expr->varNames.empty()) ||
+		(!results && numRows)) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr, columns or results is "
+			"null");
+	}
+
+	if(numRows == 0) return MATH_OK;
+
+	return call([&]() {
+		expr->expr.calculate_batch(columns, numRows, results);
+
+		return MATH_OK;
+	});
+
+}
+
+math_status math_expr_evaluate_batch_float(math_expr* expr,
+	const float* const* columns, size_t numRows, float* results,
+	int isMixedPrecision) {
+
+/*
+	Same as math_expr_evaluate_batch(), for columns of floats. Calculates in
+	single precision, or in double precision if isMixedPrecision is not 0.
+*/
+
+	if(!expr || (!columns && !expr->varNames.empty()) ||
+		(!results && numRows)) {
+		return fail(MATH_ERROR_INVALID_ARGUMENT, "expr, columns or results is "
+			"null");
+	}
+
+	if(numRows == 0) return MATH_OK;
+
+	return call([&]() {
+		expr->expr.calculate_batch_float(columns, numRows, results,
+			isMixedPrecision ? MathInterpreter::FloatPrecision::MIXED :
+			MathInterpreter::FloatPrecision::SINGLE);
+
+		return MATH_OK;
+	});
+
+}
+
+} // extern "C"
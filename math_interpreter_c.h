@@ -0,0 +1,101 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef MATH_INTERPRETER_C_H
+#define MATH_INTERPRETER_C_H
+
+/*
+	C interface of MathInterpreter, for calling it from other languages
+	through their foreign function interfaces (Rust, Go, Python ctypes/cffi
+	etc.). Expressions are opaque handles, and errors are returned as status
+	codes instead of exceptions; the message of the last error of the
+	calling thread is given by math_last_error().
+
+	How to use:
+
+		e.g. math_expr* expr;
+
+			 if(math_expr_compile("$x$ * 2 + $y$", 13, &expr) != MATH_OK) {
+				 fprintf(stderr, "%s\n", math_last_error());
+			 }
+
+			 // columns in the order of math_expr_var_name(expr, i)
+			 const double* columns[] = {xs, ys};
+			 math_expr_evaluate_batch(expr, columns, numRows, results);
+
+			 math_expr_free(expr);
+
+	Variables are referred to by their index, in the order in which they
+	first appear in the expression. The batch functions read the columns
+	and write the results in place, without copying them, so that the
+	buffers of the caller (e.g. numpy arrays, Rust slices, Go slices) can
+	be passed as they are.
+
+	A handle must not be used by several threads at once, since binding and
+	evaluating change it. Use math_expr_clone() for a handle per thread.
+
+	The interface is stable: functions are only added, and MATH_ABI_VERSION
+	changes when they are.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MATH_ABI_VERSION 1
+
+typedef struct math_expr math_expr;
+
+typedef enum math_status {
+	MATH_OK = 0,
+	MATH_ERROR_SYNTAX = 1,             /* syntax error in the expression */
+	MATH_ERROR_UNKNOWN_EXPRESSION = 2, /* unknown function name etc. */
+	MATH_ERROR_EMPTY = 3,              /* empty expression */
+	MATH_ERROR_UNKNOWN_VARIABLE = 4,   /* bad variable name or index */
+	MATH_ERROR_INVALID_ARGUMENT = 5,   /* null pointer */
+	MATH_ERROR_OUT_OF_MEMORY = 6,
+	MATH_ERROR_INTERNAL = 7
+} math_status;
+
+uint32_t math_abi_version(void);
+const char* math_status_string(math_status status);
+const char* math_last_error(void);
+
+math_status math_expr_compile(const char* text, size_t length,
+	math_expr** expr);
+math_status math_expr_clone(const math_expr* expr, math_expr** copy);
+void math_expr_free(math_expr* expr);
+
+size_t math_expr_num_vars(const math_expr* expr);
+const char* math_expr_var_name(const math_expr* expr, size_t varIndex);
+math_status math_expr_var_index(const math_expr* expr, const char* name,
+	size_t* varIndex);
+
+math_status math_expr_bind(math_expr* expr, size_t varIndex, double value);
+math_status math_expr_bind_all(math_expr* expr, const double* values);
+
+math_status math_expr_evaluate(math_expr* expr, double* result);
+math_status math_expr_evaluate_batch(math_expr* expr,
+	const double* const* columns, size_t numRows, double* results);
+math_status math_expr_evaluate_batch_float(math_expr* expr,
+	const float* const* columns, size_t numRows, float* results,
+	int isMixedPrecision);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !MATH_INTERPRETER_C_H */
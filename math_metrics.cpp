@@ -0,0 +1,331 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "math_metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+const size_t MathMetrics::NUM_ENGINES;
+const size_t MathMetrics::NUM_COMPILES;
+const size_t MathMetrics::NUM_REJECTIONS;
+const size_t MathMetrics::COMPILE_BUCKETS;
+
+const double MathMetrics::COMPILE_BUCKET_BOUNDS[COMPILE_BUCKETS] = {
+	1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0};
+
+MathMetrics::Block MathMetrics::m_fallbackBlock;
+
+// blocks of the running threads, and the counts of the exited ones
+struct MathMetrics::Registry {
+	std::mutex mutex;
+	std::vector<Block*> blocks;
+	Snapshot exited {};
+};
+
+// owns the block of a thread, and hands its counts over to the registry when
+// the thread exits
+struct MathMetrics::ThreadBlock {
+	Block* block = nullptr;
+
+	~ThreadBlock() {
+		if(!block) return;
+
+		Registry& registry = m_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		m_add_block(registry.exited, *block);
+		registry.blocks.erase(std::remove(registry.blocks.begin(), 
+			registry.blocks.end(), block), registry.blocks.end());
+
+		delete block;
+	}
+};
+
+void MathMetrics::count_native_cache(bool isHit) noexcept {
+
+	Block& block = m_block();
+
+	if(isHit) block.nativeCacheHits.add(1);
+	else block.nativeCacheMisses.add(1);
+
+}
+
+void MathMetrics::add_compile(Compile kind, double seconds) noexcept {
+
+	Block& block = m_block();
+
+	size_t bucket = 0;
+	while(bucket < COMPILE_BUCKETS && seconds > COMPILE_BUCKET_BOUNDS[bucket]) {
+		bucket++;
+	}
+
+	block.compileBuckets[(size_t)kind][bucket].add(1);
+	block.compileNanoseconds[(size_t)kind].add((uint64_t)(seconds * 1e9));
+
+}
+
+void MathMetrics::count_rejection(Rejection reason) noexcept {
+
+	m_block().rejections[(size_t)reason].add(1);
+
+}
+
+MathMetrics::Snapshot MathMetrics::snapshot() {
+
+/*
+	Returns the sums of the counters of all threads.
+*/
+
+	Registry& registry = m_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	Snapshot snapshot = registry.exited;
+
+	for(const auto& block: registry.blocks) m_add_block(snapshot, *block);
+	m_add_block(snapshot, m_fallbackBlock);
+
+	return snapshot;
+
+}
+
+std::string MathMetrics::to_openmetrics() {
+
+/*
+	Returns the metrics in the OpenMetrics text format.
+*/
+
+	Snapshot snapshot = MathMetrics::snapshot();
+	std::ostringstream oss;
+
+	oss << "# TYPE math_evaluations counter\n"
+		"# HELP math_evaluations Calculations of expressions, by engine.\n";
+
+	for(size_t i = 0; i < NUM_ENGINES; i++) {
+		oss << "math_evaluations_total{engine=\"" << engine_name((Engine)i) << 
+			"\"} " << snapshot.evaluations[i] << '\n';
+	}
+
+	oss << "# TYPE math_result_cache_lookups counter\n"
+		"# HELP math_result_cache_lookups Lookups in the result caches.\n"
+		"math_result_cache_lookups_total{result=\"hit\"} " << 
+		snapshot.resultCacheHits << "\n"
+		"math_result_cache_lookups_total{result=\"miss\"} " << 
+		snapshot.resultCacheMisses << '\n';
+
+	oss << "# TYPE math_native_cache_lookups counter\n"
+		"# HELP math_native_cache_lookups Lookups of compiled native modules "
+		"in the cache on disk.\n"
+		"math_native_cache_lookups_total{result=\"hit\"} " << 
+		snapshot.nativeCacheHits << "\n"
+		"math_native_cache_lookups_total{result=\"miss\"} " << 
+		snapshot.nativeCacheMisses << '\n';
+
+	const char* const compileNames[NUM_COMPILES] = {"expression", "native"};
+
+	oss << "# TYPE math_compile_seconds histogram\n"
+		"# UNIT math_compile_seconds seconds\n"
+		"# HELP math_compile_seconds Time spent compiling expressions.\n";
+
+	for(size_t i = 0; i < NUM_COMPILES; i++) {
+		const Histogram& histogram = snapshot.compiles[i];
+		std::string labels = std::string("kind=\"") + compileNames[i] + "\"";
+		uint64_t cumulative = 0;
+
+		for(size_t bucket = 0; bucket <= COMPILE_BUCKETS; bucket++) {
+			cumulative += histogram.buckets[bucket];
+
+			oss << "math_compile_seconds_bucket{" << labels << ",le=\"";
+
+			if(bucket < COMPILE_BUCKETS) oss << COMPILE_BUCKET_BOUNDS[bucket];
+			else oss << "+Inf";
+
+			oss << "\"} " << cumulative << '\n';
+		}
+
+		oss << "math_compile_seconds_count{" << labels << "} " << 
+			histogram.count << '\n';
+		oss << "math_compile_seconds_sum{" << labels << "} " << 
+			histogram.sum << '\n';
+	}
+
+	const char* const rejectionNames[NUM_REJECTIONS] = {"syntax_error", 
+		"unknown_expression", "empty"};
+
+	oss << "# TYPE math_rejected_expressions counter\n"
+		"# HELP math_rejected_expressions Expressions that failed to "
+		"initialize, by reason.\n";
+
+	for(size_t i = 0; i < NUM_REJECTIONS; i++) {
+		oss << "math_rejected_expressions_total{reason=\"" << 
+			rejectionNames[i] << "\"} " << snapshot.rejections[i] << '\n';
+	}
+
+	oss << "# EOF\n";
+
+	return oss.str();
+
+}
+
+size_t MathMetrics::write(char* buffer, size_t size) {
+
+/*
+	Writes the metrics to the buffer, like snprintf(): at most size - 1 
+	characters are written, followed by a null character, and the length of
+	the whole text is returned. The text was complete if it is less than size.
+*/
+
+	std::string text = to_openmetrics();
+
+	if(size > 0) {
+		size_t length = std::min(text.size(), size - 1);
+
+		std::memcpy(buffer, text.data(), length);
+		buffer[length] = '\0';
+	}
+
+	return text.size();
+
+}
+
+void MathMetrics::write_file(const std::string& path) {
+
+/*
+	Writes the metrics to the file. The file is written under a temporary 
+	name and renamed when complete, so that readers never see a partially 
+	written file, e.g. for the textfile collector of node_exporter.
+
+	Throws METRICS_WRITE_ERROR if the file cannot be written.
+*/
+
+	// the process id and a counter, unique across processes and threads
+	static std::atomic<uint64_t> counter(0);
+	std::string tempPath = path + "." + std::to_string(getpid()) + "." + 
+		std::to_string(counter++) + ".tmp";
+
+	std::ofstream file(tempPath);
+	file << to_openmetrics();
+	file.close();
+
+	if(!file) {
+		std::remove(tempPath.c_str());
+		throw METRICS_WRITE_ERROR(path);
+	}
+
+	if(std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		throw METRICS_WRITE_ERROR(path);
+	}
+
+}
+
+const char* MathMetrics::engine_name(Engine engine) noexcept {
+
+	switch(engine) {
+		case Engine::FIXED: return "fixed";
+		case Engine::PROGRAM: return "program";
+		case Engine::RESULT_CACHE: return "result_cache";
+		case Engine::BATCH: return "batch";
+		case Engine::DISTINCT: return "distinct";
+		case Engine::FLOAT_MIXED: return "float_mixed";
+		case Engine::FLOAT_SINGLE: return "float_single";
+		case Engine::NATIVE: return "native";
+		default: return "unknown";
+	}
+
+}
+
+MathMetrics::Registry& MathMetrics::m_registry() {
+
+/*
+	Never destroyed, since threads may exit after the static objects are.
+*/
+
+	static Registry* registry = new Registry();
+
+	return *registry;
+
+}
+
+MathMetrics::Block* MathMetrics::m_register_thread() noexcept {
+
+/*
+	Creates the block of the calling thread, or returns m_fallbackBlock if 
+	the block cannot be created or registered.
+*/
+
+	static thread_local ThreadBlock threadBlock;
+
+	std::unique_ptr<Block> block(new(std::nothrow) Block());
+	if(!block) return &m_fallbackBlock;
+
+	try {
+		Registry& registry = m_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		registry.blocks.push_back(block.get());
+	}
+	catch(...) {
+		return &m_fallbackBlock;
+	}
+
+	threadBlock.block = block.release();
+
+	return threadBlock.block;
+
+}
+
+void MathMetrics::m_add_block(Snapshot& snapshot, const Block& block) noexcept {
+
+	auto load = [](const Counter& counter) {
+		return counter.value.load(std::memory_order_relaxed);
+	};
+
+	for(size_t i = 0; i < NUM_ENGINES; i++) {
+		snapshot.evaluations[i] += load(block.evaluations[i]);
+	}
+
+	snapshot.resultCacheHits += load(block.resultCacheHits);
+	snapshot.resultCacheMisses += load(block.resultCacheMisses);
+	snapshot.nativeCacheHits += load(block.nativeCacheHits);
+	snapshot.nativeCacheMisses += load(block.nativeCacheMisses);
+
+	for(size_t i = 0; i < NUM_COMPILES; i++) {
+		Histogram& histogram = snapshot.compiles[i];
+
+		for(size_t bucket = 0; bucket <= COMPILE_BUCKETS; bucket++) {
+			uint64_t count = load(block.compileBuckets[i][bucket]);
+
+			histogram.buckets[bucket] += count;
+			histogram.count += count;
+		}
+
+		histogram.sum += load(block.compileNanoseconds[i]) * 1e-9;
+	}
+
+	for(size_t i = 0; i < NUM_REJECTIONS; i++) {
+		snapshot.rejections[i] += load(block.rejections[i]);
+	}
+
+}
@@ -0,0 +1,201 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef MATH_METRICS_H
+#define MATH_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <exception>
+
+
+class METRICS_WRITE_ERROR: public std::exception {
+
+public:
+	METRICS_WRITE_ERROR(const std::string& path) {
+		m_returnMessage = "Cannot write the metrics to " + path;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class MathMetrics {
+
+/*
+	Process-wide metrics of MathInterpreter and NativeModule, exported in the
+	OpenMetrics text format (the Prometheus exposition format):
+		- math_evaluations_total{engine}: calculations per engine. 
+		  calculate() counts one per call, the batch calculations one per row.
+		- math_result_cache_lookups_total{result}: hits and misses of the 
+		  result caches.
+		- math_native_cache_lookups_total{result}: NativeModule objects found
+		  in the cache on disk, or compiled.
+		- math_compile_seconds{kind}: histogram of the time spent preparing
+		  expressions for calculation (init_with_expr(), specialize() etc.)
+		  and compiling NativeModule objects.
+		- math_rejected_expressions_total{reason}: expressions init_with_expr()
+		  threw for.
+
+	How to use:
+		The library counts on its own. Scrape the metrics with one of:
+
+			e.g. std::string text = MathMetrics::to_openmetrics();
+
+			e.g. MathMetrics::write_file("/var/lib/node_exporter/math.prom");
+
+			e.g. char buffer[8192];
+				 size_t length = MathMetrics::write(buffer, sizeof(buffer));
+
+	Every thread counts in its own block of counters, which only that thread
+	writes, with plain relaxed loads and stores instead of atomic 
+	read-modify-writes, so that counting never contends with other threads.
+	Scraping sums the blocks of all threads, and the counts of the threads 
+	that have exited. The counters are atomic only so that scraping reads 
+	them safely while they change.
+*/
+
+public:
+	enum class Engine {
+		FIXED,        // fixed-size evaluators
+		PROGRAM,      // generic RPN loop
+		RESULT_CACHE, // result cache hits
+		BATCH,
+		DISTINCT,     // batch, calculated once per distinct row
+		FLOAT_MIXED,
+		FLOAT_SINGLE,
+		NATIVE
+	};
+
+	enum class Compile {
+		EXPRESSION,
+		NATIVE
+	};
+
+	enum class Rejection {
+		SYNTAX_ERROR,
+		UNKNOWN_EXPRESSION,
+		EMPTY
+	};
+
+	static const size_t NUM_ENGINES = 8;
+	static const size_t NUM_COMPILES = 2;
+	static const size_t NUM_REJECTIONS = 3;
+	static const size_t COMPILE_BUCKETS = 8;
+
+	// upper bounds of the compile time buckets, in seconds
+	static const double COMPILE_BUCKET_BOUNDS[COMPILE_BUCKETS];
+
+	struct Histogram {
+		std::array<uint64_t, COMPILE_BUCKETS + 1> buckets; // the last is +Inf
+		uint64_t count;
+		double sum;
+	};
+
+	struct Snapshot {
+		std::array<uint64_t, NUM_ENGINES> evaluations;
+		uint64_t resultCacheHits;
+		uint64_t resultCacheMisses;
+		uint64_t nativeCacheHits;
+		uint64_t nativeCacheMisses;
+		std::array<Histogram, NUM_COMPILES> compiles;
+		std::array<uint64_t, NUM_REJECTIONS> rejections;
+	};
+
+	static inline void count_evaluations(Engine engine, 
+		uint64_t numEvaluations) noexcept;
+	static inline void count_result_cache(bool isHit) noexcept;
+	static void count_native_cache(bool isHit) noexcept;
+	static void add_compile(Compile kind, double seconds) noexcept;
+	static void count_rejection(Rejection reason) noexcept;
+
+	static Snapshot snapshot();
+
+	static std::string to_openmetrics();
+	static size_t write(char* buffer, size_t size);
+	static void write_file(const std::string& path);
+
+	static const char* engine_name(Engine engine) noexcept;
+
+protected:
+	struct Counter {
+		std::atomic<uint64_t> value {0};
+
+		void add(uint64_t n) noexcept {
+			value.store(value.load(std::memory_order_relaxed) + n, 
+				std::memory_order_relaxed);
+		}
+	};
+
+	// counters of a thread
+	struct Block {
+		std::array<Counter, NUM_ENGINES> evaluations;
+		Counter resultCacheHits;
+		Counter resultCacheMisses;
+		Counter nativeCacheHits;
+		Counter nativeCacheMisses;
+		std::array<std::array<Counter, COMPILE_BUCKETS + 1>, NUM_COMPILES> 
+			compileBuckets;
+		std::array<Counter, NUM_COMPILES> compileNanoseconds;
+		std::array<Counter, NUM_REJECTIONS> rejections;
+	};
+
+	struct Registry;
+	struct ThreadBlock;
+
+	// counts the threads whose block could not be created, e.g. out of
+	// memory, since counting never throws. Shared by those threads, which
+	// may lose counts when they count at the same time
+	static Block m_fallbackBlock;
+
+	static inline Block& m_block() noexcept;
+	static Registry& m_registry();
+	static Block* m_register_thread() noexcept;
+	static void m_add_block(Snapshot& snapshot, const Block& block) noexcept;
+
+};
+
+MathMetrics::Block& MathMetrics::m_block() noexcept {
+
+	static thread_local Block* block = nullptr;
+
+	if(!block) block = m_register_thread();
+
+	return *block;
+
+}
+
+void MathMetrics::count_evaluations(Engine engine, 
+	uint64_t numEvaluations) noexcept {
+
+	m_block().evaluations[(size_t)engine].add(numEvaluations);
+
+}
+
+void MathMetrics::count_result_cache(bool isHit) noexcept {
+
+	Block& block = m_block();
+
+	if(isHit) block.resultCacheHits.add(1);
+	else block.resultCacheMisses.add(1);
+
+}
+
+#endif // !MATH_METRICS_H
@@ -0,0 +1,113 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef MATH_PROBES_H
+#define MATH_PROBES_H
+
+#include <cstdint>
+
+/*
+	Static user-level tracepoints (USDT probes) of MathInterpreter and 
+	NativeModule, for tracing with perf, bpftrace or SystemTap without 
+	rebuilding, e.g.
+
+		bpftrace -e 'usdt:./app:math_interpreter:cache_lookup_return 
+			{ @hits[arg0] = sum(arg1); }'
+
+		perf buildid-cache --add ./app
+		perf probe sdt_math_interpreter:compile_entry
+		perf record -e sdt_math_interpreter:compile_entry ./app
+
+	A probe is a single nop in the code, and a note in the .note.stapsdt 
+	section of the binary telling the tracer where the nop is and where to 
+	find its arguments. The notes are written the same way as sys/sdt.h does,
+	so that systemtap is not needed to build. Tracers replace the nop with a
+	breakpoint while tracing. The arguments are kept in registers or memory
+	for the tracer, which may cost a move or two around the nop.
+
+	The probes are defined on x86-64 and AArch64 ELF targets, with GCC or 
+	Clang, unless MATH_INTERPRETER_NO_PROBES is defined. Elsewhere they 
+	compile to nothing.
+
+	Probes of the provider math_interpreter, with their arguments. All 
+	arguments are 64-bit unsigned integers, and hash is the one of 
+	MathInterpreter::expression_hash():
+		lex_entry(hash, expression length)
+		lex_return(hash, number of tokens)
+		parse_entry(hash, number of tokens)
+		parse_return(hash, RPN length)
+		optimize_entry(hash, RPN length)
+		optimize_return(hash, RPN length after folding the constants)
+		compile_entry(hash, RPN length)
+		compile_return(hash, number of instructions)
+		cache_lookup_entry(hash, key length)
+		cache_lookup_return(hash, 1 if found, else 0)
+		batch_chunk_entry(hash, first row, number of rows)
+		batch_chunk_return(hash, first row, number of rows)
+		native_compile_entry(object hash, C source length)
+		native_compile_return(object hash, 1 if compiled, 0 if cached)
+
+	The object hash of NativeModule is the one in the file name of the 
+	compiled object.
+*/
+
+#if !defined(MATH_INTERPRETER_NO_PROBES) && defined(__ELF__) && \
+	(defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__aarch64__))
+
+#define MATH_PROBE_NOTE(name, args) \
+	"990: nop\n" \
+	".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+	".balign 4\n" \
+	".4byte 992f-991f, 994f-993f, 3\n" \
+	"991: .asciz \"stapsdt\"\n" \
+	"992: .balign 4\n" \
+	"993: .8byte 990b\n" \
+	".8byte _.stapsdt.base\n" \
+	".8byte 0\n" \
+	".asciz \"math_interpreter\"\n" \
+	".asciz \"" #name "\"\n" \
+	".asciz \"" args "\"\n" \
+	"994: .balign 4\n" \
+	".popsection\n" \
+	".ifndef _.stapsdt.base\n" \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n" \
+	".hidden _.stapsdt.base\n" \
+	"_.stapsdt.base: .space 1\n" \
+	".size _.stapsdt.base, 1\n" \
+	".popsection\n" \
+	".endif\n"
+
+#define MATH_PROBE1(name, arg1) \
+	__asm__ __volatile__(MATH_PROBE_NOTE(name, "8@%0") \
+		:: "nor"((uint64_t)(arg1)))
+
+#define MATH_PROBE2(name, arg1, arg2) \
+	__asm__ __volatile__(MATH_PROBE_NOTE(name, "8@%0 8@%1") \
+		:: "nor"((uint64_t)(arg1)), "nor"((uint64_t)(arg2)))
+
+#define MATH_PROBE3(name, arg1, arg2, arg3) \
+	__asm__ __volatile__(MATH_PROBE_NOTE(name, "8@%0 8@%1 8@%2") \
+		:: "nor"((uint64_t)(arg1)), "nor"((uint64_t)(arg2)), \
+		"nor"((uint64_t)(arg3)))
+
+#else
+
+#define MATH_PROBE1(name, arg1) do {} while(0)
+#define MATH_PROBE2(name, arg1, arg2) do {} while(0)
+#define MATH_PROBE3(name, arg1, arg2, arg3) do {} while(0)
+
+#endif
+
+#endif // !MATH_PROBES_H
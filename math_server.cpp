@@ -0,0 +1,100 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+/*
+	The evaluation server binary. See EvaluationServer in evaluation_server.h
+	for the protocol.
+
+	Usage: math_server SOCKET_PATH [--window-us N] [--max-batch-rows N]
+	                               [--workers N]
+
+	Runs until SIGINT or SIGTERM.
+*/
+
+#include <iostream>
+#include <exception>
+#include <string>
+#include <csignal>
+#include <cstdlib>
+
+#include "evaluation_server.h"
+
+static EvaluationServer* server = nullptr;
+
+static void stop_server(int) {
+
+	if(server) server->stop();
+
+}
+
+static void print_usage() {
+
+	std::cerr << "Usage: math_server SOCKET_PATH [--window-us N] "
+		"[--max-batch-rows N] [--workers N]" << std::endl;
+
+}
+
+int main(int argc, char* argv[]) {
+
+	if(argc < 2) {
+		print_usage();
+		return 2;
+	}
+
+	EvaluationServer::Config config;
+	config.socketPath = argv[1];
+
+	for(int i = 2; i < argc; i++) {
+		std::string option = argv[i];
+
+		if(i + 1 >= argc) {
+			print_usage();
+			return 2;
+		}
+
+		unsigned long long value = std::strtoull(argv[++i], nullptr, 10);
+
+		if(option == "--window-us") {
+			config.batchWindow = std::chrono::microseconds(value);
+		}
+		else if(option == "--max-batch-rows") {
+			config.maxBatchRows = value;
+		}
+		else if(option == "--workers") {
+			config.numWorkers = value;
+		}
+		else {
+			print_usage();
+			return 2;
+		}
+	}
+
+	try {
+		EvaluationServer evaluationServer(config);
+		server = &evaluationServer;
+
+		std::signal(SIGINT, stop_server);
+		std::signal(SIGTERM, stop_server);
+
+		evaluationServer.run();
+
+		server = nullptr;
+	}
+	catch(const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+
+}
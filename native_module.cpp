@@ -0,0 +1,511 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "native_module.h"
+#include "reproducible_math.h"
+#include "math_metrics.h"
+#include "math_probes.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NativeModule::NativeModule(const std::vector<const MathInterpreter*>& exprs,
+	const std::string& cacheDir, const std::string& compiler, 
+	const std::string& flags) {
+
+/*
+	exprs:    The initialized interpreters of the expressions to compile.
+	cacheDir: The directory of the compiled objects. Defaults to 
+	          $XDG_CACHE_HOME/math_interpreter, ~/.cache/math_interpreter or
+	          /tmp/math_interpreter. Objects are only loaded from a directory
+	          owned by the user and not writable by others; otherwise they 
+	          are compiled to a private temporary directory, removed with 
+	          the module.
+	compiler: The C compiler to run.
+	flags:    The flags given to the compiler, in addition to the ones needed
+	          to build a shared object.
+
+	Throws NATIVE_COMPILE_ERROR if the compiler fails or the compiled object
+	cannot be loaded.
+*/
+
+	std::string source;
+	bool isReproducible = false;
+
+	for(size_t i = 0; i < exprs.size(); i++) {
+		source += exprs[i]->to_c_source("math_expr_" + std::to_string(i));
+		source += "\n";
+
+		if(exprs[i]->is_reproducible()) isReproducible = true;
+	}
+
+	std::string allFlags = isReproducible ? flags + " -ffp-contract=off" : 
+		flags;
+
+	uint64_t sourceHash = m_hash(source + '\0' + compiler + '\0' + allFlags);
+
+	std::ostringstream hash;
+	hash << std::hex << std::setw(16) << std::setfill('0') << sourceHash;
+
+	std::string dir = cacheDir.empty() ? m_default_cache_dir() : cacheDir;
+	bool isPrivate;
+
+	try {
+		m_make_dirs(dir);
+		isPrivate = m_is_private_dir(dir);
+	}
+	catch(const NATIVE_COMPILE_ERROR&) {
+		isPrivate = false;
+	}
+
+	// another user could have put objects in the directory, so nothing is
+	// loaded from it
+	if(!isPrivate) {
+		dir = m_make_private_dir();
+		m_privateDir = dir;
+	}
+
+	try {
+		m_load(exprs, source, dir, hash.str(), sourceHash, compiler, 
+			allFlags, isReproducible);
+	}
+	catch(...) {
+		m_remove_private_dir();
+		throw;
+	}
+
+}
+
+void NativeModule::m_load(const std::vector<const MathInterpreter*>& exprs,
+	const std::string& source, const std::string& dir, 
+	const std::string& hash, uint64_t sourceHash, const std::string& compiler,
+	const std::string& flags, bool isReproducible) {
+
+/*
+	Loads the object of the source from the directory, compiling it first 
+	if it is not there yet, and gets the functions of the expressions.
+*/
+
+	m_libraryPath = dir + "/math_expr_" + hash + ".so";
+
+	MATH_PROBE2(native_compile_entry, sourceHash, source.size());
+
+	bool isCached = access(m_libraryPath.c_str(), R_OK) == 0;
+	MathMetrics::count_native_cache(isCached);
+
+	if(!isCached) {
+		auto start = std::chrono::steady_clock::now();
+
+		m_compile(source, compiler, flags);
+
+		MathMetrics::add_compile(MathMetrics::Compile::NATIVE, 
+			std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count());
+	}
+
+	MATH_PROBE2(native_compile_return, sourceHash, !isCached);
+
+	m_handle = dlopen(m_libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if(!m_handle) throw NATIVE_COMPILE_ERROR(dlerror());
+
+	if(isReproducible) m_bind_reproducible_math();
+
+	for(size_t i = 0; i < exprs.size(); i++) {
+		std::string funcName = "math_expr_" + std::to_string(i);
+
+		void* scalar = dlsym(m_handle, funcName.c_str());
+		void* batch = dlsym(m_handle, (funcName + "_batch").c_str());
+
+		if(!scalar || !batch) {
+			dlclose(m_handle);
+			throw NATIVE_COMPILE_ERROR("Missing symbol " + funcName + " in " +
+				m_libraryPath);
+		}
+
+		m_scalarFunctions.push_back((ScalarFunction)scalar);
+		m_batchFunctions.push_back((BatchFunction)batch);
+
+		m_exprs.push_back(*exprs[i]);
+		m_varNames.push_back(exprs[i]->variable_names());
+	}
+
+}
+
+NativeModule::~NativeModule() {
+
+	if(m_handle) dlclose(m_handle);
+
+	m_remove_private_dir();
+
+}
+
+size_t NativeModule::size() const noexcept {
+
+	return m_scalarFunctions.size();
+
+}
+
+NativeModule::ScalarFunction NativeModule::scalar_function(
+	size_t exprIndex) const {
+
+	return m_scalarFunctions.at(exprIndex);
+
+}
+
+NativeModule::BatchFunction NativeModule::batch_function(
+	size_t exprIndex) const {
+
+	return m_batchFunctions.at(exprIndex);
+
+}
+
+const std::string& NativeModule::library_path() const noexcept {
+
+	return m_libraryPath;
+
+}
+
+double NativeModule::calculate(size_t exprIndex, const double* vars) {
+
+/*
+	Same as scalar_function(exprIndex)(vars), checked against the reference
+	interpreter in the shadow mode.
+*/
+
+	double result = m_scalarFunctions.at(exprIndex)(vars);
+
+	MathMetrics::count_evaluations(MathMetrics::Engine::NATIVE, 1);
+
+	if(m_shadow && m_shadow->sample(ShadowSampler::Tier::NATIVE)) {
+		m_shadow_check(exprIndex, vars, result);
+	}
+
+	return result;
+
+}
+
+void NativeModule::calculate_batch(size_t exprIndex, 
+	const double* const* columns, size_t numRows, double* results) {
+
+/*
+	Same as batch_function(exprIndex)(columns, numRows, results), checked 
+	against the reference interpreter in the shadow mode.
+*/
+
+	m_batchFunctions.at(exprIndex)(columns, numRows, results);
+
+	MathMetrics::count_evaluations(MathMetrics::Engine::NATIVE, numRows);
+
+	if(!m_shadow) return;
+
+	std::vector<double> vars(m_varNames[exprIndex].size());
+
+	for(const auto& row: 
+		m_shadow->sample_rows(ShadowSampler::Tier::NATIVE, numRows)) {
+
+		for(size_t i = 0; i < vars.size(); i++) vars[i] = columns[i][row];
+
+		m_shadow_check(exprIndex, vars.data(), results[row]);
+	}
+
+}
+
+void NativeModule::set_shadow(const ShadowSampler::Config& config) {
+
+/*
+	Enables the shadow mode. Not safe to call while other threads calculate.
+*/
+
+	m_shadow = std::make_shared<ShadowSampler>(config);
+
+}
+
+void NativeModule::disable_shadow() noexcept {
+
+	m_shadow.reset();
+
+}
+
+ShadowSampler::Stats NativeModule::shadow_stats() const {
+
+	if(!m_shadow) return ShadowSampler::Stats {};
+
+	return m_shadow->stats();
+
+}
+
+void NativeModule::m_shadow_check(size_t exprIndex, const double* vars, 
+	double result) {
+
+/*
+	Calculates the expression again with its interpreter, and compares the
+	results. The interpreters are shared by all threads, hence the lock.
+*/
+
+	const std::vector<std::string>& varNames = m_varNames[exprIndex];
+	ShadowSampler::Inputs inputs;
+
+	for(size_t i = 0; i < varNames.size(); i++) {
+		inputs.emplace_back(varNames[i], vars[i]);
+	}
+
+	double expected;
+	std::string expression;
+
+	{
+		std::lock_guard<std::mutex> lock(m_shadowMutex);
+
+		MathInterpreter& expr = m_exprs[exprIndex];
+
+		for(const auto& input: inputs) expr.set_value(input.first, input.second);
+
+		expected = expr.calculate_reference();
+		expression = expr.expression();
+	}
+
+	m_shadow->check(ShadowSampler::Tier::NATIVE, expected, result, expression,
+		inputs);
+
+}
+
+std::string NativeModule::m_default_cache_dir() const {
+
+	const char* xdgCache = std::getenv("XDG_CACHE_HOME");
+	if(xdgCache && *xdgCache) return std::string(xdgCache) + "/math_interpreter";
+
+	const char* home = std::getenv("HOME");
+	if(home && *home) return std::string(home) + "/.cache/math_interpreter";
+
+	return "/tmp/math_interpreter";
+
+}
+
+void NativeModule::m_make_dirs(const std::string& path) const {
+
+/*
+	Creates the directory and its missing parents, like mkdir -p.
+*/
+
+	for(size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+		std::string dir = path.substr(0, pos);
+
+		if(mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+			throw NATIVE_COMPILE_ERROR("Cannot create the directory " + dir);
+		}
+
+		if(pos == std::string::npos) break;
+	}
+
+}
+
+bool NativeModule::m_is_private_dir(const std::string& path) const {
+
+/*
+	Returns whether the path is a directory, not a symbolic link, owned by 
+	the effective user and not writable by the group or others, so that no
+	other user can have put objects in it.
+*/
+
+	struct stat info;
+
+	if(lstat(path.c_str(), &info) != 0) return false;
+
+	return S_ISDIR(info.st_mode) && info.st_uid == geteuid() &&
+		!(info.st_mode & (S_IWGRP | S_IWOTH));
+
+}
+
+std::string NativeModule::m_make_private_dir() const {
+
+/*
+	Creates a new directory that only the user can access, under $TMPDIR or
+	/tmp.
+*/
+
+	const char* tmpDir = std::getenv("TMPDIR");
+
+	std::string path = std::string(tmpDir && *tmpDir ? tmpDir : "/tmp") + 
+		"/math_interpreter.XXXXXX";
+
+	if(!mkdtemp(&path[0])) {
+		throw NATIVE_COMPILE_ERROR("Cannot create a directory from " + path);
+	}
+
+	return path;
+
+}
+
+void NativeModule::m_remove_private_dir() noexcept {
+
+	if(m_privateDir.empty()) return;
+
+	std::remove(m_libraryPath.c_str());
+	rmdir(m_privateDir.c_str());
+
+	m_privateDir.clear();
+
+}
+
+void NativeModule::m_compile(const std::string& source, 
+	const std::string& compiler, const std::string& flags) const {
+
+/*
+	Compiles the source to m_libraryPath. The object is compiled under a 
+	temporary name and renamed when complete, so that other processes sharing
+	the cache never load a partially written object.
+*/
+
+	std::string tempPath = m_temp_path(m_libraryPath);
+	std::string sourcePath = tempPath + ".c";
+	std::string logPath = tempPath + ".log";
+
+	std::ofstream sourceFile(sourcePath);
+	sourceFile << source;
+	sourceFile.close();
+
+	if(!sourceFile) {
+		throw NATIVE_COMPILE_ERROR("Cannot write the source to " + sourcePath);
+	}
+
+	// the compiler and the flags are given as shell words, the paths are not
+	std::string command = compiler + " " + flags + " -shared -fPIC -o " + 
+		m_shell_quote(tempPath) + " " + m_shell_quote(sourcePath) + 
+		" -lm > " + m_shell_quote(logPath) + " 2>&1";
+
+	int status = std::system(command.c_str());
+
+	std::ifstream logFile(logPath);
+	std::string log((std::istreambuf_iterator<char>(logFile)),
+		std::istreambuf_iterator<char>());
+
+	std::remove(sourcePath.c_str());
+	std::remove(logPath.c_str());
+
+	if(status != 0) {
+		std::remove(tempPath.c_str());
+		throw NATIVE_COMPILE_ERROR(command + "\n" + log);
+	}
+
+	if(std::rename(tempPath.c_str(), m_libraryPath.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		throw NATIVE_COMPILE_ERROR("Cannot rename the compiled object to " +
+			m_libraryPath);
+	}
+
+}
+
+std::string NativeModule::m_temp_path(const std::string& path) {
+
+/*
+	Returns a name next to the path that no other call uses, in this process
+	(a counter) or in another one (the process id).
+*/
+
+	static std::atomic<uint64_t> counter(0);
+
+	return path + "." + std::to_string(getpid()) + "." + 
+		std::to_string(counter++);
+
+}
+
+std::string NativeModule::m_shell_quote(const std::string& str) {
+
+/*
+	Quotes the string as a single word for /bin/sh: in single quotes, with 
+	each single quote of the string written as '\''.
+*/
+
+	std::string quoted = "'";
+
+	for(char c: str) {
+		if(c == '\'') quoted += "'\\''";
+		else quoted += c;
+	}
+
+	return quoted + "'";
+
+}
+
+void NativeModule::m_bind_reproducible_math() {
+
+/*
+	Sets the function pointers of the reproducible C source to the functions
+	of ReproducibleMath.
+*/
+
+	struct Binding {
+		const char* name;
+		double (*function)(double);
+	};
+
+	const Binding bindings[] = {
+		{"math_reproducible_exp", &ReproducibleMath::exp},
+		{"math_reproducible_log", &ReproducibleMath::log},
+		{"math_reproducible_log10", &ReproducibleMath::log10},
+		{"math_reproducible_sin", &ReproducibleMath::sin},
+		{"math_reproducible_cos", &ReproducibleMath::cos},
+		{"math_reproducible_tan", &ReproducibleMath::tan},
+		{"math_reproducible_asin", &ReproducibleMath::asin},
+		{"math_reproducible_acos", &ReproducibleMath::acos},
+		{"math_reproducible_atan", &ReproducibleMath::atan}
+	};
+
+	for(const auto& binding: bindings) {
+		void* symbol = dlsym(m_handle, binding.name);
+
+		if(!symbol) {
+			dlclose(m_handle);
+			throw NATIVE_COMPILE_ERROR(std::string("Missing symbol ") + 
+				binding.name + " in " + m_libraryPath);
+		}
+
+		*(double (**)(double))symbol = binding.function;
+	}
+
+	void* powSymbol = dlsym(m_handle, "math_reproducible_pow");
+
+	if(!powSymbol) {
+		dlclose(m_handle);
+		throw NATIVE_COMPILE_ERROR("Missing symbol math_reproducible_pow in " +
+			m_libraryPath);
+	}
+
+	*(double (**)(double, double))powSymbol = &ReproducibleMath::pow;
+
+}
+
+uint64_t NativeModule::m_hash(const std::string& str) const noexcept {
+
+/*
+	64-bit FNV-1a.
+*/
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for(const auto& c: str) {
+		hash = (hash ^ (unsigned char)c) * 0x100000001B3ULL;
+	}
+
+	return hash;
+
+}
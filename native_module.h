@@ -0,0 +1,154 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef NATIVE_MODULE_H
+#define NATIVE_MODULE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <exception>
+
+#include "math_interpreter.h"
+
+
+class NATIVE_COMPILE_ERROR: public std::exception {
+
+public:
+	NATIVE_COMPILE_ERROR(const std::string& details) {
+		m_returnMessage = "Native compilation of the expressions failed: " + 
+			details;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class NativeModule {
+
+/*
+	Compiles a set of expressions to native code with the system C compiler,
+	and loads the result with dlopen(). POSIX only; link with -ldl on systems
+	where dlopen() is not part of libc.
+
+	The C source of all expressions goes to a single translation unit (see
+	MathInterpreter::to_c_source()). The compiled shared objects are cached on
+	disk, keyed by a hash of the source code, the compiler and the flags, so
+	that the compiler only runs the first time a set of expressions is seen.
+
+	How to use:
+		1. Initialize the interpreters as usual, and create a NativeModule 
+		   from them. This runs the compiler, or loads the cached object.
+
+			e.g. NativeModule module({&inter1, &inter2});
+
+		2. Get the functions of each expression by its position in the set.
+		   The variable values are given in the order of 
+		   MathInterpreter::variable_names().
+
+			e.g. NativeModule::ScalarFunction f = module.scalar_function(0);
+				 double vars[] = {37.81, 75.0};
+				 double result = f(vars);
+
+			e.g. NativeModule::BatchFunction g = module.batch_function(1);
+				 const double* columns[] = {xs.data(), ys.data()};
+				 g(columns, xs.size(), results.data());
+
+	The functions stay valid as long as the NativeModule exists.
+
+	calculate() and calculate_batch() call the same functions, count the
+	calculations in MathMetrics, and support the shadow mode (see 
+	set_shadow() and ShadowSampler), in which a sample of the results is 
+	compared with the reference interpreter.
+
+	If any of the interpreters is in the reproducible mode (see
+	MathInterpreter::set_reproducible()), the module is compiled with 
+	-ffp-contract=off, and its functions call the ones of ReproducibleMath, 
+	so that they give the same results as calculate().
+*/
+
+public:
+	using ScalarFunction = double (*)(const double* vars);
+	using BatchFunction = void (*)(const double* const* columns, 
+		size_t numRows, double* results);
+
+	NativeModule(const std::vector<const MathInterpreter*>& exprs,
+		const std::string& cacheDir = std::string(),
+		const std::string& compiler = "cc",
+		const std::string& flags = "-O3 -march=native");
+
+	NativeModule(const NativeModule&) = delete;
+	NativeModule& operator=(const NativeModule&) = delete;
+
+	size_t size() const noexcept;
+
+	ScalarFunction scalar_function(size_t exprIndex) const;
+	BatchFunction batch_function(size_t exprIndex) const;
+
+	const std::string& library_path() const noexcept;
+
+	double calculate(size_t exprIndex, const double* vars);
+	void calculate_batch(size_t exprIndex, const double* const* columns,
+		size_t numRows, double* results);
+
+	void set_shadow(const ShadowSampler::Config& config);
+	void disable_shadow() noexcept;
+	ShadowSampler::Stats shadow_stats() const;
+
+	virtual ~NativeModule();
+
+protected:
+	void* m_handle = nullptr;
+	std::string m_libraryPath;
+	std::string m_privateDir; // empty if the cache directory is used
+
+	std::vector<ScalarFunction> m_scalarFunctions;
+	std::vector<BatchFunction> m_batchFunctions;
+
+	// copies of the interpreters, for the reference results of the shadow 
+	// mode
+	std::vector<MathInterpreter> m_exprs;
+	std::vector<std::vector<std::string>> m_varNames;
+
+	std::shared_ptr<ShadowSampler> m_shadow;
+	std::mutex m_shadowMutex;
+
+	void m_load(const std::vector<const MathInterpreter*>& exprs,
+		const std::string& source, const std::string& dir, 
+		const std::string& hash, uint64_t sourceHash, 
+		const std::string& compiler, const std::string& flags, 
+		bool isReproducible);
+
+	std::string m_default_cache_dir() const;
+	void m_make_dirs(const std::string& path) const;
+	bool m_is_private_dir(const std::string& path) const;
+	std::string m_make_private_dir() const;
+	void m_remove_private_dir() noexcept;
+	void m_compile(const std::string& source, const std::string& compiler,
+		const std::string& flags) const;
+	static std::string m_temp_path(const std::string& path);
+	static std::string m_shell_quote(const std::string& str);
+	void m_bind_reproducible_math();
+	void m_shadow_check(size_t exprIndex, const double* vars, double result);
+
+	uint64_t m_hash(const std::string& str) const noexcept;
+
+};
+
+#endif // !NATIVE_MODULE_H
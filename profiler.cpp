@@ -0,0 +1,159 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+Profiler::Profiler(size_t period, const std::string& expression,
+	const std::vector<Site>& sites): 
+	m_period(std::max<size_t>(period, 1)), m_expression(expression), 
+	m_sites(sites), m_cycles(sites.size(), 0) {
+
+/*
+	period:     Every period-th calculation is sampled.
+	expression: The text of the expression.
+	sites:      The instructions of the program, in order.
+*/
+
+}
+
+size_t Profiler::period() const noexcept {
+
+	return m_period;
+
+}
+
+void Profiler::add_sample(const std::vector<uint64_t>& instructionCycles) {
+
+/*
+	Adds the cycles of each instruction of a sampled calculation.
+*/
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for(size_t i = 0; i < m_cycles.size(); i++) {
+		m_cycles[i] += instructionCycles[i];
+	}
+
+	m_samples++;
+
+}
+
+Profiler::Profile Profiler::profile() const {
+
+/*
+	Returns the self and total time of the subexpression of every instruction,
+	sorted by position in the expression text, the enclosing subexpressions
+	first.
+*/
+
+	std::vector<uint64_t> cycles;
+	Profile profile {m_expression, 0, 0, {}};
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		cycles = m_cycles;
+		profile.samples = m_samples;
+	}
+
+	// prefix sums, so that the total of the instructions first..i is 
+	// sums[i + 1] - sums[first]
+	std::vector<uint64_t> sums(cycles.size() + 1, 0);
+
+	for(size_t i = 0; i < cycles.size(); i++) sums[i + 1] = sums[i] + cycles[i];
+
+	profile.cycles = sums.back();
+
+	for(size_t i = 0; i < m_sites.size(); i++) {
+		const Site& site = m_sites[i];
+
+		Entry entry {site.label, site.span, std::string(), cycles[i], 
+			sums[i + 1] - sums[site.first], 0.0, 0.0};
+
+		if(site.span.begin < site.span.end && 
+			site.span.end <= m_expression.size()) {
+			entry.text = m_expression.substr(site.span.begin, 
+				site.span.end - site.span.begin);
+		}
+
+		if(profile.cycles) {
+			entry.selfPercent = 100.0 * entry.selfCycles / profile.cycles;
+			entry.totalPercent = 100.0 * entry.totalCycles / profile.cycles;
+		}
+
+		profile.entries.push_back(entry);
+	}
+
+	// the root of a subexpression comes after its operands in RPN, and 
+	// spans at least as much text
+	std::reverse(profile.entries.begin(), profile.entries.end());
+	std::stable_sort(profile.entries.begin(), profile.entries.end(),
+		[](const Entry& lhs, const Entry& rhs) {
+			if(lhs.span.begin != rhs.span.begin) {
+				return lhs.span.begin < rhs.span.begin;
+			}
+
+			return lhs.span.end > rhs.span.end;
+		});
+
+	return profile;
+
+}
+
+void Profiler::reset() {
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::fill(m_cycles.begin(), m_cycles.end(), 0);
+	m_samples = 0;
+
+}
+
+std::string Profiler::annotate(const Profile& profile, double minPercent) {
+
+/*
+	Returns the expression text, followed by a line per subexpression taking
+	at least minPercent of the time, underlining it in the text. Whitespace
+	in the text is shown as spaces, to keep the lines aligned.
+*/
+
+	std::string text = profile.expression;
+	std::replace_if(text.begin(), text.end(), 
+		[](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+
+	std::ostringstream oss;
+	oss << text << '\n';
+
+	if(!profile.cycles) return oss.str();
+
+	oss << std::fixed << std::setprecision(1);
+
+	for(const auto& entry: profile.entries) {
+		if(entry.totalPercent < minPercent) continue;
+		if(entry.span.end > text.size()) continue;
+
+		std::string line(text.size(), ' ');
+		std::fill(line.begin() + entry.span.begin, 
+			line.begin() + entry.span.end, '^');
+
+		oss << line << "  " << std::setw(5) << entry.totalPercent << "%  self " 
+			<< std::setw(5) << entry.selfPercent << "%  " << entry.label << '\n';
+	}
+
+	return oss.str();
+
+}
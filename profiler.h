@@ -0,0 +1,111 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+
+class Profiler {
+
+/*
+	Sampling profiler attributing the calculation time of an expression to the
+	parts of its text. Kept by MathInterpreter in the profiling mode, see 
+	MathInterpreter::set_profiling().
+
+	Every period-th calculation runs with each instruction of the program 
+	timed on its own, in cycles of the time stamp counter (see 
+	Instrumentation::cycles()). The cycles of an instruction are its self 
+	time. Each instruction calculates a subexpression, which takes the self
+	times of all the instructions calculating it: in RPN, the instructions 
+	from the first one of its first operand up to itself.
+
+	annotate() underlines the subexpressions in the expression text, with the
+	share of the time spent in each, e.g.
+
+		exp(sin($x$)) * $y$ + 1
+		^^^^^^^^^^^^^^^^^^^^^^^  100.0%  self  13.9%  +
+		^^^^^^^^^^^^^^^^^^^       75.3%  self  13.6%  *
+		^^^^^^^^^^^^^             50.6%  self  18.3%  exp
+		    ^^^^^^^^              32.3%  self  20.0%  sin
+		        ^^^               12.4%  self  12.4%  variable
+		                ^^^       11.0%  self  11.0%  variable
+		                      ^   10.9%  self  10.9%  number
+
+	The timings include the cost of reading the counter, tens of cycles per 
+	instruction, which is about what the numbers and variables show. Safe to 
+	use from multiple threads.
+*/
+
+public:
+	// offsets in the expression text, end excluded
+	struct Span {
+		size_t begin;
+		size_t end;
+	};
+
+	// an instruction of the program
+	struct Site {
+		std::string label;
+		Span span;    // of the subexpression calculated by the instruction
+		size_t first; // index of the first instruction of the subexpression
+	};
+
+	struct Entry {
+		std::string label;
+		Span span;
+		std::string text;
+		uint64_t selfCycles;
+		uint64_t totalCycles;
+		double selfPercent;
+		double totalPercent;
+	};
+
+	struct Profile {
+		std::string expression;
+		uint64_t samples;
+		uint64_t cycles;
+		std::vector<Entry> entries; // in the order of the expression text
+	};
+
+	Profiler(size_t period, const std::string& expression, 
+		const std::vector<Site>& sites);
+
+	size_t period() const noexcept;
+
+	void add_sample(const std::vector<uint64_t>& instructionCycles);
+
+	Profile profile() const;
+	void reset();
+
+	static std::string annotate(const Profile& profile, 
+		double minPercent = 1.0);
+
+	virtual ~Profiler() = default;
+
+protected:
+	size_t m_period;
+	std::string m_expression;
+	std::vector<Site> m_sites;
+
+	mutable std::mutex m_mutex;
+	uint64_t m_samples = 0;
+	std::vector<uint64_t> m_cycles; // per instruction
+
+};
+
+#endif // !PROFILER_H
@@ -0,0 +1,792 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "reproducible_math.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#error "ReproducibleMath needs double operations rounded to double."
+#endif
+
+// the compiler must not fuse multiplications and additions of this file
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace {
+
+const double INF = std::numeric_limits<double>::infinity();
+const double NAN_VALUE = std::numeric_limits<double>::quiet_NaN();
+
+const double LN2_HI = 6.93147180369123816490e-01;
+const double LN2_LO = 1.90821492927058770002e-10;
+const double INV_LN2 = 1.44269504088896338700e+00;
+const double INV_LN10 = 4.34294481903251816668e-01;
+const double INV_LN10_LO = 1.09831965021676510e-17;
+
+const double EXP_OVERFLOW = 7.09782712893383973096e+02;
+const double EXP_UNDERFLOW = -7.45133219101941108420e+02;
+
+const double EXP_P[] = {1.66666666666666019037e-01, -2.77777777770155933842e-03,
+	6.61375632143793436117e-05, -1.65339022054652515390e-06,
+	4.13813679705723846039e-08};
+
+const double LOG_LG[] = {6.666666666666735130e-01, 3.999999999940941908e-01,
+	2.857142874366239149e-01, 2.222219843214978396e-01, 
+	1.818357216161805012e-01, 1.531383769920937332e-01,
+	1.479819860511658591e-01};
+
+const double SIN_S[] = {-1.66666666666666324348e-01, 8.33333333332248946124e-03,
+	-1.98412698298579493134e-04, 2.75573137070700676789e-06,
+	-2.50507602534068634195e-08, 1.58969099521155010221e-10};
+
+const double COS_C[] = {4.16666666666666019037e-02, -1.38888888888741095749e-03,
+	2.48015872894767294178e-05, -2.75573143513906633035e-07,
+	2.08757232129817482790e-09, -1.13596475577881948265e-11};
+
+// pi/2 in three parts, the first two with 33 significant bits each
+const double PIO2_1 = 1.57079632673412561417e+00;
+const double PIO2_2 = 6.07710050630396597660e-11;
+const double PIO2_2T = 2.02226624879595063154e-21;
+const double INV_PIO2 = 6.36619772367581382433e-01;
+const double PIO4 = 7.85398163397448278999e-01;
+
+// (2^20 - 1/2) * pi/2, from where n * PIO2_1 and n * PIO2_2 may be inexact
+const double REDUCE_MEDIUM_MAX = 1.64709854376712208614e+06;
+
+// 2/pi in chunks of 24 bits, enough for the largest doubles
+const int32_t TWO_OVER_PI[] = {
+	0xA2F983, 0x6E4E44, 0x1529FC, 0x2757D1, 0xF534DD, 0xC0DB62,
+	0x95993C, 0x439041, 0xFE5163, 0xABDEBB, 0xC561B7, 0x246E3A,
+	0x424DD2, 0xE00649, 0x2EEA09, 0xD1921C, 0xFE1DEB, 0x1CB129,
+	0xA73EE8, 0x8235F5, 0x2EBB44, 0x84E99C, 0x7026B4, 0x5F7E41,
+	0x3991D6, 0x398353, 0x39F49C, 0x845F8B, 0xBDF928, 0x3B1FF8,
+	0x97FFDE, 0x05980F, 0xEF2F11, 0x8B5A0A, 0x6D1F6D, 0x367ECF,
+	0x27CB09, 0xB74F46, 0x3F669E, 0x5FEA2D, 0x7527BA, 0xC7EBE5,
+	0xF17B3D, 0x0739F7, 0x8A5292, 0xEA6BFB, 0x5FB11F, 0x8D5D08,
+	0x560330, 0x46FC7B, 0x6BABF0, 0xCFBC20, 0x9AF436, 0x1DA9E3,
+	0x91615E, 0xE61B08, 0x659985, 0x5F14A0, 0x68408D, 0xFFD880,
+	0x4D7327, 0x310606, 0x1556CA, 0x73A8C9, 0x60E27B, 0xC08C6B};
+
+// pi/2 in chunks of 24 bits
+const double PIO2_CHUNKS[] = {1.57079625129699707031e+00, 
+	7.54978941586159635335e-08, 5.39030252995776476554e-15,
+	3.28200341580791294123e-22, 1.27065575308067607349e-29,
+	1.22933308981111328932e-36, 2.73370053816464559624e-44,
+	2.16741683877804819444e-51};
+
+const double TWO_24 = 1.67772160000000000000e+07;
+const double TWO_MINUS_24 = 5.96046447753906250000e-08;
+
+const double ATAN_HI[] = {4.63647609000806093515e-01, 7.85398163397448278999e-01,
+	9.82793723247329054082e-01, 1.57079632679489655800e+00};
+const double ATAN_LO[] = {2.26987774529616870924e-17, 3.06161699786838301793e-17,
+	1.39033110312309984516e-17, 6.12323399573676603587e-17};
+const double ATAN_T[] = {3.33333333333329318027e-01, -1.99999999998764832476e-01,
+	1.42857142725034663711e-01, -1.11111104054623557880e-01,
+	9.09088713343650656196e-02, -7.69187620504482999495e-02,
+	6.66107313738753120669e-02, -5.83357013379057348645e-02,
+	4.97687799461593236017e-02, -3.65315727442169155270e-02,
+	1.62858201153657823623e-02};
+
+uint64_t to_bits(double x) {
+
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+
+	return bits;
+
+}
+
+double from_bits(uint64_t bits) {
+
+	double x;
+	std::memcpy(&x, &bits, sizeof(x));
+
+	return x;
+
+}
+
+} // namespace
+
+double ReproducibleMath::exp(double x) noexcept {
+
+	if(x != x) return x;
+	if(x > EXP_OVERFLOW) return INF;
+	if(x < EXP_UNDERFLOW) return 0.0;
+
+	return m_exp_dd(x, 0.0);
+
+}
+
+double ReproducibleMath::log(double x) noexcept {
+
+	DoubleDouble result = m_log_dd(x);
+
+	return result.hi + result.lo;
+
+}
+
+double ReproducibleMath::log10(double x) noexcept {
+
+	DoubleDouble ln = m_log_dd(x);
+
+	if(ln.lo == 0.0 || ln.hi != ln.hi) return ln.hi * INV_LN10;
+
+	DoubleDouble product = m_two_product(ln.hi, INV_LN10);
+
+	return product.hi + (product.lo + (ln.lo * INV_LN10 + 
+		ln.hi * INV_LN10_LO));
+
+}
+
+double ReproducibleMath::pow(double x, double y) noexcept {
+
+/*
+	Follows C99 for the special cases. Otherwise calculates exp(y*log(x)), 
+	with log(x) and the product in double-double precision, so that the error
+	of log(x) is not magnified by y.
+*/
+
+	if(y == 0.0 || x == 1.0) return 1.0;
+	if(x != x || y != y) return NAN_VALUE;
+
+	double absX = std::fabs(x);
+
+	if(std::fabs(y) == INF) {
+		if(absX == 1.0) return 1.0;
+
+		return (absX < 1.0) == (y > 0.0) ? 0.0 : INF;
+	}
+
+	bool yIsInt = std::floor(y) == y;
+	bool yIsOdd = yIsInt && std::fmod(y, 2.0) != 0.0;
+
+	if(x == 0.0 || absX == INF) {
+		// 1/x turns +-0 into +-inf and back
+		double result = (x == 0.0) == (y < 0.0) ? INF : 0.0;
+
+		return yIsOdd && std::signbit(x) ? -result : result;
+	}
+
+	if(x < 0.0 && !yIsInt) return NAN_VALUE;
+
+	DoubleDouble ln = m_log_dd(absX);
+	double result;
+
+	double z = y * ln.hi;
+
+	if(z > 2 * EXP_OVERFLOW) result = INF;
+	else if(z < 2 * EXP_UNDERFLOW) result = 0.0;
+	else {
+		DoubleDouble product = m_two_product(y, ln.hi);
+		DoubleDouble sum = m_two_sum(product.hi, product.lo + y * ln.lo);
+
+		if(sum.hi > EXP_OVERFLOW) result = INF;
+		else if(sum.hi < EXP_UNDERFLOW) result = 0.0;
+		else result = m_exp_dd(sum.hi, sum.lo);
+	}
+
+	return x < 0.0 && yIsOdd ? -result : result;
+
+}
+
+double ReproducibleMath::sin(double x) noexcept {
+
+	if(std::fabs(x) == INF || x != x) return NAN_VALUE;
+
+	double hi, lo;
+
+	switch(m_reduce(x, hi, lo)) {
+		case 0:
+			return m_kernel_sin(hi, lo);
+		case 1:
+			return m_kernel_cos(hi, lo);
+		case 2:
+			return -m_kernel_sin(hi, lo);
+		default:
+			return -m_kernel_cos(hi, lo);
+	}
+
+}
+
+double ReproducibleMath::cos(double x) noexcept {
+
+	if(std::fabs(x) == INF || x != x) return NAN_VALUE;
+
+	double hi, lo;
+
+	switch(m_reduce(x, hi, lo)) {
+		case 0:
+			return m_kernel_cos(hi, lo);
+		case 1:
+			return -m_kernel_sin(hi, lo);
+		case 2:
+			return -m_kernel_cos(hi, lo);
+		default:
+			return m_kernel_sin(hi, lo);
+	}
+
+}
+
+double ReproducibleMath::tan(double x) noexcept {
+
+	if(std::fabs(x) == INF || x != x) return NAN_VALUE;
+
+	double hi, lo;
+	int quadrant = m_reduce(x, hi, lo);
+
+	double sinVal = m_kernel_sin(hi, lo);
+	double cosVal = m_kernel_cos(hi, lo);
+
+	return quadrant % 2 == 0 ? sinVal / cosVal : -cosVal / sinVal;
+
+}
+
+double ReproducibleMath::asin(double x) noexcept {
+
+	double absX = std::fabs(x);
+
+	if(absX > 1.0 || x != x) return NAN_VALUE;
+	if(absX == 1.0) return x * ATAN_HI[3] + x * ATAN_LO[3];
+
+	return atan(x / std::sqrt((1.0 - x) * (1.0 + x)));
+
+}
+
+double ReproducibleMath::acos(double x) noexcept {
+
+	if(std::fabs(x) > 1.0 || x != x) return NAN_VALUE;
+	if(x == -1.0) return 2.0 * ATAN_HI[3] + 2.0 * ATAN_LO[3];
+
+	return 2.0 * atan(std::sqrt((1.0 - x) / (1.0 + x)));
+
+}
+
+double ReproducibleMath::atan(double x) noexcept {
+
+/*
+	Reduces |x| to one of five intervals around 0, 0.5, 1, 1.5 and infinity,
+	using atan(x) = atan(c) + atan((x - c)/(1 + x*c)).
+*/
+
+	if(x != x) return x;
+
+	double absX = std::fabs(x);
+	double sign = x < 0.0 ? -1.0 : 1.0;
+
+	if(absX >= 7.3786976294838206464e19) { // 2^66
+		return sign * ATAN_HI[3] + sign * ATAN_LO[3];
+	}
+
+	if(absX < 3.7252902984e-09) return x; // 2^-28
+
+	int interval;
+
+	if(absX < 0.4375) interval = -1;
+	else if(absX < 0.6875) {
+		interval = 0;
+		absX = (2.0 * absX - 1.0) / (2.0 + absX);
+	}
+	else if(absX < 1.1875) {
+		interval = 1;
+		absX = (absX - 1.0) / (absX + 1.0);
+	}
+	else if(absX < 2.4375) {
+		interval = 2;
+		absX = (absX - 1.5) / (1.0 + 1.5 * absX);
+	}
+	else {
+		interval = 3;
+		absX = -1.0 / absX;
+	}
+
+	double z = absX * absX;
+	double w = z * z;
+
+	double s1 = z * (ATAN_T[0] + w * (ATAN_T[2] + w * (ATAN_T[4] + 
+		w * (ATAN_T[6] + w * (ATAN_T[8] + w * ATAN_T[10])))));
+	double s2 = w * (ATAN_T[1] + w * (ATAN_T[3] + w * (ATAN_T[5] + 
+		w * (ATAN_T[7] + w * ATAN_T[9]))));
+
+	if(interval < 0) return sign * (absX - absX * (s1 + s2));
+
+	double result = ATAN_HI[interval] - 
+		((absX * (s1 + s2) - ATAN_LO[interval]) - absX);
+
+	return sign * result;
+
+}
+
+ReproducibleMath::DoubleDouble ReproducibleMath::m_log_dd(
+	double x) noexcept {
+
+/*
+	Natural logarithm as an unevaluated sum hi + lo, with a relative error of
+	about 2^-57. x is split into 2^k * m with sqrt(2)/2 <= m < sqrt(2), and
+	log(m) = log(1 + f) = 2s + s*R(s), s = f/(2 + f).
+*/
+
+	if(x != x) return DoubleDouble {x, 0.0};
+	if(x < 0.0) return DoubleDouble {NAN_VALUE, 0.0};
+	if(x == 0.0) return DoubleDouble {-INF, 0.0};
+	if(x == INF) return DoubleDouble {INF, 0.0};
+
+	int k = 0;
+
+	if(x < DBL_MIN) {
+		x *= 18014398509481984.0; // 2^54
+		k -= 54;
+	}
+
+	uint64_t bits = to_bits(x);
+	uint32_t high = (uint32_t)(bits >> 32);
+
+	k += (int)(high >> 20) - 1023;
+	high &= 0x000FFFFF;
+
+	// exponent of m: 0 if the mantissa is below sqrt(2), -1 otherwise
+	uint32_t carry = (high + 0x95F64) & 0x100000;
+	high |= carry ^ 0x3FF00000;
+	k += (int)(carry >> 20);
+
+	double m = from_bits(((uint64_t)high << 32) | (bits & 0xFFFFFFFFULL));
+	double f = m - 1.0;
+	double dk = k;
+
+	// s in double-double precision, since log(m) = 2s + s*R(s) is dominated
+	// by the error of 2s
+	DoubleDouble divisor = m_two_sum(2.0, f);
+	double s = f / divisor.hi;
+
+	DoubleDouble product = m_two_product(s, divisor.hi);
+	double sLo = (((f - product.hi) - product.lo) - s * divisor.lo) / 
+		divisor.hi;
+
+	double z = s * s;
+	double w = z * z;
+
+	double t1 = w * (LOG_LG[1] + w * (LOG_LG[3] + w * LOG_LG[5]));
+	double t2 = z * (LOG_LG[0] + w * (LOG_LG[2] + w * (LOG_LG[4] + 
+		w * LOG_LG[6])));
+	double r = t2 + t1;
+
+	double lo = (2.0 * sLo + s * r) + dk * LN2_LO;
+
+	DoubleDouble result = m_two_sum(dk * LN2_HI, 2.0 * s);
+
+	return m_two_sum(result.hi, result.lo + lo);
+
+}
+
+double ReproducibleMath::m_exp_dd(double hi, double lo) noexcept {
+
+/*
+	exp(hi + lo) for EXP_UNDERFLOW <= hi <= EXP_OVERFLOW and |lo| much smaller
+	than |hi|. hi + lo is reduced to k*ln(2) + r with |r| <= ln(2)/2, and
+	exp(r) = 1 + 2r/(2 - R(r)), with R(r) from a minimax polynomial.
+*/
+
+	int k = 0;
+	double rHi = hi;
+	double rLo = -lo;
+
+	if(std::fabs(hi) > 0.5 * LN2_HI) {
+		k = (int)(INV_LN2 * hi + (hi < 0.0 ? -0.5 : 0.5));
+
+		double dk = k;
+		rHi = hi - dk * LN2_HI;
+		rLo = dk * LN2_LO - lo;
+	}
+
+	double r = rHi - rLo;
+	double t = r * r;
+	double c = r - t * (EXP_P[0] + t * (EXP_P[1] + t * (EXP_P[2] + 
+		t * (EXP_P[3] + t * EXP_P[4]))));
+
+	double result = 1.0 - ((rLo - (r * c) / (2.0 - c)) - rHi);
+
+	return m_scale(result, k);
+
+}
+
+double ReproducibleMath::m_scale(double x, int exponent) noexcept {
+
+/*
+	x * 2^exponent, rounded once even if the result is subnormal.
+*/
+
+	const double twoTo1023 = from_bits(0x7FE0000000000000ULL);
+	const double twoToMinus969 = from_bits(0x0360000000000000ULL);
+
+	if(exponent > 1023) {
+		x *= twoTo1023;
+		exponent -= 1023;
+
+		if(exponent > 1023) exponent = 1023;
+	}
+	else if(exponent < -1022) {
+		x *= twoToMinus969;
+		exponent += 969;
+
+		if(exponent < -1022) {
+			x *= twoToMinus969;
+			exponent += 969;
+
+			if(exponent < -1022) exponent = -1022;
+		}
+	}
+
+	return x * from_bits((uint64_t)(0x3FF + exponent) << 52);
+
+}
+
+int ReproducibleMath::m_reduce(double x, double& hi, double& lo) noexcept {
+
+/*
+	Reduces x to hi + lo = x - n*pi/2 with |hi + lo| <= pi/4 and returns n 
+	mod 4. n*PIO2_1 and n*PIO2_2 are exact for |n| < 2^20, larger arguments
+	are reduced by m_reduce_large().
+*/
+
+	double absX = std::fabs(x);
+
+	if(absX <= PIO4) {
+		hi = x;
+		lo = 0.0;
+
+		return 0;
+	}
+
+	if(absX >= REDUCE_MEDIUM_MAX) return m_reduce_large(x, hi, lo);
+
+	double n = std::floor(absX * INV_PIO2 + 0.5);
+
+	DoubleDouble remainder = m_two_sum(absX - n * PIO2_1, -(n * PIO2_2));
+	DoubleDouble reduced = m_two_sum(remainder.hi, 
+		remainder.lo - n * PIO2_2T);
+
+	int quadrant = (int)std::fmod(n, 4.0);
+
+	if(x < 0.0) {
+		hi = -reduced.hi;
+		lo = -reduced.lo;
+
+		return (4 - quadrant) % 4;
+	}
+
+	hi = reduced.hi;
+	lo = reduced.lo;
+
+	return quadrant;
+
+}
+
+int ReproducibleMath::m_reduce_large(double x, double& hi, 
+	double& lo) noexcept {
+
+/*
+	Same as m_reduce(), for finite x of any size (Payne-Hanek, fdlibm's 
+	__kernel_rem_pio2). x is an integer times 2^e0 with 3 digits of 24 bits. 
+	Only the bits of 2/pi around 2^-e0 matter for the fraction of x * 2/pi:
+	the earlier ones give multiples of 4 (whole turns), and the later ones
+	are too small. So x is multiplied by a window of TWO_OVER_PI that starts
+	at those bits, digit by digit, and the window is widened until the 
+	fraction is known to 53 bits despite cancellation.
+*/
+
+	const int NUM_TERMS = 4; // digits of the product, beyond the first
+
+	uint64_t bits = to_bits(std::fabs(x));
+	int32_t highWord = (int32_t)(bits >> 32);
+
+	// |x| = z * 2^e0 with 2^23 <= z < 2^24, split into digits of 24 bits
+	int e0 = (highWord >> 20) - 1046;
+	double z = from_bits(((uint64_t)(highWord - (e0 << 20)) << 32) | 
+		(bits & 0xFFFFFFFFULL));
+
+	double digits[3];
+
+	for(int i = 0; i < 2; i++) {
+		digits[i] = (double)(int32_t)z;
+		z = (z - digits[i]) * TWO_24;
+	}
+
+	digits[2] = z;
+
+	int numDigits = 3;
+	while(digits[numDigits - 1] == 0.0) numDigits--;
+
+	int lastDigit = numDigits - 1;
+	int window = (e0 - 3) / 24;
+	if(window < 0) window = 0;
+	int q0 = e0 - 24 * (window + 1); // exponent of the last digit of q
+
+	double f[20] = {}, q[20] = {}, fq[20] = {};
+	int32_t iq[20];
+
+	// the digits of 2/pi in the window, and the product with x
+	for(int i = 0, j = window - lastDigit; i <= lastDigit + NUM_TERMS; 
+		i++, j++) {
+		f[i] = j < 0 ? 0.0 : (double)TWO_OVER_PI[j];
+	}
+
+	for(int i = 0; i <= NUM_TERMS; i++) {
+		double sum = 0.0;
+
+		for(int j = 0; j <= lastDigit; j++) {
+			sum += digits[j] * f[lastDigit + i - j];
+		}
+
+		q[i] = sum;
+	}
+
+	int numTerms = NUM_TERMS;
+	int n;
+	int ih;
+
+	while(true) {
+		// distill q into digits iq of 24 bits, and the integer part n
+		int i = 0;
+		z = q[numTerms];
+
+		for(int j = numTerms; j > 0; i++, j--) {
+			double high = (double)(int32_t)(TWO_MINUS_24 * z);
+			iq[i] = (int32_t)(z - TWO_24 * high);
+			z = q[j - 1] + high;
+		}
+
+		z = m_scale(z, q0);
+		z -= 8.0 * std::floor(z * 0.125);
+		n = (int32_t)z;
+		z -= (double)n;
+
+		// ih > 0 if the fraction is at least 0.5, then q is made 1 - q
+		ih = 0;
+
+		if(q0 > 0) {
+			i = iq[numTerms - 1] >> (24 - q0);
+			n += i;
+			iq[numTerms - 1] -= i << (24 - q0);
+			ih = iq[numTerms - 1] >> (23 - q0);
+		}
+		else if(q0 == 0) {
+			ih = iq[numTerms - 1] >> 23;
+		}
+		else if(z >= 0.5) {
+			ih = 2;
+		}
+
+		if(ih > 0) {
+			n += 1;
+			int carry = 0;
+
+			for(i = 0; i < numTerms; i++) {
+				int32_t digit = iq[i];
+
+				if(carry == 0) {
+					if(digit != 0) {
+						carry = 1;
+						iq[i] = 0x1000000 - digit;
+					}
+				}
+				else {
+					iq[i] = 0xFFFFFF - digit;
+				}
+			}
+
+			if(q0 == 1) iq[numTerms - 1] &= 0x7FFFFF;
+			else if(q0 == 2) iq[numTerms - 1] &= 0x3FFFFF;
+
+			if(ih == 2) {
+				z = 1.0 - z;
+				if(carry != 0) z -= m_scale(1.0, q0);
+			}
+		}
+
+		if(z != 0.0) break;
+
+		// the fraction cancelled out so far: widen the window if the 
+		// digits below the first terms are all zero
+		int32_t lowDigits = 0;
+		for(i = numTerms - 1; i >= NUM_TERMS; i--) lowDigits |= iq[i];
+
+		if(lowDigits != 0) break;
+
+		int k = 1;
+		while(iq[NUM_TERMS - k] == 0) k++;
+
+		for(i = numTerms + 1; i <= numTerms + k; i++) {
+			f[lastDigit + i] = (double)TWO_OVER_PI[window + i];
+
+			double sum = 0.0;
+
+			for(int j = 0; j <= lastDigit; j++) {
+				sum += digits[j] * f[lastDigit + i - j];
+			}
+
+			q[i] = sum;
+		}
+
+		numTerms += k;
+	}
+
+	// chop off the zero digits of the fraction
+	if(z == 0.0) {
+		numTerms -= 1;
+		q0 -= 24;
+
+		while(iq[numTerms] == 0) {
+			numTerms--;
+			q0 -= 24;
+		}
+	}
+	else {
+		z = m_scale(z, -q0);
+
+		if(z >= TWO_24) {
+			double high = (double)(int32_t)(TWO_MINUS_24 * z);
+			iq[numTerms] = (int32_t)(z - TWO_24 * high);
+			numTerms += 1;
+			q0 += 24;
+			iq[numTerms] = (int32_t)high;
+		}
+		else {
+			iq[numTerms] = (int32_t)z;
+		}
+	}
+
+	// the fraction as doubles, times pi/2
+	double scale = m_scale(1.0, q0);
+
+	for(int i = numTerms; i >= 0; i--) {
+		q[i] = scale * (double)iq[i];
+		scale *= TWO_MINUS_24;
+	}
+
+	for(int i = numTerms; i >= 0; i--) {
+		double sum = 0.0;
+
+		for(int k = 0; k <= NUM_TERMS && k <= numTerms - i; k++) {
+			sum += PIO2_CHUNKS[k] * q[i + k];
+		}
+
+		fq[numTerms - i] = sum;
+	}
+
+	double sum = 0.0;
+	for(int i = numTerms; i >= 0; i--) sum += fq[i];
+
+	double tail = fq[0] - sum;
+	for(int i = 1; i <= numTerms; i++) tail += fq[i];
+
+	if(ih != 0) {
+		sum = -sum;
+		tail = -tail;
+	}
+
+	if(x < 0.0) {
+		hi = -sum;
+		lo = -tail;
+
+		return (4 - (n & 3)) & 3;
+	}
+
+	hi = sum;
+	lo = tail;
+
+	return n & 3;
+
+}
+
+double ReproducibleMath::m_kernel_sin(double x, double tail) noexcept {
+
+/*
+	sin(x + tail) for |x + tail| <= pi/4.
+*/
+
+	double z = x * x;
+	double v = z * x;
+	double r = SIN_S[1] + z * (SIN_S[2] + z * (SIN_S[3] + z * (SIN_S[4] + 
+		z * SIN_S[5])));
+
+	return x - ((z * (0.5 * tail - v * r) - tail) - v * SIN_S[0]);
+
+}
+
+double ReproducibleMath::m_kernel_cos(double x, double tail) noexcept {
+
+/*
+	cos(x + tail) for |x + tail| <= pi/4.
+*/
+
+	double z = x * x;
+	double w = z * z;
+	double r = z * (COS_C[0] + z * (COS_C[1] + z * COS_C[2])) + 
+		w * w * (COS_C[3] + z * (COS_C[4] + z * COS_C[5]));
+
+	double halfZ = 0.5 * z;
+	w = 1.0 - halfZ;
+
+	return w + (((1.0 - w) - halfZ) + (z * r - x * tail));
+
+}
+
+ReproducibleMath::DoubleDouble ReproducibleMath::m_two_sum(double a, 
+	double b) noexcept {
+
+/*
+	a + b exactly, as the rounded sum and its rounding error.
+*/
+
+	double sum = a + b;
+	double bVirtual = sum - a;
+	double error = (a - (sum - bVirtual)) + (b - bVirtual);
+
+	return DoubleDouble {sum, error};
+
+}
+
+ReproducibleMath::DoubleDouble ReproducibleMath::m_two_product(double a, 
+	double b) noexcept {
+
+/*
+	a * b exactly, as the rounded product and its rounding error. Splits the
+	factors into halves of 26 bits (Dekker), since a fused multiply-add is not
+	available everywhere.
+*/
+
+	const double splitter = 134217729.0; // 2^27 + 1
+
+	double aSplit = splitter * a;
+	double aHi = aSplit - (aSplit - a);
+	double aLo = a - aHi;
+
+	double bSplit = splitter * b;
+	double bHi = bSplit - (bSplit - b);
+	double bLo = b - bHi;
+
+	double product = a * b;
+	double error = ((aHi * bHi - product) + aHi * bLo + aLo * bHi) + 
+		aLo * bLo;
+
+	return DoubleDouble {product, error};
+
+}
@@ -0,0 +1,74 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef REPRODUCIBLE_MATH_H
+#define REPRODUCIBLE_MATH_H
+
+
+class ReproducibleMath {
+
+/*
+	Elementary functions that give bitwise identical results on every host.
+
+	The results of the standard library functions depend on the library and on
+	the instruction set it was built for. These are calculated only with 
+	additions, subtractions, multiplications, divisions and square roots, which
+	IEEE 754 defines exactly, in a fixed order and without fused multiply-adds.
+	The algorithms and coefficients are those of fdlibm, which is also behind
+	Java's StrictMath. Arguments of sin(), cos() and tan() beyond 2^20 * pi/2
+	are reduced to [-pi/4, pi/4] with the bits of 2/pi they need (Payne-
+	Hanek), so that they stay accurate for every double. The results are 
+	within 1-2 ulp of the exact ones, except for:
+		- pow() of results close to the overflow or underflow limits, whose
+		  error grows with |y*log(x)| up to a few dozen ulp.
+	These results are still reproducible.
+
+	Requires double operations to be rounded to double (FLT_EVAL_METHOD == 0),
+	as with SSE2 on x86 and on every 64-bit target.
+*/
+
+public:
+	static double exp(double x) noexcept;
+	static double log(double x) noexcept;
+	static double log10(double x) noexcept;
+	static double pow(double x, double y) noexcept;
+
+	static double sin(double x) noexcept;
+	static double cos(double x) noexcept;
+	static double tan(double x) noexcept;
+
+	static double asin(double x) noexcept;
+	static double acos(double x) noexcept;
+	static double atan(double x) noexcept;
+
+protected:
+	struct DoubleDouble {
+		double hi;
+		double lo;
+	};
+
+	static DoubleDouble m_log_dd(double x) noexcept;
+	static double m_exp_dd(double hi, double lo) noexcept;
+	static double m_scale(double x, int exponent) noexcept;
+
+	static int m_reduce(double x, double& hi, double& lo) noexcept;
+	static int m_reduce_large(double x, double& hi, double& lo) noexcept;
+	static double m_kernel_sin(double x, double tail) noexcept;
+	static double m_kernel_cos(double x, double tail) noexcept;
+
+	static DoubleDouble m_two_sum(double a, double b) noexcept;
+	static DoubleDouble m_two_product(double a, double b) noexcept;
+
+};
+
+#endif // !REPRODUCIBLE_MATH_H
@@ -0,0 +1,178 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "result_cache.h"
+
+#include <cstring>
+
+const size_t ResultCache::SHARDS;
+const size_t ResultCache::WAYS;
+
+ResultCache::ResultCache(size_t capacity, size_t keyLength) : 
+	m_keyLength(keyLength), 
+	m_setsPerShard((capacity + SHARDS*WAYS - 1) / (SHARDS*WAYS)),
+	m_shards(new Shard[SHARDS]) {
+
+/*
+	capacity:  The maximum number of results kept, rounded up to a multiple of
+	           SHARDS*WAYS.
+	keyLength: The number of variable values in each key.
+*/
+
+	if(m_setsPerShard == 0) m_setsPerShard = 1;
+
+	size_t slotsPerShard = m_setsPerShard * WAYS;
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		m_shards[i].keys.resize(slotsPerShard * m_keyLength);
+		m_shards[i].values.resize(slotsPerShard);
+		m_shards[i].valid.resize(slotsPerShard, false);
+		m_shards[i].nextVictim.resize(m_setsPerShard, 0);
+	}
+
+}
+
+bool ResultCache::find(const std::vector<double>& key, double& result) {
+
+/*
+	Looks up the result stored for the given variable values. Returns true and
+	sets result on a hit.
+*/
+
+	uint64_t hash = m_hash(key);
+	Shard& shard = m_shards[hash & (SHARDS - 1)];
+	size_t set = (size_t)((hash >> 32) % m_setsPerShard);
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	size_t slot = m_find_slot(shard, set, key);
+
+	if(slot == WAYS) {
+		shard.misses++;
+		return false;
+	}
+
+	result = shard.values[set*WAYS + slot];
+	shard.hits++;
+
+	return true;
+
+}
+
+void ResultCache::insert(const std::vector<double>& key, 
+	const double& result) {
+
+	uint64_t hash = m_hash(key);
+	Shard& shard = m_shards[hash & (SHARDS - 1)];
+	size_t set = (size_t)((hash >> 32) % m_setsPerShard);
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	size_t slot = m_find_slot(shard, set, key);
+
+	if(slot == WAYS) {
+		slot = shard.nextVictim[set];
+		shard.nextVictim[set] = (uint8_t)((slot + 1) % WAYS);
+	}
+
+	size_t index = set*WAYS + slot;
+
+	std::memcpy(&shard.keys[index*m_keyLength], key.data(), 
+		m_keyLength * sizeof(double));
+	shard.values[index] = result;
+	shard.valid[index] = true;
+
+}
+
+void ResultCache::clear() {
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+
+		m_shards[i].valid.assign(m_shards[i].valid.size(), false);
+		m_shards[i].hits = 0;
+		m_shards[i].misses = 0;
+	}
+
+}
+
+ResultCache::Stats ResultCache::stats() const {
+
+/*
+	Returns the capacity and the hit/miss counts summed over all shards.
+*/
+
+	Stats stats {m_setsPerShard * WAYS * SHARDS, 0, 0};
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+
+		stats.hits += m_shards[i].hits;
+		stats.misses += m_shards[i].misses;
+	}
+
+	return stats;
+
+}
+
+uint64_t ResultCache::m_hash(const std::vector<double>& key) const noexcept {
+
+/*
+	Mixes the bit patterns of the key values one by one. Each value is 
+	scrambled before being combined, because doubles with few significant
+	bits (e.g. small integers) only differ in their high bits.
+*/
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for(const auto& val: key) {
+		uint64_t bits;
+		std::memcpy(&bits, &val, sizeof(bits));
+
+		bits ^= bits >> 33;
+		bits *= 0xFF51AFD7ED558CCDULL;
+		bits ^= bits >> 33;
+
+		hash = (hash ^ bits) * 0x100000001B3ULL;
+	}
+
+	hash ^= hash >> 29;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 32;
+
+	return hash;
+
+}
+
+size_t ResultCache::m_find_slot(const Shard& shard, size_t set,
+	const std::vector<double>& key) const noexcept {
+
+/*
+	Returns the slot of the given key in its set, or WAYS if the key is not in
+	the set.
+
+	Must be called with the mutex of the shard locked.
+*/
+
+	for(size_t slot = 0; slot < WAYS; slot++) {
+		size_t index = set*WAYS + slot;
+
+		if(!shard.valid[index]) continue;
+
+		if(std::memcmp(&shard.keys[index*m_keyLength], key.data(), 
+			m_keyLength * sizeof(double)) == 0) return slot;
+	}
+
+	return WAYS;
+
+}
@@ -0,0 +1,79 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+
+class ResultCache {
+
+/*
+	Bounded cache of calculation results, keyed by the values of all variables
+	of an expression. Safe to use from multiple threads.
+
+	The cache is split into SHARDS shards, each guarded by its own mutex, so 
+	that threads looking up different keys rarely contend. Each shard is a 
+	WAYS-way set-associative table: a key can be stored in any of the WAYS 
+	slots of its set, and a new entry evicts the entries of its set in 
+	round-robin order. Keys are compared bitwise, so that 0.0 and -0.0 are 
+	different keys.
+*/
+
+public:
+	struct Stats {
+		size_t capacity;
+		size_t hits;
+		size_t misses;
+	};
+
+	ResultCache(size_t capacity, size_t keyLength);
+
+	bool find(const std::vector<double>& key, double& result);
+	void insert(const std::vector<double>& key, const double& result);
+	void clear();
+
+	Stats stats() const;
+
+	virtual ~ResultCache() = default;
+
+protected:
+	static const size_t SHARDS = 16; // power of 2
+	static const size_t WAYS = 4;
+
+	struct Shard {
+		std::mutex mutex;
+		std::vector<uint64_t> keys; // keyLength values per slot
+		std::vector<double> values;
+		std::vector<bool> valid;
+		std::vector<uint8_t> nextVictim; // per set
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	size_t m_keyLength;
+	size_t m_setsPerShard;
+
+	std::unique_ptr<Shard[]> m_shards;
+
+	uint64_t m_hash(const std::vector<double>& key) const noexcept;
+	size_t m_find_slot(const Shard& shard, size_t set, 
+		const std::vector<double>& key) const noexcept;
+
+};
+
+#endif // !RESULT_CACHE_H
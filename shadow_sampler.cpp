@@ -0,0 +1,235 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "shadow_sampler.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+const size_t ShadowSampler::NUM_TIERS;
+
+ShadowSampler::ShadowSampler(const Config& config): m_config(config) {
+
+	double rate = std::max(0.0, std::min(1.0, config.sampleRate));
+
+	m_threshold = rate >= 1.0 ? std::numeric_limits<uint64_t>::max() :
+		(uint64_t)(rate * 18446744073709551616.0); // 2^64
+
+	m_tokens = (double)config.maxChecksPerSecond;
+	m_lastRefill = Clock::now();
+
+}
+
+bool ShadowSampler::sample(Tier tier) {
+
+/*
+	Decides whether to check the current call. Returns true if the call was
+	sampled and fits in the budget.
+*/
+
+	if(m_random() >= m_threshold) return false;
+
+	return m_take_tokens(tier, 1) == 1;
+
+}
+
+std::vector<size_t> ShadowSampler::sample_rows(Tier tier, size_t numRows) {
+
+/*
+	Returns the rows of a batch to check, in increasing order. The gaps 
+	between the sampled rows are drawn from the geometric distribution, so 
+	that batches cost one random number per sampled row instead of one per 
+	row. If the budget does not cover all sampled rows, an evenly spread subset
+	of them is returned.
+*/
+
+	std::vector<size_t> rows;
+
+	if(m_threshold == 0 || numRows == 0) return rows;
+
+	double rate = std::min(1.0, m_config.sampleRate);
+	double logMiss = std::log1p(-rate);
+
+	for(size_t row = 0; ; row++) {
+		if(rate < 1.0) {
+			// uniform in (0, 1]
+			double u = ((m_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+			double gap = std::floor(std::log(u) / logMiss);
+
+			if(gap >= (double)(numRows - row)) break;
+
+			row += (size_t)gap;
+		}
+
+		if(row >= numRows) break;
+
+		rows.push_back(row);
+	}
+
+	size_t numChecks = m_take_tokens(tier, rows.size());
+
+	if(numChecks < rows.size()) {
+		std::vector<size_t> spread(numChecks);
+
+		for(size_t i = 0; i < numChecks; i++) {
+			spread[i] = rows[i * rows.size() / numChecks];
+		}
+
+		rows = std::move(spread);
+	}
+
+	return rows;
+
+}
+
+void ShadowSampler::check(Tier tier, double expected, double actual, 
+	const std::string& expression, const Inputs& inputs) {
+
+/*
+	Compares the result of the engine with the one of the reference 
+	interpreter. NaNs are equal to each other.
+*/
+
+	double error = 0.0;
+	bool isSame = expected == actual || (expected != expected && 
+		actual != actual);
+
+	if(!isSame) {
+		error = std::fabs(actual - expected);
+		if(expected != 0.0) error /= std::fabs(expected);
+
+		// covers NaN against a number and infinities of different signs
+		if(error != error) error = std::numeric_limits<double>::infinity();
+	}
+
+	double tolerance = m_config.tolerances[(size_t)tier];
+	bool isDivergence = !isSame && !(error <= tolerance && tolerance > 0.0);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		TierStats& tierStats = m_stats[(size_t)tier];
+		tierStats.checks++;
+		tierStats.maxError = std::max(tierStats.maxError, error);
+
+		if(isDivergence) tierStats.divergences++;
+	}
+
+	if(!isDivergence) return;
+
+	Divergence divergence {tier, expression, inputs, expected, actual, error};
+
+	if(m_config.logger) m_config.logger(divergence);
+	else m_log(divergence);
+
+}
+
+ShadowSampler::Stats ShadowSampler::stats() const {
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_stats;
+
+}
+
+const char* ShadowSampler::tier_name(Tier tier) noexcept {
+
+	switch(tier) {
+		case Tier::FIXED:
+			return "fixed";
+		case Tier::RESULT_CACHE:
+			return "result_cache";
+		case Tier::BATCH:
+			return "batch";
+		case Tier::DISTINCT:
+			return "distinct";
+		case Tier::FLOAT_MIXED:
+			return "float_mixed";
+		case Tier::FLOAT_SINGLE:
+			return "float_single";
+		case Tier::NATIVE:
+			return "native";
+		default:
+			return "unknown";
+	}
+
+}
+
+uint64_t ShadowSampler::m_random() const noexcept {
+
+/*
+	xorshift64*, with a state per thread so that sampling takes no lock.
+*/
+
+	thread_local uint64_t state = 0;
+
+	if(state == 0) state = 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)&state;
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 0x2545F4914F6CDD1DULL;
+
+}
+
+size_t ShadowSampler::m_take_tokens(Tier tier, size_t numSamples) {
+
+/*
+	Token bucket holding up to maxChecksPerSecond tokens, refilled at 
+	maxChecksPerSecond tokens per second. Returns how many of the samples fit
+	in the budget, and counts the rest as skipped.
+*/
+
+	if(numSamples == 0) return 0;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Clock::time_point now = Clock::now();
+	double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+	double capacity = (double)m_config.maxChecksPerSecond;
+
+	m_tokens = std::min(capacity, m_tokens + elapsed * capacity);
+	m_lastRefill = now;
+
+	size_t numTaken = std::min(numSamples, (size_t)m_tokens);
+	m_tokens -= (double)numTaken;
+
+	m_stats[(size_t)tier].skipped += numSamples - numTaken;
+
+	return numTaken;
+
+}
+
+void ShadowSampler::m_log(const Divergence& divergence) const {
+
+	std::ostringstream line;
+	line << std::setprecision(17) << "shadow divergence: tier=" << 
+		tier_name(divergence.tier) << " expr=\"" << divergence.expression << 
+		"\" inputs={";
+
+	for(size_t i = 0; i < divergence.inputs.size(); i++) {
+		line << (i ? ", " : "") << divergence.inputs[i].first << "=" << 
+			divergence.inputs[i].second;
+	}
+
+	line << "} expected=" << divergence.expected << " actual=" << 
+		divergence.actual << " error=" << divergence.error << "\n";
+
+	std::cerr << line.str();
+
+}
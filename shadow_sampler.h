@@ -0,0 +1,130 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef SHADOW_SAMPLER_H
+#define SHADOW_SAMPLER_H
+
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <functional>
+
+
+class ShadowSampler {
+
+/*
+	Compares a sample of the results of an optimized engine with the results of 
+	the reference interpreter (MathInterpreter::calculate_reference(), which
+	shares no caches or function pointers with the engines), to roll out 
+	faster engines safely under real load. Safe to use from multiple
+	threads.
+
+	Each call, or each row of a batch, is sampled with the probability 
+	Config::sampleRate. At most Config::maxChecksPerSecond samples are 
+	calculated again by the reference interpreter, so that the overhead stays
+	bounded whatever the load; the samples over this budget are only counted.
+	The results are compared within the tolerance of the engine's tier, and 
+	divergences are passed to Config::logger with the expression and the 
+	variable values, or written to std::cerr if no logger is given.
+
+	See MathInterpreter::set_shadow() and NativeModule::set_shadow().
+*/
+
+public:
+	enum class Tier {
+		FIXED,        // fixed-size scalar evaluators
+		RESULT_CACHE, // results returned by the result cache
+		BATCH,        // calculate_batch()
+		DISTINCT,     // calculate_batch() on the distinct rows only
+		FLOAT_MIXED,  // calculate_batch_float() in mixed precision
+		FLOAT_SINGLE, // calculate_batch_float() in single precision
+		NATIVE        // NativeModule
+	};
+
+	static const size_t NUM_TIERS = 7;
+
+	using Inputs = std::vector<std::pair<std::string, double>>;
+
+	struct Divergence {
+		Tier tier;
+		std::string expression;
+		Inputs inputs;
+		double expected; // result of the reference interpreter
+		double actual;   // result of the engine
+		double error;    // relative error, absolute if expected is 0
+	};
+
+	struct Config {
+		double sampleRate = 0.01;
+		size_t maxChecksPerSecond = 1000;
+
+		// largest relative error accepted per tier, 0 to require identical
+		// results
+		std::array<double, NUM_TIERS> tolerances {{
+			0.0,   // FIXED
+			0.0,   // RESULT_CACHE
+			0.0,   // BATCH
+			0.0,   // DISTINCT
+			1e-6,  // FLOAT_MIXED
+			1e-3,  // FLOAT_SINGLE
+			1e-12  // NATIVE, fused multiply-adds of the C compiler
+		}};
+
+		std::function<void(const Divergence&)> logger;
+	};
+
+	struct TierStats {
+		size_t checks;      // samples calculated again and compared
+		size_t divergences; // checks outside the tolerance
+		size_t skipped;     // samples over the budget, not checked
+		double maxError;
+	};
+
+	using Stats = std::array<TierStats, NUM_TIERS>;
+
+	explicit ShadowSampler(const Config& config);
+
+	bool sample(Tier tier);
+	std::vector<size_t> sample_rows(Tier tier, size_t numRows);
+
+	void check(Tier tier, double expected, double actual, 
+		const std::string& expression, const Inputs& inputs);
+
+	Stats stats() const;
+
+	static const char* tier_name(Tier tier) noexcept;
+
+	virtual ~ShadowSampler() = default;
+
+protected:
+	using Clock = std::chrono::steady_clock;
+
+	Config m_config;
+	uint64_t m_threshold; // sampleRate scaled to the range of the generator
+
+	mutable std::mutex m_mutex;
+	double m_tokens;
+	Clock::time_point m_lastRefill;
+	Stats m_stats {};
+
+	uint64_t m_random() const noexcept;
+	size_t m_take_tokens(Tier tier, size_t numSamples);
+	void m_log(const Divergence& divergence) const;
+
+};
+
+#endif // !SHADOW_SAMPLER_H
@@ -0,0 +1,446 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#include "shm_channel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+	ATOMIC_INT_LOCK_FREE == 2, "futex words must be plain lock-free ints");
+
+const uint32_t SharedMemoryChannel::MAGIC;
+const uint32_t SharedMemoryChannel::VERSION;
+const size_t SharedMemoryChannel::CACHE_LINE;
+const int SharedMemoryChannel::SPINS;
+
+SharedMemoryChannel SharedMemoryChannel::create(uint32_t numSlots,
+	uint32_t slotValues) {
+
+/*
+	numSlots:   The number of requests that can be in flight.
+	slotValues: The number of doubles of a request: its variable values, 
+	            and its results.
+
+	Creates a channel in a new memfd, for the server side. Throws 
+	SHM_CHANNEL_ERROR on failure.
+*/
+
+	if(numSlots == 0 || slotValues == 0) {
+		throw SHM_CHANNEL_ERROR("Empty ring");
+	}
+
+	auto roundUp = [](size_t size) {
+		return (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+	};
+
+	size_t slotSize = roundUp(sizeof(Slot) + slotValues * sizeof(double));
+	size_t size = roundUp(sizeof(Header)) + numSlots * slotSize;
+
+	int fd = memfd_create("math_interpreter_channel", MFD_CLOEXEC);
+	if(fd < 0) throw SHM_CHANNEL_ERROR(std::string("memfd_create(): ") + 
+		std::strerror(errno));
+
+	if(ftruncate(fd, size) != 0) {
+		std::string error = std::strerror(errno);
+		close(fd);
+		throw SHM_CHANNEL_ERROR("ftruncate(): " + error);
+	}
+
+	SharedMemoryChannel channel;
+	channel.m_map(fd, size);
+
+	channel.m_numSlots = numSlots;
+	channel.m_slotValues = slotValues;
+	channel.m_slotSize = slotSize;
+	channel.m_requestRows.assign(numSlots, 0);
+
+	// the memory is zeroed, which is the initial value of every field
+	new (channel.m_header) Header();
+
+	channel.m_header->magic = MAGIC;
+	channel.m_header->version = VERSION;
+	channel.m_header->numSlots = numSlots;
+	channel.m_header->slotValues = slotValues;
+	channel.m_header->slotSize = slotSize;
+
+	for(uint32_t i = 0; i < numSlots; i++) {
+		new (&channel.m_slot(i)) Slot();
+	}
+
+	return channel;
+
+}
+
+SharedMemoryChannel::SharedMemoryChannel(int fd) {
+
+/*
+	Attaches to the channel created by the server, for the client side. 
+	Takes the file descriptor over, closing it on failure too. Throws 
+	SHM_CHANNEL_ERROR if it is not a channel.
+*/
+
+	struct stat fdStat;
+
+	if(fstat(fd, &fdStat) != 0 || (size_t)fdStat.st_size < sizeof(Header)) {
+		close(fd);
+		throw SHM_CHANNEL_ERROR("Not a channel");
+	}
+
+	m_map(fd, fdStat.st_size);
+
+	const Header& header = *m_header;
+	size_t headerSize = (sizeof(Header) + CACHE_LINE - 1) / CACHE_LINE * 
+		CACHE_LINE;
+
+	if(header.magic != MAGIC || header.version != VERSION || 
+		header.numSlots == 0 || 
+		header.slotSize < sizeof(Slot) + header.slotValues * sizeof(double) ||
+		headerSize + header.numSlots * header.slotSize != m_size) {
+		munmap(m_header, m_size);
+		close(fd);
+		throw SHM_CHANNEL_ERROR("Not a channel, or of another version");
+	}
+
+	m_numSlots = header.numSlots;
+	m_slotValues = header.slotValues;
+	m_slotSize = header.slotSize;
+	m_requestRows.assign(m_numSlots, 0);
+
+}
+
+SharedMemoryChannel::SharedMemoryChannel(SharedMemoryChannel&& other) noexcept:
+	m_fd(other.m_fd), m_size(other.m_size), m_header(other.m_header),
+	m_slots(other.m_slots), m_numSlots(other.m_numSlots), 
+	m_slotValues(other.m_slotValues), m_slotSize(other.m_slotSize),
+	m_nextTicket(other.m_nextTicket), 
+	m_requestRows(std::move(other.m_requestRows)),
+	m_nextServed(other.m_nextServed) {
+
+	other.m_fd = -1;
+	other.m_header = nullptr;
+	other.m_slots = nullptr;
+
+}
+
+SharedMemoryChannel::~SharedMemoryChannel() {
+
+	if(m_header) munmap(m_header, m_size);
+	if(m_fd >= 0) close(m_fd);
+
+}
+
+int SharedMemoryChannel::fd() const noexcept {
+
+	return m_fd;
+
+}
+
+uint32_t SharedMemoryChannel::num_slots() const noexcept {
+
+	return m_numSlots;
+
+}
+
+uint32_t SharedMemoryChannel::slot_values() const noexcept {
+
+	return m_slotValues;
+
+}
+
+uint64_t SharedMemoryChannel::submit(uint32_t exprId, const double* values, 
+	size_t numRows, size_t numValues) {
+
+/*
+	Writes a request into the next slot, and returns the ticket to wait() 
+	for its results with. Throws SHM_CHANNEL_ERROR if the request does not
+	fit in a slot, if every slot holds a request that was not waited for, 
+	or if the server closed the channel.
+*/
+
+	if(numRows > m_slotValues || numValues > m_slotValues) {
+		throw SHM_CHANNEL_ERROR("The request does not fit in a slot of " + 
+			std::to_string(m_slotValues) + " values");
+	}
+
+	if(m_header->isClosed) throw SHM_CHANNEL_ERROR("Closed by the server");
+
+	Slot& slot = m_slot(m_nextTicket);
+
+	if(slot.state.load(std::memory_order_acquire) != EMPTY) {
+		throw SHM_CHANNEL_ERROR("All slots are in flight; wait() for the "
+			"earlier requests first");
+	}
+
+	slot.exprId = exprId;
+	slot.numRows = (uint32_t)numRows;
+	slot.numValues = (uint32_t)numValues;
+	m_requestRows[m_nextTicket % m_numSlots] = (uint32_t)numRows;
+	slot.isFailed = 0;
+	std::memcpy(m_values(slot), values, numValues * sizeof(double));
+
+	// sequentially consistent with the server's announcement that it 
+	// sleeps, so that either the server sees the request, or this sees 
+	// that it has to wake the server
+	slot.state.store(REQUEST);
+	m_header->requests.fetch_add(1);
+
+	if(m_header->isServerSleeping.load()) m_futex_wake(m_header->requests);
+
+	return m_nextTicket++;
+
+}
+
+void SharedMemoryChannel::wait(uint64_t ticket, double* results) {
+
+/*
+	Waits for the results of the request with the given ticket, and copies 
+	them to results. Throws SHM_CHANNEL_ERROR with the message of the server
+	if the request failed.
+*/
+
+	if(ticket >= m_nextTicket || m_nextTicket - ticket > m_numSlots) {
+		throw SHM_CHANNEL_ERROR("No request in flight for the ticket");
+	}
+
+	Slot& slot = m_slot(ticket);
+	int spins = 0;
+
+	while(true) {
+		uint32_t state = slot.state.load();
+
+		if(state == DONE) break;
+		if(state == EMPTY) {
+			throw SHM_CHANNEL_ERROR("No request in flight for the ticket");
+		}
+
+		if(m_header->isClosed) throw SHM_CHANNEL_ERROR("Closed by the server");
+
+		if(++spins < m_spins()) {
+			m_pause();
+			continue;
+		}
+
+		slot.isClientWaiting.store(1);
+		if(slot.state.load() == REQUEST) m_futex_wait(slot.state, REQUEST);
+		slot.isClientWaiting.store(0);
+
+		spins = 0;
+	}
+
+	const double* values = m_values(slot);
+
+	// the server answers with as many results as there were rows, or with
+	// an error message that fits in the slot
+	if(m_read_once(slot.isFailed)) {
+		std::string error((const char*)values, std::min<size_t>(
+			m_read_once(slot.numRows), m_slotValues * sizeof(double)));
+		slot.state.store(EMPTY, std::memory_order_release);
+
+		throw SHM_CHANNEL_ERROR(error);
+	}
+
+	std::memcpy(results, values, 
+		m_requestRows[ticket % m_numSlots] * sizeof(double));
+	slot.state.store(EMPTY, std::memory_order_release);
+
+}
+
+void SharedMemoryChannel::evaluate(uint32_t exprId, const double* values,
+	size_t numRows, size_t numValues, double* results) {
+
+	wait(submit(exprId, values, numRows, numValues), results);
+
+}
+
+void SharedMemoryChannel::serve(const Handler& handler) {
+
+/*
+	Calculates the requests in the order of the ring, until close_channel()
+	is called from another thread.
+*/
+
+	while(!m_header->isClosed) {
+		Slot& slot = m_slot(m_nextServed);
+		int spins = 0;
+
+		while(slot.state.load() != REQUEST) {
+			if(m_header->isClosed) return;
+
+			if(++spins < m_spins()) {
+				m_pause();
+				continue;
+			}
+
+			uint32_t requests = m_header->requests.load();
+
+			m_header->isServerSleeping.store(1);
+
+			if(slot.state.load() != REQUEST && !m_header->isClosed) {
+				m_futex_wait(m_header->requests, requests);
+			}
+
+			m_header->isServerSleeping.store(0);
+
+			spins = 0;
+		}
+
+		double* values = m_values(slot);
+		size_t maxBytes = m_slotValues * sizeof(double);
+		std::string error;
+		bool isDone = false;
+
+		// the client may write anything into the slot, at any time: read 
+		// the request once, and only use the copies after checking them
+		uint32_t exprId = m_read_once(slot.exprId);
+		uint32_t numRows = m_read_once(slot.numRows);
+		uint32_t numValues = m_read_once(slot.numValues);
+
+		if(numRows > m_slotValues || numValues > m_slotValues) {
+			error = "The request does not fit in a slot";
+		}
+		else {
+			try {
+				isDone = handler(exprId, values, numRows, numValues, values, 
+					error);
+			}
+			catch(const std::exception& e) {
+				error = e.what();
+			}
+		}
+
+		if(!isDone) {
+			size_t length = std::min(error.size(), maxBytes);
+
+			std::memcpy(values, error.data(), length);
+			slot.numRows = (uint32_t)length;
+			slot.isFailed = 1;
+		}
+
+		slot.state.store(DONE);
+		if(slot.isClientWaiting.load()) m_futex_wake(slot.state);
+
+		m_nextServed++;
+	}
+
+}
+
+void SharedMemoryChannel::close_channel() noexcept {
+
+/*
+	Makes serve() return, and the waiting client calls throw.
+*/
+
+	m_header->isClosed = 1;
+	m_header->requests.fetch_add(1);
+	m_futex_wake(m_header->requests);
+
+	for(uint32_t i = 0; i < m_numSlots; i++) {
+		m_futex_wake(m_slot(i).state);
+	}
+
+}
+
+void SharedMemoryChannel::m_map(int fd, size_t size) {
+
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, 
+		fd, 0);
+
+	if(address == MAP_FAILED) {
+		std::string error = std::strerror(errno);
+		close(fd);
+		throw SHM_CHANNEL_ERROR("mmap(): " + error);
+	}
+
+	m_fd = fd;
+	m_size = size;
+	m_header = (Header*)address;
+	m_slots = (char*)address + (sizeof(Header) + CACHE_LINE - 1) / 
+		CACHE_LINE * CACHE_LINE;
+
+}
+
+SharedMemoryChannel::Slot& SharedMemoryChannel::m_slot(
+	uint64_t ticket) const noexcept {
+
+	return *(Slot*)(m_slots + (ticket % m_numSlots) * m_slotSize);
+
+}
+
+double* SharedMemoryChannel::m_values(Slot& slot) const noexcept {
+
+	return (double*)((char*)&slot + sizeof(Slot));
+
+}
+
+uint32_t SharedMemoryChannel::m_read_once(const uint32_t& word) noexcept {
+
+/*
+	Reads a word of the shared memory exactly once, so that the compiler 
+	cannot read it again after it was checked.
+*/
+
+	return *(const volatile uint32_t*)&word;
+
+}
+
+int SharedMemoryChannel::m_spins() noexcept {
+
+/*
+	Returns the number of times to spin before sleeping: none if the process
+	may only run on one CPU.
+*/
+
+	static const int spins = []() {
+		cpu_set_t cpus;
+
+		if(sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && 
+			CPU_COUNT(&cpus) == 1) {
+			return 0;
+		}
+
+		return SPINS;
+	}();
+
+	return spins;
+
+}
+
+void SharedMemoryChannel::m_futex_wait(std::atomic<uint32_t>& word, 
+	uint32_t val) noexcept {
+
+/*
+	Sleeps until woken, unless word no longer has the value val. Not private
+	to the process, since the word is in shared memory.
+*/
+
+	syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, val, nullptr, nullptr, 
+		0);
+
+}
+
+void SharedMemoryChannel::m_futex_wake(std::atomic<uint32_t>& word) noexcept {
+
+	syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT32_MAX, nullptr, 
+		nullptr, 0);
+
+}
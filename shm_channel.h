@@ -0,0 +1,182 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <string>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <vector>
+
+
+class SHM_CHANNEL_ERROR: public std::exception {
+
+public:
+	SHM_CHANNEL_ERROR(const std::string& details) {
+		m_returnMessage = "Shared memory channel error: " + details;
+	}
+
+	virtual const char* what() const noexcept {
+		return m_returnMessage.c_str();
+	}
+
+private:
+	std::string m_returnMessage;
+
+};
+
+class SharedMemoryChannel {
+
+/*
+	Ring of request slots in shared memory (memfd), through which a client
+	process has expressions calculated by a server process on the same host
+	without a system call per request while both sides are busy. Linux only
+	(memfd, futex).
+
+	The server creates the channel, and passes its file descriptor to the
+	client, e.g. with the OPEN_CHANNEL request of EvaluationServer, which
+	sends it over the Unix socket. The client attaches to it:
+
+		e.g. SharedMemoryChannel channel(fd); // closes fd when destroyed
+
+			 // exprId from the COMPILE request, values row by row
+			 channel.evaluate(exprId, values, numRows, numValues, results);
+
+	A request is written into the next slot of the ring: the expression id,
+	the number of rows, and the variable values. The server calculates it
+	and writes the results into the same slot, over the values. Each slot
+	has a state word (empty, request, done), an atomic that passes the slot
+	and its contents between the two sides. submit() and wait() split
+	evaluate() so that up to numSlots requests are in flight.
+
+	Waiting sides spin for a while (unless the process may only run on one
+	CPU, where spinning keeps the other side from running), then sleep on 
+	a futex in the shared memory. A side only makes the futex wake-up call when the other side
+	announced that it sleeps, so that no system calls are made while
+	requests keep coming.
+
+	A channel has a single client thread: submit() and wait() must not be
+	called from several threads at once. Use a channel per client thread.
+*/
+
+public:
+	// calculates numRows rows of the expression, from the values given
+	// row by row, into results. Returns false with an error message if the
+	// request cannot be calculated. results may overlap values
+	using Handler = std::function<bool(uint32_t exprId, const double* values,
+		size_t numRows, size_t numValues, double* results,
+		std::string& error)>;
+
+	static SharedMemoryChannel create(uint32_t numSlots, uint32_t slotValues);
+	explicit SharedMemoryChannel(int fd);
+
+	SharedMemoryChannel(SharedMemoryChannel&& other) noexcept;
+	SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+	SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+	int fd() const noexcept;
+	uint32_t num_slots() const noexcept;
+	uint32_t slot_values() const noexcept;
+
+	// client
+	uint64_t submit(uint32_t exprId, const double* values, size_t numRows,
+		size_t numValues);
+	void wait(uint64_t ticket, double* results);
+	void evaluate(uint32_t exprId, const double* values, size_t numRows,
+		size_t numValues, double* results);
+
+	// server
+	void serve(const Handler& handler);
+	void close_channel() noexcept;
+
+	virtual ~SharedMemoryChannel();
+
+protected:
+	static const uint32_t MAGIC = 0x4D455843; // "MEXC"
+	static const uint32_t VERSION = 1;
+	static const size_t CACHE_LINE = 64;
+	static const int SPINS = 4000;
+
+	enum SlotState: uint32_t {
+		EMPTY = 0,
+		REQUEST = 1,
+		DONE = 2
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t numSlots;
+		uint32_t slotValues; // doubles per slot
+		uint64_t slotSize;   // bytes, with the slot header
+
+		// futex of the server, advanced with every request
+		alignas(CACHE_LINE) std::atomic<uint32_t> requests;
+		std::atomic<uint32_t> isServerSleeping;
+		std::atomic<uint32_t> isClosed;
+	};
+
+	// followed by slotValues doubles
+	struct alignas(CACHE_LINE) Slot {
+		std::atomic<uint32_t> state; // futex of the client
+		std::atomic<uint32_t> isClientWaiting;
+		uint32_t exprId;
+		uint32_t numRows;  // the length of the message if failed
+		uint32_t numValues;
+		uint32_t isFailed;
+	};
+
+	int m_fd = -1;
+	size_t m_size = 0;
+	Header* m_header = nullptr;
+	char* m_slots = nullptr;
+
+	// the geometry of the ring, kept out of the shared memory so that the 
+	// other side cannot change how this side indexes the mapping
+	uint32_t m_numSlots = 0;
+	uint32_t m_slotValues = 0;
+	size_t m_slotSize = 0;
+
+	uint64_t m_nextTicket = 0; // client
+	std::vector<uint32_t> m_requestRows; // client, the rows of each slot
+	uint64_t m_nextServed = 0; // server
+
+	SharedMemoryChannel() = default;
+
+	void m_map(int fd, size_t size);
+	Slot& m_slot(uint64_t ticket) const noexcept;
+	double* m_values(Slot& slot) const noexcept;
+	static uint32_t m_read_once(const uint32_t& word) noexcept;
+
+	static int m_spins() noexcept;
+	static inline void m_pause() noexcept;
+	static void m_futex_wait(std::atomic<uint32_t>& word,
+		uint32_t val) noexcept;
+	static void m_futex_wake(std::atomic<uint32_t>& word) noexcept;
+
+};
+
+void SharedMemoryChannel::m_pause() noexcept {
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+
+}
+
+#endif // !SHM_CHANNEL_H
@@ -0,0 +1,505 @@
+/*
+Program:        Math Expression Parser v1.0.
+Author:         Deniz Bilgili
+				Technical University of Istanbul,
+				Department of Mechanical Engineering
+Date published: 05.2017
+
+This code is shared publicly, under the MIT License. To see the license, please
+refer to the LICENSE.txt file.
+
+Please do not delete this section.
+*/
+
+#ifndef STATIC_EXPR_H
+#define STATIC_EXPR_H
+
+#if __cplusplus < 202002L
+#error "static_expr.h requires C++20."
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846  /* pi */
+#endif // !M_PI
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+namespace static_expr_detail {
+
+/*
+	Compile-time front end of the interpreter. See StaticExpr below for how to
+	use it; nothing in this namespace is meant to be used directly.
+*/
+
+template<std::size_t N>
+struct FixedString {
+
+/*
+	String literal usable as a template argument.
+*/
+
+	char chars[N] {};
+
+	constexpr FixedString(const char (&str)[N]) {
+		for(std::size_t i = 0; i < N; i++) chars[i] = str[i];
+	}
+
+	constexpr std::string_view view() const {
+		return std::string_view(chars, N - 1);
+	}
+
+};
+
+// Same functions as MathInterpreter::FUNCTION, keep both in sync
+enum class Function {
+	LOG,
+	LOG10,
+	SIN,
+	COS,
+	TAN,
+	COT,
+	ASIN,
+	ACOS,
+	ATAN,
+	ACOT,
+	DEG,
+	RAD,
+	SQRT,
+	EXP,
+	ABS
+};
+
+enum class NodeType {
+	NUMBER,
+	VARIABLE,
+	OPERATOR,
+	FUNCTION
+};
+
+struct Node {
+	NodeType type = NodeType::NUMBER;
+	double value = 0.0;                // NUMBER
+	std::size_t slot = 0;              // VARIABLE
+	char op = 0;                       // OPERATOR
+	Function func = Function::ABS;     // FUNCTION
+	std::size_t lhs = 0;               // OPERATOR, argument of FUNCTION
+	std::size_t rhs = 0;               // OPERATOR
+};
+
+template<std::size_t MaxNodes>
+struct Program {
+	std::array<Node, MaxNodes> nodes {};
+	std::size_t numNodes = 0;
+	std::size_t root = 0;
+
+	std::array<std::string_view, MaxNodes> varNames {};
+	std::size_t numVars = 0;
+};
+
+inline void syntax_error(const char* what) {
+
+/*
+	Not constexpr on purpose: reaching a call while parsing at compile time
+	stops the compilation, and the compiler shows the message in the error.
+*/
+
+	(void)what;
+
+}
+
+template<std::size_t MaxNodes>
+class Parser {
+
+/*
+	Recursive descent parser with the same syntax and operator precedences as
+	MathInterpreter. Like there, all binary operators (including ^) are left
+	associative.
+*/
+
+public:
+	constexpr explicit Parser(std::string_view input) : m_input(input) {}
+
+	constexpr Program<MaxNodes> parse() {
+		m_program.root = m_parse_expr(0);
+
+		m_skip_whitespaces();
+		if(m_pos != m_input.size()) syntax_error("Unexpected character.");
+
+		return m_program;
+	}
+
+private:
+	std::string_view m_input;
+	std::size_t m_pos = 0;
+
+	Program<MaxNodes> m_program {};
+
+	constexpr void m_skip_whitespaces() {
+		while(m_pos < m_input.size() && (m_input[m_pos] == ' ' || 
+			m_input[m_pos] == '\t' || m_input[m_pos] == '\n' || 
+			m_input[m_pos] == '\r')) m_pos++;
+	}
+
+	constexpr char m_peek() {
+		m_skip_whitespaces();
+		return m_pos < m_input.size() ? m_input[m_pos] : '\0';
+	}
+
+	constexpr std::size_t m_add(const Node& node) {
+		m_program.nodes[m_program.numNodes] = node;
+		return m_program.numNodes++;
+	}
+
+	static constexpr int m_precedence(char op) {
+		switch(op) {
+			case '+':
+			case '-':
+				return 2;
+			case '*':
+			case '/':
+			case '%':
+				return 3;
+			case '^':
+				return 4;
+			default:
+				return -1;
+		}
+	}
+
+	constexpr std::size_t m_parse_expr(int minPrecedence) {
+		std::size_t lhs = m_parse_unary();
+
+		while(true) {
+			char op = m_peek();
+			int precedence = m_precedence(op);
+
+			if(precedence < minPrecedence || precedence < 0) break;
+
+			m_pos++;
+			std::size_t rhs = m_parse_expr(precedence + 1);
+
+			Node node;
+			node.type = NodeType::OPERATOR;
+			node.op = op;
+			node.lhs = lhs;
+			node.rhs = rhs;
+
+			lhs = m_add(node);
+		}
+
+		return lhs;
+	}
+
+	constexpr std::size_t m_parse_unary() {
+		char token = m_peek();
+
+		if(token != '-' && token != '+') return m_parse_primary();
+
+		m_pos++;
+		std::size_t operand = m_parse_unary();
+
+		if(token == '+') return operand;
+
+		// negative numbers are folded, other operands are multiplied by -1,
+		// which flips the sign exactly
+		if(m_program.nodes[operand].type == NodeType::NUMBER) {
+			m_program.nodes[operand].value = -m_program.nodes[operand].value;
+			return operand;
+		}
+
+		Node minusOne;
+		minusOne.value = -1.0;
+
+		Node node;
+		node.type = NodeType::OPERATOR;
+		node.op = '*';
+		node.lhs = m_add(minusOne);
+		node.rhs = operand;
+
+		return m_add(node);
+	}
+
+	constexpr std::size_t m_parse_primary() {
+		char token = m_peek();
+
+		if((token >= '0' && token <= '9') || token == '.') {
+			return m_parse_number();
+		}
+		if(token == '$') return m_parse_variable();
+		if(token == '(') {
+			m_pos++;
+			std::size_t inner = m_parse_expr(0);
+
+			if(m_peek() != ')') syntax_error("Missing right parenthesis.");
+			m_pos++;
+
+			return inner;
+		}
+		if((token >= 'a' && token <= 'z') || (token >= 'A' && token <= 'Z')) {
+			return m_parse_function();
+		}
+
+		syntax_error("Expected a number, variable, function or parenthesis.");
+		return 0;
+	}
+
+	constexpr std::size_t m_parse_number() {
+		// the digits are collected in an integer and divided by a power of ten
+		// once, which rounds correctly as long as both are exact doubles
+		std::uint64_t mantissa = 0;
+		int numDigits = 0;
+		int fractionDigits = 0;
+		bool pointFound = false;
+
+		while(m_pos < m_input.size()) {
+			char digit = m_input[m_pos];
+
+			if(digit == '.') {
+				if(pointFound) syntax_error("Number with two decimal points.");
+				pointFound = true;
+			}
+			else if(digit >= '0' && digit <= '9') {
+				mantissa = mantissa*10 + (std::uint64_t)(digit - '0');
+				numDigits++;
+				if(pointFound) fractionDigits++;
+			}
+			else {
+				break;
+			}
+
+			m_pos++;
+		}
+
+		if(numDigits == 0) syntax_error("Number without digits.");
+		if(numDigits > 19) syntax_error("Number with too many digits.");
+
+		double scale = 1.0;
+		for(int i = 0; i < fractionDigits; i++) scale *= 10.0;
+
+		Node node;
+		node.value = (double)mantissa / scale;
+
+		return m_add(node);
+	}
+
+	constexpr std::size_t m_parse_variable() {
+		std::size_t nameBegin = ++m_pos; // skip the left $ sign
+
+		while(m_pos < m_input.size() && m_input[m_pos] != '$') m_pos++;
+
+		if(m_pos == m_input.size()) syntax_error("Missing right $ sign.");
+
+		std::string_view name = m_input.substr(nameBegin, m_pos - nameBegin);
+		m_pos++; // skip the right $ sign
+
+		if(name.empty()) syntax_error("Variable without a name.");
+
+		Node node;
+
+		if(name == "pi" || name == "PI") {
+			node.value = M_PI;
+			return m_add(node);
+		}
+
+		std::size_t slot = 0;
+
+		while(slot < m_program.numVars && m_program.varNames[slot] != name) {
+			slot++;
+		}
+
+		if(slot == m_program.numVars) {
+			m_program.varNames[m_program.numVars++] = name;
+		}
+
+		node.type = NodeType::VARIABLE;
+		node.slot = slot;
+
+		return m_add(node);
+	}
+
+	constexpr std::size_t m_parse_function() {
+		std::size_t nameBegin = m_pos;
+
+		while(m_pos < m_input.size() && m_input[m_pos] != '(' && 
+			m_input[m_pos] != ' ') m_pos++;
+
+		std::string_view name = m_input.substr(nameBegin, m_pos - nameBegin);
+
+		Node node;
+		node.type = NodeType::FUNCTION;
+		node.func = m_function(name);
+
+		if(m_peek() != '(') syntax_error("Function without parentheses.");
+		m_pos++;
+
+		node.lhs = m_parse_expr(0);
+
+		if(m_peek() != ')') syntax_error("Missing right parenthesis.");
+		m_pos++;
+
+		return m_add(node);
+	}
+
+	static constexpr Function m_function(std::string_view name) {
+		if(name == "LOG" || name == "log") return Function::LOG;
+		if(name == "LOG10" || name == "log10") return Function::LOG10;
+		if(name == "SIN" || name == "sin") return Function::SIN;
+		if(name == "COS" || name == "cos") return Function::COS;
+		if(name == "TAN" || name == "tan") return Function::TAN;
+		if(name == "COT" || name == "cot") return Function::COT;
+		if(name == "ASIN" || name == "asin") return Function::ASIN;
+		if(name == "ACOS" || name == "acos") return Function::ACOS;
+		if(name == "ATAN" || name == "atan") return Function::ATAN;
+		if(name == "ACOT" || name == "acot") return Function::ACOT;
+		if(name == "DEG" || name == "deg") return Function::DEG;
+		if(name == "RAD" || name == "rad") return Function::RAD;
+		if(name == "SQRT" || name == "sqrt") return Function::SQRT;
+		if(name == "EXP" || name == "exp") return Function::EXP;
+		if(name == "ABS" || name == "abs") return Function::ABS;
+
+		syntax_error("Unknown function.");
+		return Function::ABS;
+	}
+
+};
+
+template<FixedString Str>
+consteval auto parse() {
+
+	// every character adds at most two nodes (unary minus on a non-number)
+	Parser<2*sizeof(Str.chars) + 1> parser(Str.view());
+
+	return parser.parse();
+
+}
+
+template<Function Func, typename Real>
+inline Real apply_function(const Real& val) {
+
+	if constexpr(Func == Function::LOG) return std::log(val);
+	else if constexpr(Func == Function::LOG10) return std::log10(val);
+	else if constexpr(Func == Function::SIN) return std::sin(val);
+	else if constexpr(Func == Function::COS) return std::cos(val);
+	else if constexpr(Func == Function::TAN) return std::tan(val);
+	else if constexpr(Func == Function::COT) return 1/std::tan(val);
+	else if constexpr(Func == Function::ASIN) return std::asin(val);
+	else if constexpr(Func == Function::ACOS) return std::acos(val);
+	else if constexpr(Func == Function::ATAN) return std::atan(val);
+	else if constexpr(Func == Function::ACOT) return std::atan(1/val);
+	else if constexpr(Func == Function::DEG) return (val/(2*(Real)M_PI))*360;
+	else if constexpr(Func == Function::RAD) return (val/360)*2*(Real)M_PI;
+	else if constexpr(Func == Function::SQRT) return std::sqrt(val);
+	else if constexpr(Func == Function::EXP) return std::exp(val);
+	else return std::abs(val);
+
+}
+
+template<const auto& Prog, std::size_t Index>
+struct Expr {
+
+/*
+	Expression template of the node Prog.nodes[Index]. The whole tree is known
+	at compile time, so eval() compiles to straight-line code.
+*/
+
+	static constexpr const Node& node = Prog.nodes[Index];
+
+	template<typename Real>
+	static inline Real eval(const Real* vars) {
+		if constexpr(node.type == NodeType::NUMBER) {
+			return (Real)node.value;
+		}
+		else if constexpr(node.type == NodeType::VARIABLE) {
+			return vars[node.slot];
+		}
+		else if constexpr(node.type == NodeType::FUNCTION) {
+			return apply_function<node.func>(
+				Expr<Prog, node.lhs>::template eval<Real>(vars));
+		}
+		else {
+			Real lVal = Expr<Prog, node.lhs>::template eval<Real>(vars);
+			Real rVal = Expr<Prog, node.rhs>::template eval<Real>(vars);
+
+			if constexpr(node.op == '+') return lVal + rVal;
+			else if constexpr(node.op == '-') return lVal - rVal;
+			else if constexpr(node.op == '*') return lVal * rVal;
+			else if constexpr(node.op == '/') return lVal / rVal;
+			else if constexpr(node.op == '%') return std::fmod(lVal, rVal);
+			else return std::pow(lVal, rVal);
+		}
+	}
+
+};
+
+} // namespace static_expr_detail
+
+
+template<static_expr_detail::FixedString Str>
+class StaticExpr {
+
+/*
+	Mathematical expression parsed at compile time. Use it for expressions 
+	that are fixed in the source code: the compiler inlines and optimizes the
+	whole expression, and there is nothing to parse or interpret at runtime.
+	Requires C++20.
+
+	How to use:
+		1. Create the expression with the MATH_EXPR macro. The syntax is the
+		   same as for MathInterpreter. Syntax errors, unknown functions etc.
+		   are compilation errors.
+
+			e.g. constexpr auto expr = MATH_EXPR("sin(rad($x$)) * $y$");
+
+		2. Call the expression with the values of the variables, in the 
+		   order in which the variables first appear in the expression. Use
+		   slot() to get the position of a variable at compile time.
+
+			e.g. double result = expr(37.81, 75.0);
+
+			e.g. double vars[expr.num_vars()];
+				 vars[expr.slot("x")] = 37.81;
+				 vars[expr.slot("y")] = 75.0;
+				 double result = expr.eval(vars);
+*/
+
+private:
+	static constexpr auto m_program = static_expr_detail::parse<Str>();
+
+	using Root = static_expr_detail::Expr<m_program, m_program.root>;
+
+public:
+	static consteval std::size_t num_vars() {
+		return m_program.numVars;
+	}
+
+	static consteval std::size_t slot(std::string_view varName) {
+		for(std::size_t i = 0; i < m_program.numVars; i++) {
+			if(m_program.varNames[i] == varName) return i;
+		}
+
+		static_expr_detail::syntax_error("Unknown variable.");
+		return 0;
+	}
+
+	template<typename Real>
+	static inline Real eval(const Real* vars) {
+		return Root::template eval<Real>(vars);
+	}
+
+	template<typename... Args>
+		requires (sizeof...(Args) == m_program.numVars)
+	inline double operator()(Args... args) const {
+		const std::array<double, sizeof...(Args)> vars {(double)args...};
+		return Root::template eval<double>(vars.data());
+	}
+
+};
+
+#define MATH_EXPR(expr) (StaticExpr<expr>{})
+
+#endif // !STATIC_EXPR_H